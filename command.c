@@ -22,6 +22,7 @@
 
 #include "driver.h"
 #include "general.h"
+#include "performance.h"
 #include "compat/strl.h"
 #include "compat/posix_string.h"
 #include <stdio.h>
@@ -177,7 +178,46 @@ static const struct cmd_map map[] = {
    { "SLOWMOTION",             RARCH_SLOWMOTION },
 };
 
-static void parse_sub_msg(rarch_cmd_t *handle, const char *tok)
+// Queries are answered immediately, to whoever sent them.
+struct cmd_query
+{
+   const char *str;
+   size_t (*reply)(char *buf, size_t size);
+};
+
+static const struct cmd_query queries[] = {
+   { "GET_PERF", rarch_perf_report },
+};
+
+// Where a command came from. Network commands are replied to over UDP, stdin commands on stdout.
+struct cmd_source
+{
+#ifdef HAVE_NETWORK_CMD
+   int fd;
+   const struct sockaddr *addr;
+   socklen_t addr_len;
+#else
+   char dummy; // Empty structs are not valid C.
+#endif
+};
+
+static void cmd_reply(const struct cmd_source *source, const char *data, size_t size)
+{
+#ifdef HAVE_NETWORK_CMD
+   if (source && source->addr)
+   {
+      sendto(source->fd, CONST_CAST data, size, 0, source->addr, source->addr_len);
+      return;
+   }
+#else
+   (void)source;
+#endif
+
+   fwrite(data, 1, size, stdout);
+   fflush(stdout);
+}
+
+static void parse_sub_msg(rarch_cmd_t *handle, const char *tok, const struct cmd_source *source)
 {
    for (unsigned i = 0; i < sizeof(map) / sizeof(map[0]); i++)
    {
@@ -188,16 +228,32 @@ static void parse_sub_msg(rarch_cmd_t *handle, const char *tok)
       }
    }
 
+   for (unsigned i = 0; i < sizeof(queries) / sizeof(queries[0]); i++)
+   {
+      if (strcmp(tok, queries[i].str) == 0)
+      {
+         char buf[8192];
+         size_t size = queries[i].reply(buf, sizeof(buf));
+         if (size >= sizeof(buf))
+            size = sizeof(buf) - 1;
+
+         // Always terminate a reply with an empty line, so empty replies can be told apart from lost ones.
+         buf[size] = '\n';
+         cmd_reply(source, buf, size + 1);
+         return;
+      }
+   }
+
    RARCH_WARN("Unrecognized command \"%s\" received.\n", tok);
 }
 
-static void parse_msg(rarch_cmd_t *handle, char *buf)
+static void parse_msg(rarch_cmd_t *handle, char *buf, const struct cmd_source *source)
 {
    char *save;
    const char *tok = strtok_r(buf, "\n", &save);
    while (tok)
    {
-      parse_sub_msg(handle, tok);
+      parse_sub_msg(handle, tok, source);
       tok = strtok_r(NULL, "\n", &save);
    }
 }
@@ -233,12 +289,16 @@ static void network_cmd_pre_frame(rarch_cmd_t *handle)
    for (;;)
    {
       char buf[1024];
-      ssize_t ret = recvfrom(handle->net_fd, buf, sizeof(buf) - 1, 0, NULL, NULL);
+      struct sockaddr_storage addr;
+      socklen_t addr_len = sizeof(addr);
+      ssize_t ret = recvfrom(handle->net_fd, NONCONST_CAST buf, sizeof(buf) - 1, 0, (struct sockaddr*)&addr, &addr_len);
       if (ret <= 0)
          break;
 
       buf[ret] = '\0';
-      parse_msg(handle, buf);
+
+      struct cmd_source source = { handle->net_fd, (const struct sockaddr*)&addr, addr_len };
+      parse_msg(handle, buf, &source);
    }
 }
 #endif
@@ -373,7 +433,7 @@ static void stdin_cmd_pre_frame(rarch_cmd_t *handle)
    *last_newline++ = '\0';
    ptrdiff_t msg_len = last_newline - handle->stdin_buf;
 
-   parse_msg(handle, handle->stdin_buf);
+   parse_msg(handle, handle->stdin_buf, NULL);
 
    memmove(handle->stdin_buf, last_newline, handle->stdin_buf_ptr - msg_len);
    handle->stdin_buf_ptr -= msg_len;
@@ -394,7 +454,29 @@ void rarch_cmd_pre_frame(rarch_cmd_t *handle)
 }
 
 #ifdef HAVE_NETWORK_CMD
-static bool send_udp_packet(const char *host, uint16_t port, const char *msg)
+// Waits briefly for the reply to a query and prints it.
+static bool recv_udp_reply(int fd)
+{
+   fd_set fds;
+   FD_ZERO(&fds);
+   FD_SET(fd, &fds);
+
+   struct timeval tv = {0};
+   tv.tv_usec = 500000;
+   if (select(fd + 1, &fds, NULL, NULL, &tv) <= 0)
+      return false;
+
+   char buf[8192];
+   ssize_t ret = recvfrom(fd, NONCONST_CAST buf, sizeof(buf), 0, NULL, NULL);
+   if (ret <= 0)
+      return false;
+
+   fwrite(buf, 1, ret, stdout);
+   fflush(stdout);
+   return true;
+}
+
+static bool send_udp_packet(const char *host, uint16_t port, const char *msg, bool query)
 {
    struct addrinfo hints, *res = NULL;
    memset(&hints, 0, sizeof(hints));
@@ -433,6 +515,10 @@ static bool send_udp_packet(const char *host, uint16_t port, const char *msg)
          goto end;
       }
 
+      // Only one of the targets is expected to answer.
+      if (query && recv_udp_reply(fd))
+         goto end;
+
       close(fd);
       fd = -1;
       tmp = tmp->ai_next;
@@ -445,6 +531,17 @@ end:
    return ret;
 }
 
+static bool is_query(const char *cmd)
+{
+   for (unsigned i = 0; i < sizeof(queries) / sizeof(queries[0]); i++)
+   {
+      if (strcmp(queries[i].str, cmd) == 0)
+         return true;
+   }
+
+   return false;
+}
+
 static bool verify_command(const char *cmd)
 {
    for (unsigned i = 0; i < sizeof(map) / sizeof(map[0]); i++)
@@ -453,10 +550,15 @@ static bool verify_command(const char *cmd)
          return true;
    }
 
+   if (is_query(cmd))
+      return true;
+
    RARCH_ERR("Command \"%s\" is not recognized by RetroArch.\n", cmd);
    RARCH_ERR("\tValid commands:\n");
    for (unsigned i = 0; i < sizeof(map) / sizeof(map[0]); i++)
       RARCH_ERR("\t\t%s\n", map[i].str);
+   for (unsigned i = 0; i < sizeof(queries) / sizeof(queries[0]); i++)
+      RARCH_ERR("\t\t%s\n", queries[i].str);
 
    return false;
 }
@@ -499,7 +601,7 @@ bool network_cmd_send(const char *cmd_)
 
    RARCH_LOG("Sending command: \"%s\" to %s:%hu\n", cmd, host, (unsigned short)port);
 
-   bool ret = verify_command(cmd) && send_udp_packet(host, port, cmd);
+   bool ret = verify_command(cmd) && send_udp_packet(host, port, cmd, is_query(cmd));
    free(command);
 
    g_extern.verbose = old_verbose;
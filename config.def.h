@@ -65,6 +65,7 @@ enum
    INPUT_WII,
    INPUT_XINPUT,
    INPUT_LINUXRAW,
+   INPUT_EVDEV,
    INPUT_NULL
 };
 
@@ -163,6 +164,17 @@ static const bool disable_composition = false;
 // Video VSYNC (recommended)
 static const bool vsync = true;
 
+// Milliseconds to sleep after VSync before running the core, so input is polled closer to when the frame is displayed.
+// Only used with VSync. Reduced automatically when the core misses the frame budget.
+static const unsigned frame_delay = 0;
+
+// Tunes frame delay automatically from measured core run time, ignoring frame_delay.
+static const bool frame_delay_auto = false;
+
+// Only present every Nth frame while fast-forwarding, so fast-forward is not bound by the video driver.
+// 0 presents at most at the display refresh rate (refresh_rate). 1 presents every frame.
+static const unsigned fastforward_frameskip = 0;
+
 // Smooths picture
 static const bool video_smooth = true;
 
@@ -173,6 +185,14 @@ static const bool force_aspect = true;
 static const float aspect_ratio = -1.0; // Automatic
 static const bool aspect_ratio_auto = false; // 1:1 PAR
 
+// Number of threads used to render CPU filters that support threaded rendering.
+// A value of 0 uses one thread per CPU core.
+static const unsigned filter_threads = 0;
+
+// Number of threads used by the software scaler in the SDL video driver and FFmpeg recording.
+// A value of 0 uses one thread per CPU core.
+static const unsigned scaler_threads = 0;
+
 // Crop overscanned frames (7/8 or 15/15 for interlaced frames).
 static const bool crop_overscan = true;
 
@@ -200,15 +220,34 @@ static const bool hires_record = false;
 // Enables lossless RGB H.264 recording if possible (if not, FFV1 is used).
 static const bool h264_record = true;
 
+// Records in YUV 4:2:0 rather than RGB. Chroma is subsampled, but frames are converted
+// straight to the encoder's native format which is far cheaper to encode.
+static const bool yuv_record = false;
+
 // Record post-filtered (CPU filter) video rather than raw game output.
 static const bool post_filter_record = false;
 
 // Screenshots post-shaded GPU output if available.
 static const bool gpu_screenshot = true;
 
+// zlib compression level (0-9) used for PNG screenshots.
+static const unsigned screenshot_png_compression = 6;
+
+// PNG row filter used for screenshots. "none", "sub", "up", "avg", "paeth", "all" or "default".
+static const char *screenshot_png_filter = "default";
+
 // Record post-shaded GPU output instead of raw game footage if available.
 static const bool gpu_record = false;
 
+// Headless video driver: Scale frames to the configured window size rather than keeping native resolution.
+static const bool headless_scale = false;
+
+// Headless video driver: Hash every frame, and log a hash of the entire run on exit.
+static const bool headless_hash = false;
+
+// Headless video driver: Dump every Nth frame to video_headless_dump_directory. 0 disables dumping.
+static const unsigned headless_dump_interval = 0;
+
 // OSD-messages
 static const bool font_enable = true;
 
@@ -280,6 +319,10 @@ static const unsigned rewind_buffer_size = 20 << 20; // 20MiB
 // How many frames to rewind at a time.
 static const unsigned rewind_granularity = 1;
 
+// Number of frames to run ahead of the real frame to hide a core's internal input lag.
+// Requires save state support in the core. Disabled with 0.
+static const unsigned run_ahead_frames = 0;
+
 // Pause gameplay when gameplay loses focus.
 static const bool pause_nonactive = false;
 
@@ -289,6 +332,26 @@ static const unsigned autosave_interval = 0;
 // When being client over netplay, use keybinds for player 1 rather than player 2.
 static const bool netplay_client_swap_input = true;
 
+// Store netplay rollback states as deltas against the previous frame rather than in full.
+// Uses much less memory for large states, at the cost of some CPU time per frame.
+static const bool netplay_delta_states = false;
+
+// Save a netplay rollback state every N frames rather than every frame.
+// Rollbacks then replay from the nearest earlier state. 0 picks N from measured save state and replay cost.
+static const unsigned netplay_checkpoint_interval = 0;
+
+// Maximum number of spectators connected to a spectate host at once.
+static const unsigned netplay_max_spectators = 16;
+
+// Spectators which fall more than this many frames behind the host are dropped.
+// New spectators start from a save state taken up to a quarter of this many frames ago.
+static const unsigned netplay_spectator_lag = 600;
+
+// Local input is delayed by this many frames on netplay, so it reaches the other side before it is needed.
+// The delay follows the measured round-trip time within these bounds. At most 8.
+static const unsigned netplay_input_delay_min = 0;
+static const unsigned netplay_input_delay_max = 4;
+
 // On save state load, block SRAM from being overwritten.
 // This could potentially lead to buggy games.
 static const bool block_sram_overwrite = false;
@@ -310,6 +373,9 @@ static const bool network_cmd_enable = false;
 static const uint16_t network_cmd_port = 55355;
 static const bool stdin_cmd_enable = false;
 
+// Time sections of the main loop, and print percentiles on exit.
+static const bool perfcnt_enable = false;
+
 
 ////////////////////
 // Keybinds, Joypad
@@ -250,6 +250,11 @@ MESSAGE
 ============================================================ */
 #include "../../message.c"
 
+/*============================================================
+PERFORMANCE
+============================================================ */
+#include "../../performance.c"
+
 /*============================================================
 PATCH
 ============================================================ */
@@ -297,6 +302,7 @@ NETPLAY
 SCREENSHOTS
 ============================================================ */
 #ifdef HAVE_SCREENSHOTS
+#include "../../gfx/scaler/pixconv.c"
 #include "../../screenshot.c"
 #endif
 
@@ -501,9 +501,9 @@ static void rgui_settings_toggle_setting(rgui_file_type_t setting, rgui_action_t
             // but we use top-down.
             bool r = screenshot_dump(default_paths.port_dir,
                   data + (height - 1) * (pitch >> 1), 
-                  width, height, -pitch, false);
+                  width, height, -pitch, SCREENSHOT_FORMAT_0RGB1555);
 
-            msg_queue_push(g_extern.msg_queue, r ? "Screenshot saved" : "Screenshot failed to save", 1, S_DELAY_90);
+            msg_queue_push(g_extern.msg_queue, r ? "Screenshot queued" : "Screenshot failed to save", 1, S_DELAY_90);
          }
          break;
       case RGUI_SETTINGS_RESTART_GAME:
@@ -102,6 +102,9 @@ static const video_driver_t *video_drivers[] = {
 #endif
 #ifdef HAVE_RPI
    &video_rpi,
+#endif
+#ifndef RARCH_CONSOLE
+   &video_headless,
 #endif
    &video_null,
 };
@@ -127,6 +130,9 @@ static const input_driver_t *input_drivers[] = {
 #endif
 #ifdef __linux__
    &input_linuxraw,
+#endif
+#if defined(__linux__) && defined(HAVE_THREADS)
+   &input_evdev,
 #endif
    &input_null,
 };
@@ -430,6 +436,24 @@ void uninit_audio(void)
 }
 
 #ifdef HAVE_DYLIB
+// CPU filter ABI:
+// Revision 1 (filter_api_version() not exported):
+//    void filter_size(unsigned *width, unsigned *height);
+//    void filter_render(uint32_t *colormap, uint32_t *output, unsigned outpitch,
+//          const uint16_t *input, unsigned pitch, unsigned width, unsigned height);
+//    Optional, for threaded rendering:
+//    void filter_render_slice(..., unsigned first_line, unsigned last_line);
+//
+// Revision 2:
+//    unsigned filter_api_version(void); // Returns 2.
+//    void filter_size(unsigned *width, unsigned *height);
+//    void filter_render_xrgb8888(uint32_t *output, unsigned outpitch,
+//          const uint32_t *input, unsigned pitch, unsigned width, unsigned height,
+//          unsigned first_line, unsigned last_line);
+//
+// Input is always XRGB8888 in revision 2, regardless of what the core outputs.
+// Slice renderers get the full input frame, but only render the output
+// belonging to input lines [first_line, last_line).
 static void init_filter(void)
 {
    if (g_extern.filter.active)
@@ -437,12 +461,6 @@ static void init_filter(void)
    if (*g_settings.video.filter_path == '\0')
       return;
 
-   if (g_extern.system.rgb32)
-   {
-      RARCH_WARN("libretro implementation uses XRGB8888 format. CPU filters only support 0RGB1555.\n");
-      return;
-   }
-
    RARCH_LOG("Loading bSNES filter from \"%s\"\n", g_settings.video.filter_path);
    g_extern.filter.lib = dylib_load(g_settings.video.filter_path);
    if (!g_extern.filter.lib)
@@ -451,20 +469,79 @@ static void init_filter(void)
       return;
    }
 
+   unsigned api_version = 1;
+   unsigned (*papi_version)(void) =
+      (unsigned (*)(void))dylib_proc(g_extern.filter.lib, "filter_api_version");
+   if (papi_version)
+      api_version = papi_version();
+
+   if (api_version < 1 || api_version > RARCH_FILTER_API_VERSION)
+   {
+      RARCH_ERR("Filter API version %u is not supported.\n", api_version);
+      goto error;
+   }
+
    g_extern.filter.psize = 
       (void (*)(unsigned*, unsigned*))dylib_proc(g_extern.filter.lib, "filter_size");
-   g_extern.filter.prender = 
-      (void (*)(uint32_t*, uint32_t*, 
-                unsigned, const uint16_t*, 
-                unsigned, unsigned, unsigned))dylib_proc(g_extern.filter.lib, "filter_render");
 
-   if (!g_extern.filter.psize || !g_extern.filter.prender)
+   if (api_version >= 2)
    {
-      RARCH_ERR("Failed to find functions in filter...\n");
-      dylib_close(g_extern.filter.lib);
-      g_extern.filter.lib = NULL;
-      return;
+      g_extern.filter.prender_xrgb8888 =
+         (void (*)(uint32_t*, unsigned,
+                   const uint32_t*, unsigned, unsigned, unsigned,
+                   unsigned, unsigned))dylib_proc(g_extern.filter.lib, "filter_render_xrgb8888");
+
+      if (!g_extern.filter.psize || !g_extern.filter.prender_xrgb8888)
+      {
+         RARCH_ERR("Failed to find functions in filter...\n");
+         goto error;
+      }
    }
+   else
+   {
+      if (g_extern.system.rgb32)
+      {
+         RARCH_WARN("libretro implementation uses XRGB8888 format. This filter only supports 0RGB1555.\n");
+         goto error;
+      }
+
+      g_extern.filter.prender = 
+         (void (*)(uint32_t*, uint32_t*, 
+                   unsigned, const uint16_t*, 
+                   unsigned, unsigned, unsigned))dylib_proc(g_extern.filter.lib, "filter_render");
+
+      if (!g_extern.filter.psize || !g_extern.filter.prender)
+      {
+         RARCH_ERR("Failed to find functions in filter...\n");
+         goto error;
+      }
+
+      g_extern.filter.prender_slice =
+         (void (*)(uint32_t*, uint32_t*,
+                   unsigned, const uint16_t*,
+                   unsigned, unsigned, unsigned,
+                   unsigned, unsigned))dylib_proc(g_extern.filter.lib, "filter_render_slice");
+   }
+
+   RARCH_LOG("Filter uses API version %u.\n", api_version);
+
+#ifdef HAVE_THREADS
+   if (g_extern.filter.prender_slice || g_extern.filter.prender_xrgb8888)
+   {
+      unsigned threads = g_settings.video.filter_threads;
+      if (!threads)
+         threads = sthread_get_cpu_cores();
+
+      if (threads > 1)
+      {
+         g_extern.filter.pool = sthread_pool_new(threads);
+         if (g_extern.filter.pool)
+            RARCH_LOG("Rendering filter with %u threads.\n", threads);
+         else
+            RARCH_WARN("Failed to create filter threads. Rendering filter on main thread.\n");
+      }
+   }
+#endif
 
    g_extern.filter.active = true;
 
@@ -484,6 +561,18 @@ static void init_filter(void)
 
    g_extern.filter.pitch = RARCH_SCALE_BASE * g_extern.filter.scale * sizeof(uint32_t);
 
+   if (g_extern.filter.prender_xrgb8888)
+   {
+      // 0RGB1555 frames are converted up front, so the filter only has to deal with one format.
+      if (!g_extern.system.rgb32)
+      {
+         g_extern.filter.conv_pitch = geom->max_width * sizeof(uint32_t);
+         g_extern.filter.conv_buffer = (uint32_t*)malloc(g_extern.filter.conv_pitch * geom->max_height);
+         rarch_assert(g_extern.filter.conv_buffer);
+      }
+      return;
+   }
+
    g_extern.filter.colormap = (uint32_t*)malloc(0x10000 * sizeof(uint32_t));
    rarch_assert(g_extern.filter.colormap);
 
@@ -499,6 +588,11 @@ static void init_filter(void)
       b = (b << 3) | (b >> 2);
       g_extern.filter.colormap[i] = (r << 16) | (g << 8) | (b << 0);
    }
+   return;
+
+error:
+   dylib_close(g_extern.filter.lib);
+   memset(&g_extern.filter, 0, sizeof(g_extern.filter));
 }
 
 static void deinit_filter(void)
@@ -506,11 +600,16 @@ static void deinit_filter(void)
    if (!g_extern.filter.active)
       return;
 
-   g_extern.filter.active = false;
+#ifdef HAVE_THREADS
+   if (g_extern.filter.pool)
+      sthread_pool_free(g_extern.filter.pool);
+#endif
+
    dylib_close(g_extern.filter.lib);
-   g_extern.filter.lib = NULL;
    free(g_extern.filter.buffer);
    free(g_extern.filter.colormap);
+   free(g_extern.filter.conv_buffer);
+   memset(&g_extern.filter, 0, sizeof(g_extern.filter));
 }
 #endif
 
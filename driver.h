@@ -248,6 +248,7 @@ extern const video_driver_t video_xdk_d3d;
 extern const video_driver_t video_sdl;
 extern const video_driver_t video_rpi;
 extern const video_driver_t video_ext;
+extern const video_driver_t video_headless;
 extern const video_driver_t video_null;
 extern const input_driver_t input_sdl;
 extern const input_driver_t input_x;
@@ -256,6 +257,7 @@ extern const input_driver_t input_xenon360;
 extern const input_driver_t input_gx;
 extern const input_driver_t input_xinput;
 extern const input_driver_t input_linuxraw;
+extern const input_driver_t input_evdev;
 extern const input_driver_t input_null;
 ////////////////////////////////////////////////
 
@@ -17,6 +17,7 @@
 #include "general.h"
 #include "compat/strl.h"
 #include "compat/posix_string.h"
+#include "performance.h"
 #include <string.h>
 
 #ifdef RARCH_CONSOLE
@@ -168,8 +169,12 @@ void init_libretro_sym(void)
    set_environment();
 }
 
+static void uninit_core_perf_counters(void);
+
 void uninit_libretro_sym(void)
 {
+   uninit_core_perf_counters();
+
 #ifdef HAVE_DYNAMIC
    if (lib_handle)
       dylib_close(lib_handle);
@@ -226,6 +231,103 @@ void dylib_close(dylib_t lib)
 }
 #endif
 
+// Counters registered by the core through RETRO_ENVIRONMENT_GET_PERF_INTERFACE.
+// Each is backed by a frontend counter, so they show up in the same reports.
+#define MAX_CORE_PERF_COUNTERS 32
+
+static struct
+{
+   struct retro_perf_counter *core;
+   struct rarch_perf_counter *perf;
+} core_perf_counters[MAX_CORE_PERF_COUNTERS];
+static unsigned core_perf_num_counters;
+
+static retro_time_t core_perf_get_time_usec(void)
+{
+   return rarch_get_time_usec();
+}
+
+static uint64_t core_get_cpu_features(void)
+{
+   struct rarch_cpu_features cpu;
+   rarch_get_cpu_features(&cpu);
+   return cpu.simd;
+}
+
+static void core_perf_register(struct retro_perf_counter *counter)
+{
+   if (counter->registered)
+      return;
+
+   if (core_perf_num_counters >= MAX_CORE_PERF_COUNTERS)
+   {
+      RARCH_WARN("Core registered too many performance counters, ignoring \"%s\".\n", counter->ident);
+      return;
+   }
+
+   struct rarch_perf_counter *perf = (struct rarch_perf_counter*)calloc(1, sizeof(*perf));
+   if (!perf)
+      return;
+
+   perf->ident = counter->ident;
+   rarch_perf_register(perf);
+   if (!perf->registered)
+   {
+      free(perf);
+      return;
+   }
+
+   core_perf_counters[core_perf_num_counters].core = counter;
+   core_perf_counters[core_perf_num_counters].perf = perf;
+   core_perf_num_counters++;
+
+   counter->frontend_data = perf;
+   counter->registered = true;
+}
+
+static void core_perf_start(struct retro_perf_counter *counter)
+{
+   struct rarch_perf_counter *perf = (struct rarch_perf_counter*)counter->frontend_data;
+   if (!perf)
+      return;
+
+   rarch_perf_start(perf);
+   counter->start = perf->start;
+}
+
+static void core_perf_stop(struct retro_perf_counter *counter)
+{
+   struct rarch_perf_counter *perf = (struct rarch_perf_counter*)counter->frontend_data;
+   if (!perf)
+      return;
+
+   rarch_perf_stop(perf);
+   counter->start = 0;
+   counter->total = perf->total;
+   counter->call_cnt = perf->call_cnt;
+}
+
+static void core_perf_log(void)
+{
+   rarch_perf_log();
+}
+
+// Must be called while the core is still loaded, as counters live in core memory.
+static void uninit_core_perf_counters(void)
+{
+   for (unsigned i = 0; i < core_perf_num_counters; i++)
+   {
+      rarch_perf_unregister(core_perf_counters[i].perf);
+      free(core_perf_counters[i].perf);
+
+      // Statically linked cores keep their counters across reloads.
+      core_perf_counters[i].core->registered = false;
+      core_perf_counters[i].core->frontend_data = NULL;
+   }
+
+   core_perf_num_counters = 0;
+}
+
 static bool environment_cb(unsigned cmd, void *data)
 {
    switch (cmd)
@@ -352,6 +454,24 @@ static bool environment_cb(unsigned cmd, void *data)
          break;
       }
 
+      case RETRO_ENVIRONMENT_GET_VIDEO_SKIP:
+         // Queried every frame, so not logged.
+         *(bool*)data = g_extern.is_frame_skipped;
+         break;
+
+      case RETRO_ENVIRONMENT_GET_PERF_INTERFACE:
+      {
+         RARCH_LOG("Environ GET_PERF_INTERFACE.\n");
+         struct retro_perf_callback *cb = (struct retro_perf_callback*)data;
+         cb->get_time_usec    = core_perf_get_time_usec;
+         cb->get_cpu_features = core_get_cpu_features;
+         cb->perf_register    = core_perf_register;
+         cb->perf_start       = core_perf_start;
+         cb->perf_stop        = core_perf_stop;
+         cb->perf_log         = core_perf_log;
+         break;
+      }
+
       default:
          RARCH_LOG("Environ UNSUPPORTED (#%u).\n", cmd);
          return false;
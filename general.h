@@ -58,6 +58,10 @@
 #include "command.h"
 #endif
 
+#ifdef HAVE_THREADS
+#include "thread.h"
+#endif
+
 #include "audio/resampler.h"
 
 #if defined(_WIN32) && !defined(_XBOX)
@@ -101,8 +105,13 @@ struct settings
       char cg_shader_path[PATH_MAX];
       char bsnes_shader_path[PATH_MAX];
       char filter_path[PATH_MAX];
+      unsigned filter_threads;
+      unsigned scaler_threads;
       enum rarch_shader_type shader_type;
       float refresh_rate;
+      unsigned frame_delay;
+      bool frame_delay_auto;
+      unsigned fastforward_frameskip;
 
       bool render_to_texture;
       float fbo_scale_x;
@@ -126,10 +135,16 @@ struct settings
 
       bool hires_record;
       bool h264_record;
+      bool yuv_record;
       bool post_filter_record;
       bool gpu_record;
       bool gpu_screenshot;
 
+      bool headless_scale;
+      bool headless_hash;
+      unsigned headless_dump_interval;
+      char headless_dump_directory[PATH_MAX];
+
       bool allow_rotate;
       char external_driver[PATH_MAX];
    } video;
@@ -171,12 +186,23 @@ struct settings
    char cheat_settings_path[PATH_MAX];
 
    char screenshot_directory[PATH_MAX];
+   unsigned screenshot_png_compression;
+   char screenshot_png_filter[32];
    char system_directory[PATH_MAX];
 
    bool rewind_enable;
    size_t rewind_buffer_size;
    unsigned rewind_granularity;
 
+   unsigned run_ahead_frames;
+
+   bool netplay_delta_states;
+   unsigned netplay_checkpoint_interval;
+   unsigned netplay_max_spectators;
+   unsigned netplay_spectator_lag;
+   unsigned netplay_input_delay_min;
+   unsigned netplay_input_delay_max;
+
    float slowmotion_ratio;
 
    bool pause_nonactive;
@@ -189,6 +215,8 @@ struct settings
    bool network_cmd_enable;
    uint16_t network_cmd_port;
    bool stdin_cmd_enable;
+
+   bool perfcnt_enable;
 };
 
 // Settings and/or global state that is specific to a console-style implementation.
@@ -392,9 +420,26 @@ struct global
       void (*psize)(unsigned *width, unsigned *height);
       void (*prender)(uint32_t *colormap, uint32_t *output, unsigned outpitch,
             const uint16_t *input, unsigned pitch, unsigned width, unsigned height);
+      // Optional. Renders only the output belonging to input lines [first_line, last_line).
+      void (*prender_slice)(uint32_t *colormap, uint32_t *output, unsigned outpitch,
+            const uint16_t *input, unsigned pitch, unsigned width, unsigned height,
+            unsigned first_line, unsigned last_line);
+
+      // Filter API version 2. Takes XRGB8888 input directly, no colormap.
+      // 0RGB1555 frames are converted into conv_buffer first.
+      void (*prender_xrgb8888)(uint32_t *output, unsigned outpitch,
+            const uint32_t *input, unsigned pitch, unsigned width, unsigned height,
+            unsigned first_line, unsigned last_line);
+      uint32_t *conv_buffer;
+      unsigned conv_pitch;
+
+#ifdef HAVE_THREADS
+      sthread_pool_t *pool;
+#endif
    } filter;
 
    msg_queue_t *msg_queue;
+   unsigned msg_id; // ID of the message passed to the current video frame. See msg_queue_pull_id().
 
    // Rewind support.
    state_manager_t *state_manager;
@@ -402,6 +447,10 @@ struct global
    size_t state_size;
    bool frame_is_reverse;
 
+   // Run-ahead support. State of the real frame is kept here while running ahead.
+   void *runahead_buf;
+   size_t runahead_size;
+
 #ifdef HAVE_BSV_MOVIE
    // Movie playback/recording support.
    struct
@@ -422,10 +471,15 @@ struct global
    bool sram_save_disable;
    bool use_sram;
 
+   // Number of frames to run in --benchmark mode. 0 if disabled.
+   unsigned benchmark_frames;
+
    // Pausing support
    bool is_paused;
    bool is_oneshot;
    bool is_slowmotion;
+   bool is_fast_forward;
+   bool is_frame_skipped; // Current frame will not be presented.
 
    // Autosave support.
    autosave_t *autosave[2];
@@ -439,6 +493,7 @@ struct global
    bool netplay_is_spectate;
    unsigned netplay_sync_frames;
    uint16_t netplay_port;
+   uint16_t netplay_relay_port;
    char netplay_nick[32];
 #endif
 
@@ -531,6 +586,10 @@ extern struct console_settings g_console;
 
 #define RARCH_SCALE_BASE 256
 
+// Newest CPU filter API revision the frontend understands.
+// Filters without filter_api_version() are assumed to be revision 1.
+#define RARCH_FILTER_API_VERSION 2
+
 static inline uint32_t next_pow2(uint32_t v)
 {
    v--;
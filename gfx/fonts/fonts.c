@@ -18,19 +18,30 @@
 #include <string.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <limits.h>
+#include "../../boolean.h"
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
+// Messages are 8-bit strings, so a flat table covers every glyph we can be asked for.
+#define FONT_GLYPHS 256
+
 struct font_renderer
 {
    FT_Library lib;
    FT_Face face;
+
+   struct font_atlas atlas;
+   struct font_glyph glyphs[FONT_GLYPHS];
+   bool glyph_cached[FONT_GLYPHS];
+
+   // Shelf packing state.
+   unsigned pack_x, pack_y, pack_row_height;
 };
 
 font_renderer_t *font_renderer_new(const char *font_path, unsigned font_size)
 {
-   (void)font_size;
    FT_Error err;
    font_renderer_t *handle = (font_renderer_t*)calloc(1, sizeof(*handle));
    if (!handle)
@@ -48,69 +59,239 @@ font_renderer_t *font_renderer_new(const char *font_path, unsigned font_size)
    if (err)
       goto error;
 
+   // Room for about 16 glyphs per row. Height grows on demand.
+   handle->atlas.width = 256;
+   while (handle->atlas.width < font_size * 16)
+      handle->atlas.width <<= 1;
+   handle->atlas.height = handle->atlas.width >> 2;
+
+   handle->atlas.buffer = (uint8_t*)calloc(handle->atlas.width, handle->atlas.height);
+   if (!handle->atlas.buffer)
+      goto error;
+
    return handle;
 
 error:
    if (handle)
+      font_renderer_free(handle);
+   return NULL;
+}
+
+static bool grow_atlas(font_renderer_t *handle, unsigned height)
+{
+   unsigned new_height = handle->atlas.height;
+   while (new_height < height)
+      new_height <<= 1;
+
+   uint8_t *buffer = (uint8_t*)realloc(handle->atlas.buffer, handle->atlas.width * new_height);
+   if (!buffer)
+      return false;
+
+   memset(buffer + handle->atlas.width * handle->atlas.height, 0,
+         handle->atlas.width * (new_height - handle->atlas.height));
+
+   handle->atlas.buffer = buffer;
+   handle->atlas.height = new_height;
+   return true;
+}
+
+// Leaves a one pixel border between glyphs so filtered lookups don't bleed into neighbours.
+static bool pack_glyph(font_renderer_t *handle, unsigned width, unsigned height, unsigned *x, unsigned *y)
+{
+   if (width + 1 > handle->atlas.width)
+      return false;
+
+   if (handle->pack_x + width + 1 > handle->atlas.width)
    {
-      if (handle->face)
-         FT_Done_Face(handle->face);
-      if (handle->lib)
-         FT_Done_FreeType(handle->lib);
-      free(handle);
+      handle->pack_x = 0;
+      handle->pack_y += handle->pack_row_height + 1;
+      handle->pack_row_height = 0;
    }
-   return NULL;
+
+   if (handle->pack_y + height + 1 > handle->atlas.height &&
+         !grow_atlas(handle, handle->pack_y + height + 1))
+      return false;
+
+   *x = handle->pack_x;
+   *y = handle->pack_y;
+
+   handle->pack_x += width + 1;
+   if (height > handle->pack_row_height)
+      handle->pack_row_height = height;
+   return true;
+}
+
+const struct font_glyph *font_renderer_get_glyph(font_renderer_t *handle, uint32_t code)
+{
+   if (code >= FONT_GLYPHS)
+      return NULL;
+
+   if (handle->glyph_cached[code])
+      return &handle->glyphs[code];
+
+   if (FT_Load_Char(handle->face, code, FT_LOAD_RENDER))
+      return NULL;
+
+   FT_GlyphSlot slot = handle->face->glyph;
+   struct font_glyph *glyph = &handle->glyphs[code];
+
+   glyph->width = slot->bitmap.width;
+   glyph->height = slot->bitmap.rows;
+   glyph->draw_offset_x = slot->bitmap_left;
+   glyph->draw_offset_y = slot->bitmap_top - slot->bitmap.rows;
+   glyph->advance_x = slot->advance.x >> 6;
+   glyph->advance_y = slot->advance.y >> 6;
+
+   if (!pack_glyph(handle, glyph->width, glyph->height, &glyph->atlas_offset_x, &glyph->atlas_offset_y))
+      return NULL;
+
+   uint8_t *dst = handle->atlas.buffer + glyph->atlas_offset_y * handle->atlas.width + glyph->atlas_offset_x;
+   const uint8_t *src = slot->bitmap.buffer;
+   for (unsigned y = 0; y < glyph->height; y++, dst += handle->atlas.width, src += slot->bitmap.pitch)
+      memcpy(dst, src, glyph->width);
+
+   handle->atlas.generation++;
+   handle->glyph_cached[code] = true;
+   return glyph;
+}
+
+const struct font_atlas *font_renderer_get_atlas(font_renderer_t *handle)
+{
+   return &handle->atlas;
+}
+
+void font_renderer_bitmap(font_renderer_t *handle, const char *msg, struct font_bitmap *bitmap)
+{
+   bitmap->width = bitmap->height = 0;
+   bitmap->off_x = bitmap->off_y = 0;
+
+   // Look up every glyph before compositing, so the atlas won't grow under us.
+   int x_min = INT_MAX, y_min = INT_MAX, x_max = INT_MIN, y_max = INT_MIN;
+   int pen_x = 0, pen_y = 0;
+   for (const char *c = msg; *c; c++)
+   {
+      const struct font_glyph *glyph = font_renderer_get_glyph(handle, (uint8_t)*c);
+      if (!glyph)
+         continue;
+
+      if (glyph->width && glyph->height)
+      {
+         int left = pen_x + glyph->draw_offset_x;
+         int bottom = pen_y + glyph->draw_offset_y;
+
+         if (left < x_min)
+            x_min = left;
+         if (left + (int)glyph->width > x_max)
+            x_max = left + glyph->width;
+         if (bottom < y_min)
+            y_min = bottom;
+         if (bottom + (int)glyph->height > y_max)
+            y_max = bottom + glyph->height;
+      }
+
+      pen_x += glyph->advance_x;
+      pen_y += glyph->advance_y;
+   }
+
+   if (x_min >= x_max || y_min >= y_max)
+      return;
+
+   unsigned width = x_max - x_min;
+   unsigned height = y_max - y_min;
+   if (width * height > bitmap->size)
+   {
+      uint8_t *buffer = (uint8_t*)realloc(bitmap->buffer, width * height);
+      if (!buffer)
+         return;
+      bitmap->buffer = buffer;
+      bitmap->size = width * height;
+   }
+
+   memset(bitmap->buffer, 0, width * height);
+
+   pen_x = pen_y = 0;
+   for (const char *c = msg; *c; c++)
+   {
+      const struct font_glyph *glyph = font_renderer_get_glyph(handle, (uint8_t)*c);
+      if (!glyph)
+         continue;
+
+      int x = pen_x + glyph->draw_offset_x - x_min;
+      int y = y_max - (pen_y + glyph->draw_offset_y + (int)glyph->height);
+      pen_x += glyph->advance_x;
+      pen_y += glyph->advance_y;
+
+      const uint8_t *src = handle->atlas.buffer + glyph->atlas_offset_y * handle->atlas.width + glyph->atlas_offset_x;
+      uint8_t *dst = bitmap->buffer + y * width + x;
+
+      // Glyphs can overlap a bit, keep the strongest coverage.
+      for (unsigned h = 0; h < glyph->height; h++, src += handle->atlas.width, dst += width)
+         for (unsigned w = 0; w < glyph->width; w++)
+            if (src[w] > dst[w])
+               dst[w] = src[w];
+   }
+
+   bitmap->width = width;
+   bitmap->height = height;
+   bitmap->off_x = x_min;
+   bitmap->off_y = y_min;
+}
+
+void font_renderer_free_bitmap(struct font_bitmap *bitmap)
+{
+   free(bitmap->buffer);
+   memset(bitmap, 0, sizeof(*bitmap));
 }
 
 void font_renderer_msg(font_renderer_t *handle, const char *msg, struct font_output_list *output) 
 {
    output->head = NULL;
 
-   FT_GlyphSlot slot = handle->face->glyph;
    struct font_output *cur = NULL;
-   size_t len = strlen(msg);
    int off_x = 0, off_y = 0;
 
-   for (size_t i = 0; i < len; i++)
+   for (; *msg; msg++)
    {
-      FT_Error err = FT_Load_Char(handle->face, msg[i], FT_LOAD_RENDER);
+      const struct font_glyph *glyph = font_renderer_get_glyph(handle, (uint8_t)*msg);
+      if (!glyph)
+         continue;
+
+      struct font_output *tmp = (struct font_output*)calloc(1, sizeof(*tmp));
+      if (!tmp)
+         break;
 
-      if (!err)
+      tmp->output = (uint8_t*)malloc(glyph->width * glyph->height + 1);
+      if (!tmp->output)
       {
-         struct font_output *tmp = (struct font_output*)calloc(1, sizeof(*tmp));
-         if (!tmp)
-            break;
-
-         tmp->output = (uint8_t*)malloc(slot->bitmap.pitch * slot->bitmap.rows);
-         if (!tmp->output)
-         {
-            free(tmp);
-            break;
-         }
-
-         memcpy(tmp->output, slot->bitmap.buffer, slot->bitmap.pitch * slot->bitmap.rows);
-
-         tmp->width = slot->bitmap.width;
-         tmp->height = slot->bitmap.rows;
-         tmp->pitch = slot->bitmap.pitch;
-         tmp->advance_x = slot->advance.x >> 6;
-         tmp->advance_y = slot->advance.y >> 6;
-         tmp->char_off_x = slot->bitmap_left;
-         tmp->char_off_y = slot->bitmap_top - slot->bitmap.rows;
-         tmp->off_x = off_x + tmp->char_off_x;
-         tmp->off_y = off_y + tmp->char_off_y;
-         tmp->next = NULL;
-
-         if (i == 0)
-            output->head = tmp;
-         else
-            cur->next = tmp;
-
-         cur = tmp;
+         free(tmp);
+         break;
       }
 
-      off_x += slot->advance.x >> 6;
-      off_y += slot->advance.y >> 6;
+      const uint8_t *src = handle->atlas.buffer +
+         glyph->atlas_offset_y * handle->atlas.width + glyph->atlas_offset_x;
+      for (unsigned y = 0; y < glyph->height; y++)
+         memcpy(tmp->output + y * glyph->width, src + y * handle->atlas.width, glyph->width);
+
+      tmp->width = glyph->width;
+      tmp->height = glyph->height;
+      tmp->pitch = glyph->width;
+      tmp->advance_x = glyph->advance_x;
+      tmp->advance_y = glyph->advance_y;
+      tmp->char_off_x = glyph->draw_offset_x;
+      tmp->char_off_y = glyph->draw_offset_y;
+      tmp->off_x = off_x + tmp->char_off_x;
+      tmp->off_y = off_y + tmp->char_off_y;
+      tmp->next = NULL;
+
+      if (cur)
+         cur->next = tmp;
+      else
+         output->head = tmp;
+
+      cur = tmp;
+
+      off_x += glyph->advance_x;
+      off_y += glyph->advance_y;
    }
 }
 
@@ -134,6 +315,8 @@ void font_renderer_free(font_renderer_t *handle)
       FT_Done_Face(handle->face);
    if (handle->lib)
       FT_Done_FreeType(handle->lib);
+   free(handle->atlas.buffer);
+   free(handle);
 }
 
 // Not the cleanest way to do things for sure, but should hopefully work ... :)
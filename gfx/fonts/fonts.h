@@ -18,6 +18,7 @@
 #define __RARCH_FONTS_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 typedef struct font_renderer font_renderer_t;
 
@@ -35,11 +36,48 @@ struct font_output_list
    struct font_output *head;
 };
 
+// Glyphs are rasterized once and kept in an 8-bit intensity atlas owned by the renderer.
+// As a renderer has a fixed size, glyphs are only keyed on their code.
+struct font_glyph
+{
+   unsigned atlas_offset_x, atlas_offset_y;
+   unsigned width, height;
+   int draw_offset_x, draw_offset_y; // Bottom-left corner of the bitmap relative to the pen position.
+   int advance_x, advance_y;
+};
+
+struct font_atlas
+{
+   uint8_t *buffer; // 8-bit intensity, top-down. Pitch is width.
+   unsigned width, height;
+   unsigned generation; // Bumped whenever the buffer changes.
+};
+
+// A whole message composited into one bitmap.
+struct font_bitmap
+{
+   uint8_t *buffer; // 8-bit intensity, top-down. Pitch is width.
+   unsigned width, height;
+   int off_x, off_y; // Bottom-left corner relative to the pen position of the first glyph.
+   size_t size; // Allocated size of buffer.
+};
+
 font_renderer_t *font_renderer_new(const char *font_path, unsigned font_size);
 void font_renderer_msg(font_renderer_t *handle, const char *msg,
       struct font_output_list *output);
 
 void font_renderer_free_output(struct font_output_list *list);
+
+// Returns NULL if the glyph could not be rendered. Looking up a glyph might grow the atlas,
+// which moves the atlas buffer, but does not move glyphs which are already cached.
+const struct font_glyph *font_renderer_get_glyph(font_renderer_t *handle, uint32_t code);
+const struct font_atlas *font_renderer_get_atlas(font_renderer_t *handle);
+
+// Renders msg into bitmap, reusing its buffer if possible.
+// Drivers can keep the bitmap around for as long as the message stays the same.
+void font_renderer_bitmap(font_renderer_t *handle, const char *msg, struct font_bitmap *bitmap);
+void font_renderer_free_bitmap(struct font_bitmap *bitmap);
+
 void font_renderer_free(font_renderer_t *handle);
 
 const char *font_renderer_get_default_font(void);
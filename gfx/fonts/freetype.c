@@ -45,7 +45,8 @@ void gl_init_font(gl_t *gl, const char *font_path, unsigned font_size)
    else
       RARCH_LOG("Did not find default font.\n");
 
-   for (unsigned i = 0; i < 4; i++)
+   // Colors are per vertex, so fill in a full batch of quads up front.
+   for (unsigned i = 0; i < 4 * GL_FONT_BATCH_GLYPHS; i++)
    {
       gl->font_color[4 * i + 0] = g_settings.video.msg_color_r;
       gl->font_color[4 * i + 1] = g_settings.video.msg_color_g;
@@ -53,7 +54,7 @@ void gl_init_font(gl_t *gl, const char *font_path, unsigned font_size)
       gl->font_color[4 * i + 3] = 1.0;
    }
 
-   for (unsigned i = 0; i < 4; i++)
+   for (unsigned i = 0; i < 4 * GL_FONT_BATCH_GLYPHS; i++)
    {
       for (unsigned j = 0; j < 3; j++)
          gl->font_color_dark[4 * i + j] = 0.3 * gl->font_color[4 * i + j];
@@ -73,151 +74,157 @@ void gl_deinit_font(gl_t *gl)
    {
       font_renderer_free(gl->font);
       glDeleteTextures(1, &gl->font_tex);
-
-      if (gl->font_tex_empty_buf)
-         free(gl->font_tex_empty_buf);
    }
+
+   free(gl->font_vertex);
+   free(gl->font_vertex_dark);
+   free(gl->font_tex_coords);
 #else
    (void)gl;
 #endif
 }
 
 #ifdef HAVE_FREETYPE
-// Somewhat overwhelming code just to render some damn fonts.
-// We aim to use NPOT textures for compatibility with old and shitty cards.
-// Also, we want to avoid reallocating a texture for each glyph (performance dips), so we
-// contruct the whole texture using one call, and copy straight to it with
-// glTexSubImage.
+// Glyphs are rasterized once into the font renderer's atlas, which we mirror in font_tex.
+// A message is then just a batch of textured quads, one per glyph.
 
-struct font_rect
+// The atlas only changes when a glyph is seen for the first time.
+static void update_font_atlas(gl_t *gl)
 {
-   int x, y;
-   int width, height;
-   int pot_width, pot_height;
-};
+   const struct font_atlas *atlas = font_renderer_get_atlas(gl->font);
+   if (atlas->generation == gl->font_atlas_generation &&
+         (int)atlas->width == gl->font_tex_w && (int)atlas->height == gl->font_tex_h)
+      return;
 
-static void calculate_msg_geometry(const struct font_output *head, struct font_rect *rect)
-{
-   int x_min = head->off_x;
-   int x_max = head->off_x + head->width;
-   int y_min = head->off_y;
-   int y_max = head->off_y + head->height;
+   glPixelStorei(GL_UNPACK_ALIGNMENT, get_alignment(atlas->width));
+   glPixelStorei(GL_UNPACK_ROW_LENGTH, atlas->width);
 
-   while ((head = head->next))
+   if ((int)atlas->width != gl->font_tex_w || (int)atlas->height != gl->font_tex_h)
+   {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_INTENSITY8, atlas->width, atlas->height,
+            0, GL_LUMINANCE, GL_UNSIGNED_BYTE, atlas->buffer);
+
+      gl->font_tex_w = atlas->width;
+      gl->font_tex_h = atlas->height;
+   }
+   else
    {
-      int left = head->off_x;
-      int right = head->off_x + head->width;
-      int bottom = head->off_y;
-      int top = head->off_y + head->height;
-
-      if (left < x_min)
-         x_min = left;
-      if (right > x_max)
-         x_max = right;
-
-      if (bottom < y_min)
-         y_min = bottom;
-      if (top > y_max)
-         y_max = top;
+      glTexSubImage2D(GL_TEXTURE_2D,
+            0, 0, 0, atlas->width, atlas->height,
+            GL_LUMINANCE, GL_UNSIGNED_BYTE, atlas->buffer);
    }
 
-   rect->x = x_min;
-   rect->y = y_min;
-   rect->width = x_max - x_min;
-   rect->height = y_max - y_min;
+   gl->font_atlas_generation = atlas->generation;
 }
 
-static void adjust_power_of_two(gl_t *gl, struct font_rect *geom)
+static bool reserve_font_quads(gl_t *gl, unsigned quads)
 {
-   // Some systems really hate NPOT textures.
-   geom->pot_width = next_pow2(geom->width);
-   geom->pot_height = next_pow2(geom->height);
-
-   if ((geom->pot_width > gl->font_tex_w) || (geom->pot_height > gl->font_tex_h))
-   {
-      gl->font_tex_empty_buf = realloc(gl->font_tex_empty_buf, geom->pot_width * geom->pot_height);
-      memset(gl->font_tex_empty_buf, 0, geom->pot_width * geom->pot_height);
-
-      glPixelStorei(GL_UNPACK_ALIGNMENT, 8);
-      glPixelStorei(GL_UNPACK_ROW_LENGTH, geom->pot_width);
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_INTENSITY8, geom->pot_width, geom->pot_height,
-            0, GL_LUMINANCE, GL_UNSIGNED_BYTE, gl->font_tex_empty_buf);
-
-      gl->font_tex_w = geom->pot_width;
-      gl->font_tex_h = geom->pot_height;
-   }
+   if (quads <= gl->font_quads_cap)
+      return true;
+
+   GLfloat *vertex = (GLfloat*)realloc(gl->font_vertex, 8 * quads * sizeof(GLfloat));
+   if (!vertex)
+      return false;
+   gl->font_vertex = vertex;
+
+   vertex = (GLfloat*)realloc(gl->font_vertex_dark, 8 * quads * sizeof(GLfloat));
+   if (!vertex)
+      return false;
+   gl->font_vertex_dark = vertex;
+
+   vertex = (GLfloat*)realloc(gl->font_tex_coords, 8 * quads * sizeof(GLfloat));
+   if (!vertex)
+      return false;
+   gl->font_tex_coords = vertex;
+
+   gl->font_quads_cap = quads;
+   return true;
 }
 
-// Old style "blitting", so we can render all the fonts in one go.
-// TODO: Is it possible that fonts could overlap if we blit without alpha blending?
-static void blit_fonts(gl_t *gl, const struct font_output *head, const struct font_rect *geom)
+static void build_font_quads(gl_t *gl, const char *msg)
 {
-   // Clear out earlier fonts.
-   glPixelStorei(GL_UNPACK_ALIGNMENT, 8);
-   glPixelStorei(GL_UNPACK_ROW_LENGTH, gl->font_tex_w);
-   glTexSubImage2D(GL_TEXTURE_2D,
-         0, 0, 0, gl->font_tex_w, gl->font_tex_h,
-         GL_LUMINANCE, GL_UNSIGNED_BYTE, gl->font_tex_empty_buf);
-
-   while (head)
+   gl->font_quads = 0;
+
+   // Look up every glyph first, so the atlas is final before we calculate texture coordinates.
+   unsigned quads = 0;
+   for (const char *c = msg; *c; c++)
    {
-      // head has top-left oriented coords.
-      int x = head->off_x - geom->x;
-      int y = head->off_y - geom->y;
-      y = gl->font_tex_h - head->height - y - 1;
+      const struct font_glyph *glyph = font_renderer_get_glyph(gl->font, (uint8_t)*c);
+      if (glyph && glyph->width && glyph->height)
+         quads++;
+   }
 
-      glPixelStorei(GL_UNPACK_ALIGNMENT, get_alignment(head->pitch));
-      glPixelStorei(GL_UNPACK_ROW_LENGTH, head->pitch);
-      glTexSubImage2D(GL_TEXTURE_2D,
-            0, x, y, head->width, head->height,
-            GL_LUMINANCE, GL_UNSIGNED_BYTE, head->output);
+   if (!reserve_font_quads(gl, quads))
+      return;
 
-      head = head->next;
-   }
-}
+   update_font_atlas(gl);
 
-static void calculate_font_coords(gl_t *gl,
-      GLfloat font_vertex[8], GLfloat font_vertex_dark[8], GLfloat font_tex_coords[8])
-{
    GLfloat scale_factor = g_settings.video.font_scale ?
       (GLfloat)gl->full_x / (GLfloat)gl->vp_width :
       1.0f;
 
-   GLfloat lx = g_settings.video.msg_pos_x;
-   GLfloat hx = (GLfloat)gl->font_last_width / (gl->vp_width * scale_factor) + lx;
-   GLfloat ly = g_settings.video.msg_pos_y;
-   GLfloat hy = (GLfloat)gl->font_last_height / (gl->vp_height * scale_factor) + ly;
-
-   font_vertex[0] = lx;
-   font_vertex[1] = ly;
-   font_vertex[2] = lx;
-   font_vertex[3] = hy;
-   font_vertex[4] = hx;
-   font_vertex[5] = hy;
-   font_vertex[6] = hx;
-   font_vertex[7] = ly;
-
+   GLfloat scale_x = 1.0f / (gl->vp_width * scale_factor);
+   GLfloat scale_y = 1.0f / (gl->vp_height * scale_factor);
    GLfloat shift_x = 2.0f / gl->vp_width;
    GLfloat shift_y = 2.0f / gl->vp_height;
-   for (unsigned i = 0; i < 4; i++)
+   GLfloat inv_tex_w = 1.0f / gl->font_tex_w;
+   GLfloat inv_tex_h = 1.0f / gl->font_tex_h;
+
+   int pen_x = 0, pen_y = 0;
+   for (const char *c = msg; *c; c++)
    {
-      font_vertex_dark[2 * i + 0] = font_vertex[2 * i + 0] - shift_x;
-      font_vertex_dark[2 * i + 1] = font_vertex[2 * i + 1] - shift_y;
-   }
+      const struct font_glyph *glyph = font_renderer_get_glyph(gl->font, (uint8_t)*c);
+      if (!glyph)
+         continue;
+
+      int x = pen_x + glyph->draw_offset_x;
+      int y = pen_y + glyph->draw_offset_y;
+      pen_x += glyph->advance_x;
+      pen_y += glyph->advance_y;
+
+      if (!glyph->width || !glyph->height)
+         continue;
+
+      GLfloat *vertex = gl->font_vertex + 8 * gl->font_quads;
+      GLfloat *vertex_dark = gl->font_vertex_dark + 8 * gl->font_quads;
+      GLfloat *tex = gl->font_tex_coords + 8 * gl->font_quads;
+      gl->font_quads++;
+
+      GLfloat lx = g_settings.video.msg_pos_x + x * scale_x;
+      GLfloat hx = lx + glyph->width * scale_x;
+      GLfloat ly = g_settings.video.msg_pos_y + y * scale_y;
+      GLfloat hy = ly + glyph->height * scale_y;
+
+      vertex[0] = lx;
+      vertex[1] = ly;
+      vertex[2] = lx;
+      vertex[3] = hy;
+      vertex[4] = hx;
+      vertex[5] = hy;
+      vertex[6] = hx;
+      vertex[7] = ly;
+
+      for (unsigned i = 0; i < 4; i++)
+      {
+         vertex_dark[2 * i + 0] = vertex[2 * i + 0] - shift_x;
+         vertex_dark[2 * i + 1] = vertex[2 * i + 1] - shift_y;
+      }
 
-   lx = 0.0f;
-   hx = (GLfloat)gl->font_last_width / gl->font_tex_w;
-   ly = 1.0f - (GLfloat)gl->font_last_height / gl->font_tex_h; 
-   hy = 1.0f;
-
-   font_tex_coords[0] = lx;
-   font_tex_coords[1] = hy;
-   font_tex_coords[2] = lx;
-   font_tex_coords[3] = ly;
-   font_tex_coords[4] = hx;
-   font_tex_coords[5] = ly;
-   font_tex_coords[6] = hx;
-   font_tex_coords[7] = hy;
+      // Atlas is stored top-down.
+      lx = glyph->atlas_offset_x * inv_tex_w;
+      hx = (glyph->atlas_offset_x + glyph->width) * inv_tex_w;
+      ly = (glyph->atlas_offset_y + glyph->height) * inv_tex_h;
+      hy = glyph->atlas_offset_y * inv_tex_h;
+
+      tex[0] = lx;
+      tex[1] = ly;
+      tex[2] = lx;
+      tex[3] = hy;
+      tex[4] = hx;
+      tex[5] = hy;
+      tex[6] = hx;
+      tex[7] = ly;
+   }
 }
 
 extern const GLfloat vertexes_flipped[];
@@ -236,44 +243,36 @@ void gl_render_msg(void *data, const char *msg)
    gl_set_viewport(gl, gl->win_width, gl->win_height, false, false);
    glEnable(GL_BLEND);
 
-   GLfloat font_vertex[8]; 
-   GLfloat font_vertex_dark[8]; 
-   GLfloat font_tex_coords[8];
-
    glBindTexture(GL_TEXTURE_2D, gl->font_tex);
 
-   gl->coords.tex_coord = font_tex_coords;
-
-   struct font_output_list out;
+   // Messages tend to stay on screen for a long time, so keep the quads around until it changes.
+   if (!g_extern.msg_id || g_extern.msg_id != gl->font_msg_id ||
+         gl->vp_width != gl->font_msg_vp_width || gl->vp_height != gl->font_msg_vp_height)
+   {
+      build_font_quads(gl, msg);
+      gl->font_msg_id = g_extern.msg_id;
+      gl->font_msg_vp_width = gl->vp_width;
+      gl->font_msg_vp_height = gl->vp_height;
+   }
 
-   // If we get the same message, there's obviously no need to render fonts again ...
-   if (strcmp(gl->font_last_msg, msg) != 0)
+   for (unsigned i = 0; i < gl->font_quads; i += GL_FONT_BATCH_GLYPHS)
    {
-      font_renderer_msg(gl->font, msg, &out);
-      struct font_output *head = out.head;
+      unsigned quads = gl->font_quads - i;
+      if (quads > GL_FONT_BATCH_GLYPHS)
+         quads = GL_FONT_BATCH_GLYPHS;
 
-      struct font_rect geom;
-      calculate_msg_geometry(head, &geom);
-      adjust_power_of_two(gl, &geom);
-      blit_fonts(gl, head, &geom);
+      gl->coords.tex_coord = gl->font_tex_coords + 8 * i;
 
-      font_renderer_free_output(&out);
-      strlcpy(gl->font_last_msg, msg, sizeof(gl->font_last_msg));
+      gl->coords.vertex = gl->font_vertex_dark + 8 * i;
+      gl->coords.color  = gl->font_color_dark;
+      gl_set_coords(&gl->coords, 0);
+      glDrawArrays(GL_QUADS, 0, 4 * quads);
 
-      gl->font_last_width = geom.width;
-      gl->font_last_height = geom.height;
+      gl->coords.vertex = gl->font_vertex + 8 * i;
+      gl->coords.color  = gl->font_color;
+      gl_set_coords(&gl->coords, 0);
+      glDrawArrays(GL_QUADS, 0, 4 * quads);
    }
-   calculate_font_coords(gl, font_vertex, font_vertex_dark, font_tex_coords);
-   
-   gl->coords.vertex = font_vertex_dark;
-   gl->coords.color  = gl->font_color_dark;
-   gl_set_coords(&gl->coords, 0);
-   glDrawArrays(GL_QUADS, 0, 4);
-
-   gl->coords.vertex = font_vertex;
-   gl->coords.color  = gl->font_color;
-   gl_set_coords(&gl->coords, 0);
-   glDrawArrays(GL_QUADS, 0, 4);
 
    // Post - Go back to old rendering path.
    gl->coords.vertex = vertexes_flipped;
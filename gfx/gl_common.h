@@ -134,6 +134,9 @@ struct gl_coords
 
 #define MAX_SHADERS 16
 
+// Glyph quads drawn per call when rendering messages.
+#define GL_FONT_BATCH_GLYPHS 64
+
 #if defined(HAVE_XML) || defined(HAVE_CG)
 #define TEXTURES 8
 #else
@@ -202,11 +205,16 @@ typedef struct gl
    font_renderer_t *font;
    GLuint font_tex;
    int font_tex_w, font_tex_h;
-   void *font_tex_empty_buf;
-   char font_last_msg[256];
-   int font_last_width, font_last_height;
-   GLfloat font_color[16];
-   GLfloat font_color_dark[16];
+   unsigned font_atlas_generation;
+   // Quads of the last rendered message. Rebuilt when the message or viewport changes.
+   GLfloat *font_vertex;
+   GLfloat *font_vertex_dark;
+   GLfloat *font_tex_coords;
+   unsigned font_quads, font_quads_cap;
+   unsigned font_msg_id;
+   unsigned font_msg_vp_width, font_msg_vp_height;
+   GLfloat font_color[16 * GL_FONT_BATCH_GLYPHS];
+   GLfloat font_color_dark[16 * GL_FONT_BATCH_GLYPHS];
 #endif
 } gl_t;
 
@@ -0,0 +1,298 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2012 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Offscreen video driver. Renders into a system memory XRGB8888 framebuffer
+// without a display, so the full video path can be run and measured on machines
+// without a window system.
+
+#include "../general.h"
+#include "../driver.h"
+#include "../hash.h"
+#include "../performance.h"
+#include "../screenshot.h"
+#include "scaler/scaler.h"
+#include "scaler/pixconv.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_THREADS
+#include "../thread.h"
+#endif
+
+typedef struct headless_video
+{
+   struct scaler_ctx scaler;
+   bool rgb32;
+   bool scale;
+   bool hash;
+   unsigned dump_interval;
+
+   uint32_t *frame;
+   unsigned width;
+   unsigned height;
+
+   uint32_t crc;
+   unsigned frames;
+   unsigned dupes;
+   unsigned dumps;
+
+   rarch_time_t last_frame_time;
+   rarch_time_t render_time;
+   rarch_time_t render_time_max;
+   rarch_time_t interval_time;
+   rarch_time_t interval_time_max;
+} headless_video_t;
+
+static void headless_gfx_free(void *data)
+{
+   headless_video_t *vid = (headless_video_t*)data;
+   if (!vid)
+      return;
+
+   if (vid->frames)
+   {
+      RARCH_LOG("Headless: %u frames (%u dupes), render avg: %.3f ms, max: %.3f ms.\n",
+            vid->frames, vid->dupes,
+            vid->render_time / (1000.0 * vid->frames), vid->render_time_max / 1000.0);
+   }
+
+   if (vid->frames > 1)
+   {
+      RARCH_LOG("Headless: Frame interval avg: %.3f ms, max: %.3f ms (%.1f FPS).\n",
+            vid->interval_time / (1000.0 * (vid->frames - 1)), vid->interval_time_max / 1000.0,
+            vid->interval_time ? 1000000.0 * (vid->frames - 1) / vid->interval_time : 0.0);
+   }
+
+   if (vid->hash)
+      RARCH_LOG("Headless: Frame hash: 0x%08x.\n", (unsigned)vid->crc);
+   if (vid->dumps)
+      RARCH_LOG("Headless: Dumped %u frames.\n", vid->dumps);
+
+   scaler_ctx_gen_reset(&vid->scaler);
+   free(vid->frame);
+   free(vid);
+}
+
+static bool headless_set_size(headless_video_t *vid, unsigned width, unsigned height)
+{
+   if (width == vid->width && height == vid->height && vid->frame)
+      return true;
+
+   uint32_t *frame = (uint32_t*)calloc(width * height, sizeof(uint32_t));
+   if (!frame)
+      return false;
+
+   free(vid->frame);
+   vid->frame = frame;
+   vid->width = width;
+   vid->height = height;
+   return true;
+}
+
+static void *headless_gfx_init(const video_info_t *video,
+      const input_driver_t **input, void **input_data)
+{
+   headless_video_t *vid = (headless_video_t*)calloc(1, sizeof(*vid));
+   if (!vid)
+      return NULL;
+
+   vid->rgb32 = video->rgb32;
+   vid->scale = g_settings.video.headless_scale;
+   vid->hash = g_settings.video.headless_hash;
+   vid->dump_interval = g_settings.video.headless_dump_interval;
+
+   if (vid->dump_interval && !*g_settings.video.headless_dump_directory)
+   {
+      RARCH_WARN("Headless: video_headless_dump_directory is not set, frames will not be dumped.\n");
+      vid->dump_interval = 0;
+   }
+
+#ifndef HAVE_SCREENSHOTS
+   vid->dump_interval = 0;
+#endif
+
+   // Scale to the window size the frontend asked for, or keep the native size.
+   // Native size starts out at the base geometry, so viewport_size is meaningful before the first frame.
+   const struct retro_game_geometry *geom = &g_extern.system.av_info.geometry;
+   unsigned width = vid->scale ? video->width : geom->base_width;
+   unsigned height = vid->scale ? video->height : geom->base_height;
+   if (!headless_set_size(vid, width ? width : RARCH_SCALE_BASE, height ? height : RARCH_SCALE_BASE))
+      goto error;
+
+   vid->scaler.scaler_type = video->smooth ? SCALER_TYPE_BILINEAR : SCALER_TYPE_POINT;
+   vid->scaler.in_fmt = vid->rgb32 ? SCALER_FMT_ARGB8888 : SCALER_FMT_0RGB1555;
+   vid->scaler.out_fmt = SCALER_FMT_ARGB8888;
+
+#ifdef HAVE_THREADS
+   if (vid->scale)
+      vid->scaler.threads = g_settings.video.scaler_threads ? g_settings.video.scaler_threads : sthread_get_cpu_cores();
+#endif
+
+   // There is nothing to get input events from without a window.
+   *input = &input_null;
+   *input_data = input_null.init();
+
+   RARCH_LOG("Headless: %s output @ %ux%u.\n", vid->scale ? "Scaled" : "Native", vid->width, vid->height);
+   return vid;
+
+error:
+   headless_gfx_free(vid);
+   return NULL;
+}
+
+static void headless_update_hash(headless_video_t *vid)
+{
+   uint32_t crc = crc32_calculate((const uint8_t*)vid->frame, vid->width * vid->height * sizeof(uint32_t));
+
+   // Chain per-frame hashes so the final value covers the whole run.
+   for (unsigned i = 0; i < 4; i++)
+      vid->crc = crc32_adjust(vid->crc, (uint8_t)(crc >> (i * 8)));
+}
+
+#ifdef HAVE_SCREENSHOTS
+static void headless_dump_frame(headless_video_t *vid)
+{
+   char path[PATH_MAX];
+   int len = snprintf(path, sizeof(path), "%s/frame-%08u.%s",
+         g_settings.video.headless_dump_directory, vid->frames, screenshot_extension());
+   if (len < 0 || (size_t)len >= sizeof(path))
+   {
+      RARCH_WARN("Headless: video_headless_dump_directory is too long, frames will not be dumped.\n");
+      vid->dump_interval = 0;
+      return;
+   }
+
+   // Framebuffer is top-down, screenshots take bottom-up.
+   if (screenshot_dump_path(path, vid->frame + (vid->height - 1) * vid->width,
+            vid->width, vid->height, -(int)(vid->width * sizeof(uint32_t)), SCREENSHOT_FORMAT_XRGB8888))
+      vid->dumps++;
+}
+#endif
+
+static bool headless_gfx_frame(void *data, const void *frame,
+      unsigned width, unsigned height, unsigned pitch, const char *msg)
+{
+   (void)msg;
+   headless_video_t *vid = (headless_video_t*)data;
+
+   rarch_time_t start = rarch_get_time_usec();
+   if (vid->frames)
+   {
+      rarch_time_t interval = start - vid->last_frame_time;
+      vid->interval_time += interval;
+      if (interval > vid->interval_time_max)
+         vid->interval_time_max = interval;
+   }
+   vid->last_frame_time = start;
+
+   if (frame)
+   {
+      if (!vid->scale && !headless_set_size(vid, width, height))
+         return false;
+
+      if (width != (unsigned)vid->scaler.in_width
+            || height != (unsigned)vid->scaler.in_height
+            || pitch != (unsigned)vid->scaler.in_stride
+            || vid->width != (unsigned)vid->scaler.out_width
+            || vid->height != (unsigned)vid->scaler.out_height)
+      {
+         vid->scaler.in_width = width;
+         vid->scaler.in_height = height;
+         vid->scaler.in_stride = pitch;
+         vid->scaler.out_width = vid->width;
+         vid->scaler.out_height = vid->height;
+         vid->scaler.out_stride = vid->width * sizeof(uint32_t);
+
+         if (!scaler_ctx_gen_filter(&vid->scaler))
+         {
+            RARCH_ERR("Headless: Failed to create scaler for %ux%u -> %ux%u.\n",
+                  width, height, vid->width, vid->height);
+            return false;
+         }
+      }
+
+      scaler_ctx_scale(&vid->scaler, vid->frame, frame);
+
+      if (vid->hash)
+         headless_update_hash(vid);
+   }
+   else
+      vid->dupes++;
+
+#ifdef HAVE_SCREENSHOTS
+   if (vid->dump_interval && (vid->frames % vid->dump_interval) == 0)
+      headless_dump_frame(vid);
+#endif
+
+   vid->frames++;
+
+   rarch_time_t render = rarch_get_time_usec() - start;
+   vid->render_time += render;
+   if (render > vid->render_time_max)
+      vid->render_time_max = render;
+
+   return true;
+}
+
+static void headless_gfx_set_nonblock_state(void *data, bool toggle)
+{
+   (void)data;
+   (void)toggle;
+}
+
+static bool headless_gfx_alive(void *data)
+{
+   (void)data;
+   return true;
+}
+
+static bool headless_gfx_focus(void *data)
+{
+   (void)data;
+   return true;
+}
+
+static void headless_gfx_viewport_size(void *data, unsigned *width, unsigned *height)
+{
+   headless_video_t *vid = (headless_video_t*)data;
+   *width = vid->width;
+   *height = vid->height;
+}
+
+static bool headless_gfx_read_viewport(void *data, uint8_t *buffer)
+{
+   headless_video_t *vid = (headless_video_t*)data;
+
+   // Read out bottom-up, like glReadPixels().
+   conv_argb8888_bgr24(buffer, vid->frame + (vid->height - 1) * vid->width,
+         vid->width, vid->height,
+         vid->width * 3, -(int)(vid->width * sizeof(uint32_t)));
+   return true;
+}
+
+const video_driver_t video_headless = {
+   headless_gfx_init,
+   headless_gfx_frame,
+   headless_gfx_set_nonblock_state,
+   headless_gfx_alive,
+   headless_gfx_focus,
+   NULL,
+   headless_gfx_free,
+   "headless",
+
+   NULL,
+   headless_gfx_viewport_size,
+   headless_gfx_read_viewport,
+};
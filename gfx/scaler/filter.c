@@ -137,10 +137,11 @@ static void gen_filter_sinc_sub(struct scaler_filter *filter, int len, int pos,
    }
 }
 
-static bool gen_filter_sinc(struct scaler_ctx *ctx)
+// Sinc windowed by a wider sinc (Lanczos), with lobes zero crossings on each side.
+static bool gen_filter_lanczos(struct scaler_ctx *ctx, unsigned lobes)
 {
    // Need to expand the filter when downsampling to get a proper low-pass effect.
-   const int sinc_size      = 8 * (ctx->in_width > ctx->out_width ? next_pow2(ctx->in_width / ctx->out_width) : 1);
+   const int sinc_size      = 2 * lobes * (ctx->in_width > ctx->out_width ? next_pow2(ctx->in_width / ctx->out_width) : 1);
    ctx->horiz.filter_len    = sinc_size;
    ctx->horiz.filter_stride = sinc_size;
    ctx->vert.filter_len     = sinc_size;
@@ -252,7 +253,11 @@ bool scaler_gen_filter(struct scaler_ctx *ctx)
          break;
 
       case SCALER_TYPE_SINC:
-         ret = gen_filter_sinc(ctx);
+         ret = gen_filter_lanczos(ctx, 4);
+         break;
+
+      case SCALER_TYPE_LANCZOS:
+         ret = gen_filter_lanczos(ctx, ctx->lanczos_lobes ? ctx->lanczos_lobes : 3);
          break;
 
       default:
@@ -362,3 +362,455 @@ void conv_copy(void *output_, const void *input_,
       memcpy(output, input, copy_len);
 }
 
+
+#if defined(__SSE2__)
+void conv_rgb565_argb8888(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint32_t *output      = (uint32_t*)output_;
+
+   const __m128i pix_mask_r = _mm_set1_epi16((int16_t)(0x1f << 11));
+   const __m128i pix_mask_g = _mm_set1_epi16(0x3f <<  5);
+   const __m128i mul16_r    = _mm_set1_epi16(0x0108);
+   const __m128i mul16_g    = _mm_set1_epi16(0x2080);
+   const __m128i a          = _mm_set1_epi16(0x00ff);
+
+   int max_width = width - 7;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 1)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 8)
+      {
+         const __m128i in = _mm_loadu_si128((const __m128i*)(input + w));
+         __m128i r = _mm_and_si128(in, pix_mask_r);
+         __m128i g = _mm_and_si128(in, pix_mask_g);
+         __m128i b = _mm_slli_epi16(in, 11);
+
+         // Top bit is in use, so unsigned multiplies are needed here.
+         r = _mm_mulhi_epu16(r, mul16_r);
+         g = _mm_mulhi_epu16(g, mul16_g);
+         b = _mm_mulhi_epu16(b, mul16_r);
+
+         __m128i res_lo_bg = _mm_unpacklo_epi8(b, g);
+         __m128i res_hi_bg = _mm_unpackhi_epi8(b, g);
+         __m128i res_lo_ra = _mm_unpacklo_epi8(r, a);
+         __m128i res_hi_ra = _mm_unpackhi_epi8(r, a);
+
+         __m128i res_lo = _mm_or_si128(res_lo_bg, _mm_slli_si128(res_lo_ra, 2));
+         __m128i res_hi = _mm_or_si128(res_hi_bg, _mm_slli_si128(res_hi_ra, 2));
+
+         _mm_storeu_si128((__m128i*)(output + w + 0), res_lo);
+         _mm_storeu_si128((__m128i*)(output + w + 4), res_hi);
+      }
+
+      for (; w < width; w++)
+      {
+         uint32_t col = input[w];
+         uint32_t r = (col >> 11) & 0x1f;
+         uint32_t g = (col >>  5) & 0x3f;
+         uint32_t b = (col >>  0) & 0x1f;
+         r = (r << 3) | (r >> 2);
+         g = (g << 2) | (g >> 4);
+         b = (b << 3) | (b >> 2);
+
+         output[w] = (0xff << 24) | (r << 16) | (g << 8) | (b << 0);
+      }
+   }
+}
+
+void conv_argb8888_rgb565(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint32_t *input = (const uint32_t*)input_;
+   uint16_t *output      = (uint16_t*)output_;
+
+   const __m128i pix_mask_r = _mm_set1_epi32(0x1f << 11);
+   const __m128i pix_mask_g = _mm_set1_epi32(0x3f <<  5);
+   const __m128i pix_mask_b = _mm_set1_epi32(0x1f <<  0);
+
+   int max_width = width - 7;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 2)
+   {
+      int w;
+      for (w = 0; w < max_width; w += 8)
+      {
+         __m128i in0 = _mm_loadu_si128((const __m128i*)(input + w + 0));
+         __m128i in1 = _mm_loadu_si128((const __m128i*)(input + w + 4));
+
+         __m128i res0 = _mm_or_si128(_mm_or_si128(
+                  _mm_and_si128(_mm_srli_epi32(in0, 8), pix_mask_r),
+                  _mm_and_si128(_mm_srli_epi32(in0, 5), pix_mask_g)),
+               _mm_and_si128(_mm_srli_epi32(in0, 3), pix_mask_b));
+         __m128i res1 = _mm_or_si128(_mm_or_si128(
+                  _mm_and_si128(_mm_srli_epi32(in1, 8), pix_mask_r),
+                  _mm_and_si128(_mm_srli_epi32(in1, 5), pix_mask_g)),
+               _mm_and_si128(_mm_srli_epi32(in1, 3), pix_mask_b));
+
+         // Sign extend so the signed saturating pack doesn't clamp.
+         res0 = _mm_srai_epi32(_mm_slli_epi32(res0, 16), 16);
+         res1 = _mm_srai_epi32(_mm_slli_epi32(res1, 16), 16);
+
+         _mm_storeu_si128((__m128i*)(output + w), _mm_packs_epi32(res0, res1));
+      }
+
+      for (; w < width; w++)
+      {
+         uint32_t col = input[w];
+         uint16_t r = (col >> 19) & 0x1f;
+         uint16_t g = (col >> 10) & 0x3f;
+         uint16_t b = (col >>  3) & 0x1f;
+         output[w] = (r << 11) | (g << 5) | (b << 0);
+      }
+   }
+}
+#else
+void conv_rgb565_argb8888(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint16_t *input = (const uint16_t*)input_;
+   uint32_t *output      = (uint32_t*)output_;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 2, input += in_stride >> 1)
+   {
+      for (int w = 0; w < width; w++)
+      {
+         uint32_t col = input[w];
+         uint32_t r = (col >> 11) & 0x1f;
+         uint32_t g = (col >>  5) & 0x3f;
+         uint32_t b = (col >>  0) & 0x1f;
+         r = (r << 3) | (r >> 2);
+         g = (g << 2) | (g >> 4);
+         b = (b << 3) | (b >> 2);
+
+         output[w] = (0xff << 24) | (r << 16) | (g << 8) | (b << 0);
+      }
+   }
+}
+
+void conv_argb8888_rgb565(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint32_t *input = (const uint32_t*)input_;
+   uint16_t *output      = (uint16_t*)output_;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 1, input += in_stride >> 2)
+   {
+      for (int w = 0; w < width; w++)
+      {
+         uint32_t col = input[w];
+         uint16_t r = (col >> 19) & 0x1f;
+         uint16_t g = (col >> 10) & 0x3f;
+         uint16_t b = (col >>  3) & 0x1f;
+         output[w] = (r << 11) | (g << 5) | (b << 0);
+      }
+   }
+}
+#endif
+
+// BT.601, limited range. SIMD versions below do the exact same integer math.
+static inline uint8_t rgb_to_y(int r, int g, int b)
+{
+   return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+static inline uint8_t rgb_to_u(int r, int g, int b)
+{
+   return ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+}
+
+static inline uint8_t rgb_to_v(int r, int g, int b)
+{
+   return ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+}
+
+static inline uint8_t clamp_yuv(int val)
+{
+   if (val > 255)
+      return 255;
+   else if (val < 0)
+      return 0;
+   else
+      return (uint8_t)val;
+}
+
+static inline uint32_t yuv_to_argb(int y, int u, int v)
+{
+   int c = 298 * (y - 16) + 128;
+   int d = u - 128;
+   int e = v - 128;
+
+   uint32_t r = clamp_yuv((c + 409 * e) >> 8);
+   uint32_t g = clamp_yuv((c - 100 * d - 208 * e) >> 8);
+   uint32_t b = clamp_yuv((c + 516 * d) >> 8);
+
+   return (0xff << 24) | (r << 16) | (g << 8) | (b << 0);
+}
+
+// Chroma is taken from the average of each 2x2 block.
+// Blocks crossing the right or bottom edge reuse the edge pixels.
+static void argb8888_to_chroma(uint8_t *out_u, uint8_t *out_v, int step,
+      const uint32_t *line0, const uint32_t *line1, int first, int width)
+{
+   for (int w = first; w < width; w += 2, out_u += step, out_v += step)
+   {
+      int w1 = w + 1 < width ? w + 1 : w;
+      uint32_t col[4] = { line0[w], line0[w1], line1[w], line1[w1] };
+
+      int r = 2, g = 2, b = 2;
+      for (unsigned i = 0; i < 4; i++)
+      {
+         r += (col[i] >> 16) & 0xff;
+         g += (col[i] >>  8) & 0xff;
+         b += (col[i] >>  0) & 0xff;
+      }
+
+      r >>= 2;
+      g >>= 2;
+      b >>= 2;
+
+      *out_u = rgb_to_u(r, g, b);
+      *out_v = rgb_to_v(r, g, b);
+   }
+}
+
+#if defined(__SSE2__)
+// Weighted sum of B, G and R for four ARGB pixels, as 32-bit ints.
+static inline __m128i argb8888_dot_sse2(__m128i lo, __m128i hi, __m128i coeff)
+{
+   lo = _mm_madd_epi16(lo, coeff);
+   hi = _mm_madd_epi16(hi, coeff);
+
+   __m128 lo_f = _mm_castsi128_ps(lo);
+   __m128 hi_f = _mm_castsi128_ps(hi);
+   __m128i even = _mm_castps_si128(_mm_shuffle_ps(lo_f, hi_f, _MM_SHUFFLE(2, 0, 2, 0)));
+   __m128i odd  = _mm_castps_si128(_mm_shuffle_ps(lo_f, hi_f, _MM_SHUFFLE(3, 1, 3, 1)));
+   return _mm_add_epi32(even, odd);
+}
+
+static inline __m128i argb8888_round_sse2(__m128i sum, __m128i bias)
+{
+   return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8), bias);
+}
+
+static void argb8888_to_luma(uint8_t *output, const uint32_t *input, int width)
+{
+   const __m128i zero    = _mm_setzero_si128();
+   const __m128i coeff_y = _mm_set_epi16(0, 66, 129, 25, 0, 66, 129, 25);
+   const __m128i bias_y  = _mm_set1_epi32(16);
+
+   int w;
+   for (w = 0; w + 8 <= width; w += 8)
+   {
+      __m128i in0 = _mm_loadu_si128((const __m128i*)(input + w + 0));
+      __m128i in1 = _mm_loadu_si128((const __m128i*)(input + w + 4));
+
+      __m128i y0 = argb8888_round_sse2(argb8888_dot_sse2(
+               _mm_unpacklo_epi8(in0, zero), _mm_unpackhi_epi8(in0, zero), coeff_y), bias_y);
+      __m128i y1 = argb8888_round_sse2(argb8888_dot_sse2(
+               _mm_unpacklo_epi8(in1, zero), _mm_unpackhi_epi8(in1, zero), coeff_y), bias_y);
+
+      __m128i y = _mm_packs_epi32(y0, y1);
+      _mm_storel_epi64((__m128i*)(output + w), _mm_packus_epi16(y, y));
+   }
+
+   for (; w < width; w++)
+   {
+      uint32_t col = input[w];
+      output[w] = rgb_to_y((col >> 16) & 0xff, (col >> 8) & 0xff, (col >> 0) & 0xff);
+   }
+}
+
+// Sums pixel pairs of two lines. Result holds two 2x2 block sums as 16-bit channels.
+static inline __m128i argb8888_block_sum_sse2(__m128i line0, __m128i line1)
+{
+   const __m128i zero = _mm_setzero_si128();
+
+   __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(line0, zero), _mm_unpacklo_epi8(line1, zero));
+   __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(line0, zero), _mm_unpackhi_epi8(line1, zero));
+
+   lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+   hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+   return _mm_unpacklo_epi64(lo, hi);
+}
+
+static void argb8888_to_chroma_lines(uint8_t *out_u, uint8_t *out_v, int step,
+      const uint32_t *line0, const uint32_t *line1, int width)
+{
+   const __m128i coeff_u = _mm_set_epi16(0, -38, -74, 112, 0, -38, -74, 112);
+   const __m128i coeff_v = _mm_set_epi16(0, 112, -94, -18, 0, 112, -94, -18);
+   const __m128i bias_uv = _mm_set1_epi32(128);
+   const __m128i round   = _mm_set1_epi16(2);
+
+   int w;
+   for (w = 0; w + 8 <= width; w += 8, out_u += 4 * step, out_v += 4 * step)
+   {
+      __m128i blocks0 = argb8888_block_sum_sse2(
+            _mm_loadu_si128((const __m128i*)(line0 + w + 0)),
+            _mm_loadu_si128((const __m128i*)(line1 + w + 0)));
+      __m128i blocks1 = argb8888_block_sum_sse2(
+            _mm_loadu_si128((const __m128i*)(line0 + w + 4)),
+            _mm_loadu_si128((const __m128i*)(line1 + w + 4)));
+
+      blocks0 = _mm_srli_epi16(_mm_add_epi16(blocks0, round), 2);
+      blocks1 = _mm_srli_epi16(_mm_add_epi16(blocks1, round), 2);
+
+      __m128i u = argb8888_round_sse2(argb8888_dot_sse2(blocks0, blocks1, coeff_u), bias_uv);
+      __m128i v = argb8888_round_sse2(argb8888_dot_sse2(blocks0, blocks1, coeff_v), bias_uv);
+
+      u = _mm_packs_epi32(u, u);
+      v = _mm_packs_epi32(v, v);
+      u = _mm_packus_epi16(u, u);
+      v = _mm_packus_epi16(v, v);
+
+      if (step == 2) // Interleaved UV.
+         _mm_storel_epi64((__m128i*)out_u, _mm_unpacklo_epi8(u, v));
+      else
+      {
+         uint32_t u32 = _mm_cvtsi128_si32(u);
+         uint32_t v32 = _mm_cvtsi128_si32(v);
+         memcpy(out_u, &u32, sizeof(u32));
+         memcpy(out_v, &v32, sizeof(v32));
+      }
+   }
+
+   argb8888_to_chroma(out_u, out_v, step, line0, line1, w, width);
+}
+#else
+static void argb8888_to_luma(uint8_t *output, const uint32_t *input, int width)
+{
+   for (int w = 0; w < width; w++)
+   {
+      uint32_t col = input[w];
+      output[w] = rgb_to_y((col >> 16) & 0xff, (col >> 8) & 0xff, (col >> 0) & 0xff);
+   }
+}
+
+static void argb8888_to_chroma_lines(uint8_t *out_u, uint8_t *out_v, int step,
+      const uint32_t *line0, const uint32_t *line1, int width)
+{
+   argb8888_to_chroma(out_u, out_v, step, line0, line1, 0, width);
+}
+#endif
+
+static void argb8888_to_yuv(uint8_t *out_y, uint8_t *out_u, uint8_t *out_v,
+      int chroma_stride, int chroma_step,
+      const void *input_, int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint32_t *input = (const uint32_t*)input_;
+
+   for (int h = 0; h < height; h++, out_y += out_stride)
+      argb8888_to_luma(out_y, input + h * (in_stride >> 2), width);
+
+   for (int h = 0; h < height; h += 2, out_u += chroma_stride, out_v += chroma_stride)
+   {
+      const uint32_t *line0 = input + h * (in_stride >> 2);
+      const uint32_t *line1 = h + 1 < height ? line0 + (in_stride >> 2) : line0;
+      argb8888_to_chroma_lines(out_u, out_v, chroma_step, line0, line1, width);
+   }
+}
+
+void conv_argb8888_yuv420(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   uint8_t *out_y = (uint8_t*)output_;
+   uint8_t *out_u = out_y + out_stride * height;
+   uint8_t *out_v = out_u + YUV420_CHROMA_STRIDE(out_stride) * YUV_CHROMA_LINES(height);
+
+   argb8888_to_yuv(out_y, out_u, out_v, YUV420_CHROMA_STRIDE(out_stride), 1,
+         input_, width, height, out_stride, in_stride);
+}
+
+void conv_argb8888_nv12(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   uint8_t *out_y  = (uint8_t*)output_;
+   uint8_t *out_uv = out_y + out_stride * height;
+
+   argb8888_to_yuv(out_y, out_uv, out_uv + 1, NV12_CHROMA_STRIDE(out_stride), 2,
+         input_, width, height, out_stride, in_stride);
+}
+
+static void yuv_to_argb8888(void *output_,
+      const uint8_t *in_y, const uint8_t *in_u, const uint8_t *in_v,
+      int chroma_stride, int chroma_step,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   uint32_t *output = (uint32_t*)output_;
+
+   for (int h = 0; h < height; h++, output += out_stride >> 2, in_y += in_stride)
+   {
+      const uint8_t *u = in_u + (h >> 1) * chroma_stride;
+      const uint8_t *v = in_v + (h >> 1) * chroma_stride;
+
+      for (int w = 0; w < width; w++)
+         output[w] = yuv_to_argb(in_y[w], u[(w >> 1) * chroma_step], v[(w >> 1) * chroma_step]);
+   }
+}
+
+void conv_yuv420_argb8888(void *output, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint8_t *in_y = (const uint8_t*)input_;
+   const uint8_t *in_u = in_y + in_stride * height;
+   const uint8_t *in_v = in_u + YUV420_CHROMA_STRIDE(in_stride) * YUV_CHROMA_LINES(height);
+
+   yuv_to_argb8888(output, in_y, in_u, in_v, YUV420_CHROMA_STRIDE(in_stride), 1,
+         width, height, out_stride, in_stride);
+}
+
+void conv_nv12_argb8888(void *output, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   const uint8_t *in_y  = (const uint8_t*)input_;
+   const uint8_t *in_uv = in_y + in_stride * height;
+
+   yuv_to_argb8888(output, in_y, in_uv, in_uv + 1, NV12_CHROMA_STRIDE(in_stride), 2,
+         width, height, out_stride, in_stride);
+}
+
+void conv_yuv420_copy(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   uint8_t *output      = (uint8_t*)output_;
+   const uint8_t *input = (const uint8_t*)input_;
+
+   int out_chroma = YUV420_CHROMA_STRIDE(out_stride);
+   int in_chroma  = YUV420_CHROMA_STRIDE(in_stride);
+   int lines      = YUV_CHROMA_LINES(height);
+
+   conv_copy(output, input, width, height, out_stride, in_stride);
+   output += out_stride * height;
+   input  += in_stride * height;
+
+   conv_copy(output, input, width, lines, out_chroma, in_chroma);
+   output += out_chroma * lines;
+   input  += in_chroma * lines;
+
+   conv_copy(output, input, width, lines, out_chroma, in_chroma);
+}
+
+void conv_nv12_copy(void *output_, const void *input_,
+      int width, int height,
+      int out_stride, int in_stride)
+{
+   uint8_t *output      = (uint8_t*)output_;
+   const uint8_t *input = (const uint8_t*)input_;
+
+   conv_copy(output, input, width, height, out_stride, in_stride);
+   conv_copy(output + out_stride * height, input + in_stride * height, width, YUV_CHROMA_LINES(height),
+         NV12_CHROMA_STRIDE(out_stride), NV12_CHROMA_STRIDE(in_stride));
+}
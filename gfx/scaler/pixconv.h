@@ -40,5 +40,48 @@ void conv_copy(void *output, const void *input,
       int width, int height,
       int out_stride, int in_stride);
 
+void conv_rgb565_argb8888(void *output, const void *input,
+      int width, int height,
+      int out_stride, int in_stride);
+
+void conv_argb8888_rgb565(void *output, const void *input,
+      int width, int height,
+      int out_stride, int in_stride);
+
+// Planar YUV formats are stored with all planes back to back.
+// Strides passed in are for the luma plane. Colors are BT.601, limited range.
+//
+// YUV420: Y plane (height lines), followed by U and V planes,
+//         each with YUV420_CHROMA_STRIDE(stride) bytes per line and YUV_CHROMA_LINES(height) lines.
+// NV12:   Y plane, followed by one interleaved UV plane
+//         with NV12_CHROMA_STRIDE(stride) bytes per line and YUV_CHROMA_LINES(height) lines.
+#define YUV_CHROMA_LINES(height) (((height) + 1) >> 1)
+#define YUV420_CHROMA_STRIDE(stride) (((stride) + 1) >> 1)
+#define NV12_CHROMA_STRIDE(stride) (((stride) + 1) & ~1)
+
+void conv_argb8888_yuv420(void *output, const void *input,
+      int width, int height,
+      int out_stride, int in_stride);
+
+void conv_argb8888_nv12(void *output, const void *input,
+      int width, int height,
+      int out_stride, int in_stride);
+
+void conv_yuv420_argb8888(void *output, const void *input,
+      int width, int height,
+      int out_stride, int in_stride);
+
+void conv_nv12_argb8888(void *output, const void *input,
+      int width, int height,
+      int out_stride, int in_stride);
+
+void conv_yuv420_copy(void *output, const void *input,
+      int width, int height,
+      int out_stride, int in_stride);
+
+void conv_nv12_copy(void *output, const void *input,
+      int width, int height,
+      int out_stride, int in_stride);
+
 #endif
 
@@ -17,6 +17,7 @@
 #include "scaler_int.h"
 #include "filter.h"
 #include "pixconv.h"
+#include "../../performance.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -26,6 +27,10 @@
 #include <time.h>
 #endif
 
+#ifdef HAVE_THREADS
+#include "../../thread.h"
+#endif
+
 // In case aligned allocs are needed later ...
 void *scaler_alloc(size_t elem_size, size_t size)
 {
@@ -39,13 +44,6 @@ void scaler_free(void *ptr)
 
 static bool allocate_frames(struct scaler_ctx *ctx)
 {
-   ctx->scaled.stride = ((ctx->out_width + 7) & ~7) * sizeof(uint64_t);
-   ctx->scaled.width  = ctx->out_width;
-   ctx->scaled.height = ctx->in_height;
-   ctx->scaled.frame  = (uint64_t*)scaler_alloc(sizeof(uint64_t), (ctx->scaled.stride * ctx->scaled.height) >> 3);
-   if (!ctx->scaled.frame)
-      return false;
-
    if (ctx->in_fmt != SCALER_FMT_ARGB8888)
    {
       ctx->input.stride = ((ctx->in_width + 7) & ~7) * sizeof(uint32_t);
@@ -65,9 +63,79 @@ static bool allocate_frames(struct scaler_ctx *ctx)
    return true;
 }
 
+// Splits output into horizontal bands, one per thread.
+// Every band scales the input lines it needs horizontally into its own buffer,
+// so the few input lines shared between neighboring bands are scaled twice.
+static bool allocate_bands(struct scaler_ctx *ctx)
+{
+   unsigned num_bands = ctx->pool ? ctx->threads : 1;
+   if (num_bands > (unsigned)ctx->out_height)
+      num_bands = ctx->out_height;
+
+   ctx->bands = (struct scaler_band*)scaler_alloc(sizeof(struct scaler_band), num_bands);
+   if (!ctx->bands)
+      return false;
+   ctx->num_bands = num_bands;
+
+   ctx->scaled.stride = ((ctx->out_width + 7) & ~7) * sizeof(uint64_t);
+   ctx->scaled.width  = ctx->out_width;
+
+   for (unsigned i = 0; i < num_bands; i++)
+   {
+      struct scaler_band *band = &ctx->bands[i];
+      band->out_first = (ctx->out_height * i) / num_bands;
+      band->out_last  = (ctx->out_height * (i + 1)) / num_bands;
+
+      band->in_first = ctx->in_height;
+      band->in_last  = 0;
+      for (int h = band->out_first; h < band->out_last; h++)
+      {
+         int first = ctx->vert.filter_pos[h];
+         int last  = first + ctx->vert.filter_len;
+         if (first < band->in_first)
+            band->in_first = first;
+         if (last > band->in_last)
+            band->in_last = last;
+      }
+
+      band->scaled = (uint64_t*)scaler_alloc(sizeof(uint64_t),
+            ((band->in_last - band->in_first) * ctx->scaled.stride) >> 3);
+      if (!band->scaled)
+         return false;
+   }
+
+   return true;
+}
+
+static void set_kernels(struct scaler_ctx *ctx)
+{
+   ctx->scaler_horiz = scaler_argb8888_horiz;
+   ctx->scaler_vert  = scaler_argb8888_vert;
+
+#ifdef SCALER_HAVE_AVX2
+   struct rarch_cpu_features cpu;
+   rarch_get_cpu_features(&cpu);
+   if (cpu.simd & RARCH_SIMD_AVX2)
+   {
+      ctx->scaler_horiz = scaler_argb8888_horiz_avx2;
+      ctx->scaler_vert  = scaler_argb8888_vert_avx2;
+   }
+#endif
+}
+
+// Planar formats can only be converted a whole frame at a time.
+static bool fmt_is_planar(enum scaler_pix_fmt fmt)
+{
+   return fmt == SCALER_FMT_YUV420 || fmt == SCALER_FMT_NV12;
+}
+
 static bool set_direct_pix_conv(struct scaler_ctx *ctx)
 {
-   if (ctx->in_fmt == ctx->out_fmt)
+   if (ctx->in_fmt == ctx->out_fmt && ctx->in_fmt == SCALER_FMT_YUV420)
+      ctx->direct_pixconv = conv_yuv420_copy;
+   else if (ctx->in_fmt == ctx->out_fmt && ctx->in_fmt == SCALER_FMT_NV12)
+      ctx->direct_pixconv = conv_nv12_copy;
+   else if (ctx->in_fmt == ctx->out_fmt)
       ctx->direct_pixconv = conv_copy;
    else if (ctx->in_fmt == SCALER_FMT_0RGB1555 && ctx->out_fmt == SCALER_FMT_ARGB8888)
       ctx->direct_pixconv = conv_0rgb1555_argb8888;
@@ -79,6 +147,18 @@ static bool set_direct_pix_conv(struct scaler_ctx *ctx)
       ctx->direct_pixconv = conv_argb8888_bgr24;
    else if (ctx->in_fmt == SCALER_FMT_0RGB1555 && ctx->out_fmt == SCALER_FMT_BGR24)
       ctx->direct_pixconv = conv_0rgb1555_bgr24;
+   else if (ctx->in_fmt == SCALER_FMT_RGB565 && ctx->out_fmt == SCALER_FMT_ARGB8888)
+      ctx->direct_pixconv = conv_rgb565_argb8888;
+   else if (ctx->in_fmt == SCALER_FMT_ARGB8888 && ctx->out_fmt == SCALER_FMT_RGB565)
+      ctx->direct_pixconv = conv_argb8888_rgb565;
+   else if (ctx->in_fmt == SCALER_FMT_YUV420 && ctx->out_fmt == SCALER_FMT_ARGB8888)
+      ctx->direct_pixconv = conv_yuv420_argb8888;
+   else if (ctx->in_fmt == SCALER_FMT_ARGB8888 && ctx->out_fmt == SCALER_FMT_YUV420)
+      ctx->direct_pixconv = conv_argb8888_yuv420;
+   else if (ctx->in_fmt == SCALER_FMT_NV12 && ctx->out_fmt == SCALER_FMT_ARGB8888)
+      ctx->direct_pixconv = conv_nv12_argb8888;
+   else if (ctx->in_fmt == SCALER_FMT_ARGB8888 && ctx->out_fmt == SCALER_FMT_NV12)
+      ctx->direct_pixconv = conv_argb8888_nv12;
    else
       return false;
 
@@ -101,6 +181,18 @@ static bool set_pix_conv(struct scaler_ctx *ctx)
          ctx->in_pixconv = conv_bgr24_argb8888;
          break;
 
+      case SCALER_FMT_RGB565:
+         ctx->in_pixconv = conv_rgb565_argb8888;
+         break;
+
+      case SCALER_FMT_YUV420:
+         ctx->in_pixconv = conv_yuv420_argb8888;
+         break;
+
+      case SCALER_FMT_NV12:
+         ctx->in_pixconv = conv_nv12_argb8888;
+         break;
+
       default:
          return false;
    }
@@ -119,6 +211,18 @@ static bool set_pix_conv(struct scaler_ctx *ctx)
          ctx->out_pixconv = conv_argb8888_bgr24;
          break;
 
+      case SCALER_FMT_RGB565:
+         ctx->out_pixconv = conv_argb8888_rgb565;
+         break;
+
+      case SCALER_FMT_YUV420:
+         ctx->out_pixconv = conv_argb8888_yuv420;
+         break;
+
+      case SCALER_FMT_NV12:
+         ctx->out_pixconv = conv_argb8888_nv12;
+         break;
+
       default:
          return false;
    }
@@ -134,9 +238,8 @@ bool scaler_ctx_gen_filter(struct scaler_ctx *ctx)
       ctx->unscaled = true; // Only pixel format conversion ...
    else
    {
-      ctx->scaler_horiz = scaler_argb8888_horiz;
-      ctx->scaler_vert  = scaler_argb8888_vert;
-      ctx->unscaled     = false;
+      set_kernels(ctx);
+      ctx->unscaled = false;
    }
 
    ctx->scaler_special = NULL;
@@ -146,7 +249,8 @@ bool scaler_ctx_gen_filter(struct scaler_ctx *ctx)
 
    if (ctx->unscaled)
    {
-      if (!set_direct_pix_conv(ctx))
+      // Without a direct conversion, go through ARGB8888 in two steps.
+      if (!set_direct_pix_conv(ctx) && !set_pix_conv(ctx))
          return false;
    }
    else
@@ -158,7 +262,16 @@ bool scaler_ctx_gen_filter(struct scaler_ctx *ctx)
    if (!ctx->unscaled && !scaler_gen_filter(ctx))
       return false;
 
-   return true;
+   // Special scalers don't go through the separable filter.
+   if (ctx->unscaled || ctx->scaler_special)
+      return true;
+
+#ifdef HAVE_THREADS
+   if (ctx->threads > 1 && ctx->out_height > 1)
+      ctx->pool = sthread_pool_new(ctx->threads);
+#endif
+
+   return allocate_bands(ctx);
 }
 
 void scaler_ctx_gen_reset(struct scaler_ctx *ctx)
@@ -175,10 +288,21 @@ void scaler_ctx_gen_reset(struct scaler_ctx *ctx)
    scaler_free(ctx->horiz.filter_pos);
    scaler_free(ctx->vert.filter);
    scaler_free(ctx->vert.filter_pos);
-   scaler_free(ctx->scaled.frame);
    scaler_free(ctx->input.frame);
    scaler_free(ctx->output.frame);
 
+   for (unsigned i = 0; i < ctx->num_bands; i++)
+      scaler_free(ctx->bands[i].scaled);
+   scaler_free(ctx->bands);
+   ctx->bands     = NULL;
+   ctx->num_bands = 0;
+
+#ifdef HAVE_THREADS
+   if (ctx->pool)
+      sthread_pool_free(ctx->pool);
+#endif
+   ctx->pool = NULL;
+
    memset(&ctx->horiz, 0, sizeof(ctx->horiz));
    memset(&ctx->vert, 0, sizeof(ctx->vert));
    memset(&ctx->scaled, 0, sizeof(ctx->scaled));
@@ -186,6 +310,78 @@ void scaler_ctx_gen_reset(struct scaler_ctx *ctx)
    memset(&ctx->output, 0, sizeof(ctx->output));
 }
 
+struct scaler_job
+{
+   const struct scaler_ctx *ctx;
+   void *output;
+   const void *input;
+   int in_stride;
+};
+
+// Input conversion is split up separately as bands read overlapping input lines.
+static void scaler_convert_input(void *data, unsigned index, unsigned count)
+{
+   const struct scaler_job *job  = (const struct scaler_job*)data;
+   const struct scaler_ctx *ctx = job->ctx;
+
+   if (fmt_is_planar(ctx->in_fmt))
+   {
+      if (index == 0)
+      {
+         ctx->in_pixconv(ctx->input.frame, job->input,
+               ctx->in_width, ctx->in_height,
+               ctx->input.stride, ctx->in_stride);
+      }
+      return;
+   }
+
+   int first_line = (ctx->in_height * index) / count;
+   int last_line  = (ctx->in_height * (index + 1)) / count;
+
+   ctx->in_pixconv((uint8_t*)ctx->input.frame + first_line * ctx->input.stride,
+         (const uint8_t*)job->input + first_line * ctx->in_stride,
+         ctx->in_width, last_line - first_line,
+         ctx->input.stride, ctx->in_stride);
+}
+
+static void scaler_scale_band(void *data, unsigned index, unsigned count)
+{
+   const struct scaler_job *job  = (const struct scaler_job*)data;
+   const struct scaler_ctx *ctx = job->ctx;
+   (void)count;
+
+   if (index >= ctx->num_bands)
+      return;
+
+   const struct scaler_band *band = &ctx->bands[index];
+   int out_lines = band->out_last - band->out_first;
+
+   ctx->scaler_horiz(ctx, band->scaled,
+         (const uint8_t*)job->input + band->in_first * job->in_stride, job->in_stride,
+         band->in_last - band->in_first);
+
+   if (ctx->out_fmt != SCALER_FMT_ARGB8888)
+   {
+      void *frame = (uint8_t*)ctx->output.frame + band->out_first * ctx->output.stride;
+
+      ctx->scaler_vert(ctx, frame, ctx->output.stride,
+            band->scaled, band->in_first, band->out_first, band->out_last);
+
+      // Converted by scaler_ctx_scale() once every band is done.
+      if (fmt_is_planar(ctx->out_fmt))
+         return;
+
+      ctx->out_pixconv((uint8_t*)job->output + band->out_first * ctx->out_stride, frame,
+            ctx->out_width, out_lines,
+            ctx->out_stride, ctx->output.stride);
+   }
+   else
+   {
+      ctx->scaler_vert(ctx, (uint8_t*)job->output + band->out_first * ctx->out_stride, ctx->out_stride,
+            band->scaled, band->in_first, band->out_first, band->out_last);
+   }
+}
+
 void scaler_ctx_scale(struct scaler_ctx *ctx,
       void *output, const void *input)
 {
@@ -194,12 +390,22 @@ void scaler_ctx_scale(struct scaler_ctx *ctx,
    clock_gettime(CLOCK_MONOTONIC, &start_tv);
 #endif
 
-   if (ctx->unscaled) // Just perform straight pixel conversion.
+   if (ctx->unscaled && ctx->direct_pixconv) // Just perform straight pixel conversion.
    {
       ctx->direct_pixconv(output, input,
             ctx->out_width, ctx->out_height,
             ctx->out_stride, ctx->in_stride);
    }
+   else if (ctx->unscaled)
+   {
+      ctx->in_pixconv(ctx->input.frame, input,
+            ctx->in_width, ctx->in_height,
+            ctx->input.stride, ctx->in_stride);
+
+      ctx->out_pixconv(output, ctx->input.frame,
+            ctx->out_width, ctx->out_height,
+            ctx->out_stride, ctx->input.stride);
+   }
    else if (ctx->scaler_special) // Take some special, and (hopefully) more optimized path.
    {
       const void *inp = input;
@@ -239,27 +445,34 @@ void scaler_ctx_scale(struct scaler_ctx *ctx,
    }
    else // Take generic filter path.
    {
+      struct scaler_job job = { ctx, output, input, ctx->in_stride };
+
       if (ctx->in_fmt != SCALER_FMT_ARGB8888)
       {
-         ctx->in_pixconv(ctx->input.frame, input,
-               ctx->in_width, ctx->in_height,
-               ctx->input.stride, ctx->in_stride);
+#ifdef HAVE_THREADS
+         if (ctx->pool)
+            sthread_pool_run(ctx->pool, scaler_convert_input, &job);
+         else
+#endif
+            scaler_convert_input(&job, 0, 1);
 
-         ctx->scaler_horiz(ctx, ctx->input.frame, ctx->input.stride);
+         job.input     = ctx->input.frame;
+         job.in_stride = ctx->input.stride;
       }
+
+#ifdef HAVE_THREADS
+      if (ctx->pool)
+         sthread_pool_run(ctx->pool, scaler_scale_band, &job);
       else
-         ctx->scaler_horiz(ctx, input, ctx->in_stride);
+#endif
+         scaler_scale_band(&job, 0, 1);
 
-      if (ctx->out_fmt != SCALER_FMT_ARGB8888)
+      if (fmt_is_planar(ctx->out_fmt))
       {
-         ctx->scaler_vert(ctx, ctx->output.frame, ctx->output.stride);
-
          ctx->out_pixconv(output, ctx->output.frame,
                ctx->out_width, ctx->out_height,
                ctx->out_stride, ctx->output.stride);
       }
-      else
-         ctx->scaler_vert(ctx, output, ctx->out_stride);
    }
 
 #ifdef SCALER_PERF
@@ -26,7 +26,10 @@ enum scaler_pix_fmt
 {
    SCALER_FMT_ARGB8888 = 0,
    SCALER_FMT_0RGB1555,
-   SCALER_FMT_BGR24
+   SCALER_FMT_BGR24,
+   SCALER_FMT_RGB565,
+   SCALER_FMT_YUV420, // Planar, see pixconv.h for layout.
+   SCALER_FMT_NV12
 };
 
 enum scaler_type
@@ -34,7 +37,8 @@ enum scaler_type
    SCALER_TYPE_UNKNOWN = 0,
    SCALER_TYPE_POINT,
    SCALER_TYPE_BILINEAR,
-   SCALER_TYPE_SINC
+   SCALER_TYPE_SINC,
+   SCALER_TYPE_LANCZOS
 };
 
 struct scaler_filter
@@ -45,6 +49,19 @@ struct scaler_filter
    int     *filter_pos;
 };
 
+// Horizontally scaled lines needed to produce output lines [out_first, out_last).
+// Each band has its own buffer so bands can be scaled in parallel.
+struct scaler_band
+{
+   uint64_t *scaled;
+   int in_first;
+   int in_last;
+   int out_first;
+   int out_last;
+};
+
+struct sthread_pool;
+
 struct scaler_ctx
 {
    int in_width;
@@ -59,10 +76,17 @@ struct scaler_ctx
    enum scaler_pix_fmt out_fmt;
    enum scaler_type scaler_type;
 
+   // Number of lobes for SCALER_TYPE_LANCZOS. 0 selects 3.
+   unsigned lanczos_lobes;
+
+   // Number of threads to scale with. 0 or 1 scales on the calling thread.
+   // Threads are only used if built with HAVE_THREADS.
+   unsigned threads;
+
    void (*scaler_horiz)(const struct scaler_ctx*,
-         const void*, int);
+         uint64_t*, const void*, int, int);
    void (*scaler_vert)(const struct scaler_ctx*,
-         void*, int);
+         void*, int, const uint64_t*, int, int, int);
    void (*scaler_special)(const struct scaler_ctx*,
          void*, const void*, int, int, int, int, int, int);
 
@@ -81,12 +105,14 @@ struct scaler_ctx
 
    struct
    {
-      uint64_t *frame;
       int width;
-      int height;
       int stride;
    } scaled;
 
+   struct scaler_band *bands;
+   unsigned num_bands;
+   struct sthread_pool *pool;
+
    struct
    {
       uint32_t *frame;
@@ -28,6 +28,13 @@ static inline uint64_t build_argb64(uint16_t a, uint16_t r, uint16_t g, uint16_t
    return ((uint64_t)a << 48) | ((uint64_t)r << 32) | ((uint64_t)g << 16) | ((uint64_t)b << 0);
 }
 
+// Replicates a filter coefficient into all four 16-bit lanes.
+// Goes through uint16_t so negative coefficients don't borrow into the upper lanes.
+static inline uint64_t splat_coeff(int16_t coeff)
+{
+   return (uint16_t)coeff * 0x0001000100010001ull;
+}
+
 static inline uint8_t clamp_8bit(int16_t col)
 {
    if (col > 255)
@@ -56,16 +63,16 @@ static inline uint8_t clamp_8bit(int16_t col)
 // The C version of scalers perform the exact same operations as the SIMD code for testing purposes.
 
 #if defined(__SSE2__)
-void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output_, int stride)
+void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output_, int stride,
+      const uint64_t *input, int scaled_first, int first_line, int last_line)
 {
-   const uint64_t *input = ctx->scaled.frame;
    uint32_t *output = (uint32_t*)output_;
 
-   const int16_t *filter_vert = ctx->vert.filter;
+   const int16_t *filter_vert = ctx->vert.filter + first_line * ctx->vert.filter_stride;
 
-   for (int h = 0; h < ctx->out_height; h++, filter_vert += ctx->vert.filter_stride, output += stride >> 2)
+   for (int h = first_line; h < last_line; h++, filter_vert += ctx->vert.filter_stride, output += stride >> 2)
    {
-      const uint64_t *input_base = input + ctx->vert.filter_pos[h] * (ctx->scaled.stride >> 3);
+      const uint64_t *input_base = input + (ctx->vert.filter_pos[h] - scaled_first) * (ctx->scaled.stride >> 3);
 
       for (int w = 0; w < ctx->out_width; w++)
       {
@@ -76,7 +83,7 @@ void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output_, int strid
          size_t y;
          for (y = 0; (y + 1) < ctx->vert.filter_len; y += 2, input_base_y += (ctx->scaled.stride >> 2))
          {
-            __m128i coeff = _mm_set_epi64x(filter_vert[y + 1] * 0x0001000100010001ll, filter_vert[y + 0] * 0x0001000100010001ll);
+            __m128i coeff = _mm_set_epi64x(splat_coeff(filter_vert[y + 1]), splat_coeff(filter_vert[y + 0]));
             __m128i col   = _mm_set_epi64x(input_base_y[ctx->scaled.stride >> 3], input_base_y[0]);
 
             res = _mm_adds_epi16(_mm_mulhi_epi16(col, coeff), res);
@@ -84,7 +91,7 @@ void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output_, int strid
 
          for (; y < ctx->vert.filter_len; y++, input_base_y += (ctx->scaled.stride >> 3))
          {
-            __m128i coeff = _mm_set_epi64x(0, filter_vert[y] * 0x0001000100010001ll);
+            __m128i coeff = _mm_set_epi64x(0, splat_coeff(filter_vert[y]));
             __m128i col   = _mm_set_epi64x(0, input_base_y[0]);
 
             res = _mm_adds_epi16(_mm_mulhi_epi16(col, coeff), res);
@@ -100,16 +107,16 @@ void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output_, int strid
    }
 }
 #else
-void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output_, int stride)
+void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output_, int stride,
+      const uint64_t *input, int scaled_first, int first_line, int last_line)
 {
-   const uint64_t *input = ctx->scaled.frame;
    uint32_t *output = output_;
 
-   const int16_t *filter_vert = ctx->vert.filter;
+   const int16_t *filter_vert = ctx->vert.filter + first_line * ctx->vert.filter_stride;
 
-   for (int h = 0; h < ctx->out_height; h++, filter_vert += ctx->vert.filter_stride, output += stride >> 2)
+   for (int h = first_line; h < last_line; h++, filter_vert += ctx->vert.filter_stride, output += stride >> 2)
    {
-      const uint64_t *input_base = input + ctx->vert.filter_pos[h] * (ctx->scaled.stride >> 3);
+      const uint64_t *input_base = input + (ctx->vert.filter_pos[h] - scaled_first) * (ctx->scaled.stride >> 3);
 
       for (int w = 0; w < ctx->out_width; w++)
       {
@@ -148,12 +155,12 @@ void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output_, int strid
 #endif
 
 #if defined(__SSE2__)
-void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input_, int stride)
+void scaler_argb8888_horiz(const struct scaler_ctx *ctx, uint64_t *output,
+      const void *input_, int stride, int height)
 {
    const uint32_t *input = (const uint32_t*)input_;
-   uint64_t *output      = ctx->scaled.frame;
 
-   for (int h = 0; h < ctx->scaled.height; h++, input += stride >> 2, output += ctx->scaled.stride >> 3)
+   for (int h = 0; h < height; h++, input += stride >> 2, output += ctx->scaled.stride >> 3)
    {
       const int16_t *filter_horiz = ctx->horiz.filter;
 
@@ -166,7 +173,7 @@ void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input_, int
          size_t x;
          for (x = 0; (x + 1) < ctx->horiz.filter_len; x += 2)
          {
-            __m128i coeff = _mm_set_epi64x(filter_horiz[x + 1] * 0x0001000100010001ll, filter_horiz[x + 0] * 0x0001000100010001ll);
+            __m128i coeff = _mm_set_epi64x(splat_coeff(filter_horiz[x + 1]), splat_coeff(filter_horiz[x + 0]));
 
             __m128i col = _mm_unpacklo_epi8(_mm_set_epi64x(0,
                      ((uint64_t)input_base_x[x + 1] << 32) | input_base_x[x + 0]), _mm_setzero_si128());
@@ -177,7 +184,7 @@ void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input_, int
 
          for (; x < ctx->horiz.filter_len; x++)
          {
-            __m128i coeff = _mm_set_epi64x(0, filter_horiz[x] * 0x0001000100010001ll);
+            __m128i coeff = _mm_set_epi64x(0, splat_coeff(filter_horiz[x]));
             __m128i col   = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, 0, input_base_x[x]), _mm_setzero_si128());
 
             col = _mm_slli_epi16(col, 7);
@@ -202,12 +209,12 @@ void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input_, int
    }
 }
 #else
-void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input_, int stride)
+void scaler_argb8888_horiz(const struct scaler_ctx *ctx, uint64_t *output,
+      const void *input_, int stride, int height)
 {
    const uint32_t *input = input_;
-   uint64_t *output      = ctx->scaled.frame;
 
-   for (int h = 0; h < ctx->scaled.height; h++, input += stride >> 2, output += ctx->scaled.stride >> 3)
+   for (int h = 0; h < height; h++, input += stride >> 2, output += ctx->scaled.stride >> 3)
    {
       const int16_t *filter_horiz = ctx->horiz.filter;
 
@@ -243,6 +250,113 @@ void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input_, int
 }
 #endif
 
+#ifdef SCALER_HAVE_AVX2
+#include <immintrin.h>
+
+// AVX2 versions perform the same operations as the SSE2 and C scalers.
+// Horizontal scaler does four taps at a time, one tap per 64-bit lane.
+__attribute__((target("avx2")))
+void scaler_argb8888_horiz_avx2(const struct scaler_ctx *ctx, uint64_t *output,
+      const void *input_, int stride, int height)
+{
+   const uint32_t *input = (const uint32_t*)input_;
+
+   for (int h = 0; h < height; h++, input += stride >> 2, output += ctx->scaled.stride >> 3)
+   {
+      const int16_t *filter_horiz = ctx->horiz.filter;
+
+      for (int w = 0; w < ctx->scaled.width; w++, filter_horiz += ctx->horiz.filter_stride)
+      {
+         __m256i res = _mm256_setzero_si256();
+
+         const uint32_t *input_base_x = input + ctx->horiz.filter_pos[w];
+
+         size_t x;
+         for (x = 0; (x + 3) < ctx->horiz.filter_len; x += 4)
+         {
+            __m256i coeff = _mm256_set_epi64x(
+                  splat_coeff(filter_horiz[x + 3]), splat_coeff(filter_horiz[x + 2]),
+                  splat_coeff(filter_horiz[x + 1]), splat_coeff(filter_horiz[x + 0]));
+
+            __m256i col = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(input_base_x + x)));
+
+            col = _mm256_slli_epi16(col, 7);
+            res = _mm256_adds_epi16(_mm256_mulhi_epi16(col, coeff), res);
+         }
+
+         __m128i res_half = _mm_adds_epi16(_mm256_castsi256_si128(res), _mm256_extracti128_si256(res, 1));
+
+         for (; x < ctx->horiz.filter_len; x++)
+         {
+            __m128i coeff = _mm_set_epi64x(0, splat_coeff(filter_horiz[x]));
+            __m128i col   = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)input_base_x[x]), _mm_setzero_si128());
+
+            col      = _mm_slli_epi16(col, 7);
+            res_half = _mm_adds_epi16(_mm_mulhi_epi16(col, coeff), res_half);
+         }
+
+         res_half = _mm_adds_epi16(_mm_srli_si128(res_half, 8), res_half);
+         _mm_storel_epi64((__m128i*)(output + w), res_half);
+      }
+   }
+}
+
+// Vertical scaler shares coefficients for a whole line, so do four output pixels at a time.
+__attribute__((target("avx2")))
+void scaler_argb8888_vert_avx2(const struct scaler_ctx *ctx, void *output_, int stride,
+      const uint64_t *input, int scaled_first, int first_line, int last_line)
+{
+   uint32_t *output = (uint32_t*)output_;
+
+   const int16_t *filter_vert = ctx->vert.filter + first_line * ctx->vert.filter_stride;
+   const int scaled_stride    = ctx->scaled.stride >> 3;
+
+   for (int h = first_line; h < last_line; h++, filter_vert += ctx->vert.filter_stride, output += stride >> 2)
+   {
+      const uint64_t *input_base = input + (ctx->vert.filter_pos[h] - scaled_first) * scaled_stride;
+
+      int w;
+      for (w = 0; (w + 3) < ctx->out_width; w += 4)
+      {
+         __m256i res = _mm256_setzero_si256();
+
+         const uint64_t *input_base_y = input_base + w;
+         for (size_t y = 0; y < ctx->vert.filter_len; y++, input_base_y += scaled_stride)
+         {
+            __m256i coeff = _mm256_set1_epi16(filter_vert[y]);
+            __m256i col   = _mm256_loadu_si256((const __m256i*)input_base_y);
+
+            res = _mm256_adds_epi16(_mm256_mulhi_epi16(col, coeff), res);
+         }
+
+         res = _mm256_srai_epi16(res, (7 - 2 - 2));
+         res = _mm256_packus_epi16(res, res);
+         // Packing works per 128-bit lane, so gather the low quadword of each lane.
+         res = _mm256_permute4x64_epi64(res, 0x08);
+
+         _mm_storeu_si128((__m128i*)(output + w), _mm256_castsi256_si128(res));
+      }
+
+      for (; w < ctx->out_width; w++)
+      {
+         __m128i res = _mm_setzero_si128();
+
+         const uint64_t *input_base_y = input_base + w;
+         for (size_t y = 0; y < ctx->vert.filter_len; y++, input_base_y += scaled_stride)
+         {
+            __m128i coeff = _mm_set1_epi16(filter_vert[y]);
+            __m128i col   = _mm_loadl_epi64((const __m128i*)input_base_y);
+
+            res = _mm_adds_epi16(_mm_mulhi_epi16(col, coeff), res);
+         }
+
+         res = _mm_srai_epi16(res, (7 - 2 - 2));
+         output[w] = _mm_cvtsi128_si32(_mm_packus_epi16(res, res));
+      }
+   }
+}
+#endif
+
 void scaler_argb8888_point_special(const struct scaler_ctx *ctx,
       void *output_, const void *input_,
       int out_width, int out_height,
@@ -18,8 +18,27 @@
 
 #include "scaler.h"
 
-void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output, int stride);
-void scaler_argb8888_horiz(const struct scaler_ctx *ctx, const void *input, int stride);
+// Runtime dispatched AVX2 kernels. Requires a compiler which supports per-function target attributes.
+#if !defined(SCALER_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) && \
+   (defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define SCALER_HAVE_AVX2
+#endif
+
+// Scales height lines from input into scaled. scaled uses ctx->scaled.stride.
+void scaler_argb8888_horiz(const struct scaler_ctx *ctx, uint64_t *scaled,
+      const void *input, int stride, int height);
+
+// Produces output lines [first_line, last_line). output points to first_line.
+// scaled holds horizontally scaled input lines starting at scaled_first.
+void scaler_argb8888_vert(const struct scaler_ctx *ctx, void *output, int stride,
+      const uint64_t *scaled, int scaled_first, int first_line, int last_line);
+
+#ifdef SCALER_HAVE_AVX2
+void scaler_argb8888_horiz_avx2(const struct scaler_ctx *ctx, uint64_t *scaled,
+      const void *input, int stride, int height);
+void scaler_argb8888_vert_avx2(const struct scaler_ctx *ctx, void *output, int stride,
+      const uint64_t *scaled, int scaled_first, int first_line, int last_line);
+#endif
 
 void scaler_argb8888_point_special(const struct scaler_ctx *ctx,
       void *output, const void *input,
@@ -0,0 +1,329 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2012 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Benchmarks every pixel conversion and scaler combination.
+// Each case is run against a plain C build of the scaler (ref_*), and output must match exactly.
+// Usage: scaler-bench [-t threads] [filter]
+// Only cases with a name containing filter are run.
+// Exits with 1 if any SIMD output differs from the C reference.
+
+#include "../scaler.h"
+#include "../pixconv.h"
+#include "../../../performance.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef void (*pixconv_func_t)(void*, const void*, int, int, int, int);
+
+#define REF_DECL(name) void ref_##name(void*, const void*, int, int, int, int);
+REF_DECL(conv_0rgb1555_argb8888)
+REF_DECL(conv_bgr24_argb8888)
+REF_DECL(conv_argb8888_0rgb1555)
+REF_DECL(conv_argb8888_bgr24)
+REF_DECL(conv_0rgb1555_bgr24)
+REF_DECL(conv_copy)
+REF_DECL(conv_rgb565_argb8888)
+REF_DECL(conv_argb8888_rgb565)
+REF_DECL(conv_argb8888_yuv420)
+REF_DECL(conv_argb8888_nv12)
+REF_DECL(conv_yuv420_argb8888)
+REF_DECL(conv_nv12_argb8888)
+REF_DECL(conv_yuv420_copy)
+REF_DECL(conv_nv12_copy)
+
+bool ref_scaler_ctx_gen_filter(struct scaler_ctx *ctx);
+void ref_scaler_ctx_gen_reset(struct scaler_ctx *ctx);
+void ref_scaler_ctx_scale(struct scaler_ctx *ctx, void *output, const void *input);
+
+#define MIN_BENCH_TIME 0.05
+
+static const struct
+{
+   const char *name;
+   enum scaler_pix_fmt fmt;
+   unsigned pix_size; // For planar formats, size of the luma plane pixels.
+} formats[] = {
+   { "argb8888", SCALER_FMT_ARGB8888, 4 },
+   { "0rgb1555", SCALER_FMT_0RGB1555, 2 },
+   { "bgr24",    SCALER_FMT_BGR24,    3 },
+   { "rgb565",   SCALER_FMT_RGB565,   2 },
+   { "yuv420",   SCALER_FMT_YUV420,   1 },
+   { "nv12",     SCALER_FMT_NV12,     1 },
+};
+
+#define CONV(in, out, func) { #func, in, out, func, ref_##func }
+static const struct
+{
+   const char *name;
+   enum scaler_pix_fmt in_fmt;
+   enum scaler_pix_fmt out_fmt;
+   pixconv_func_t simd;
+   pixconv_func_t ref;
+} pixconvs[] = {
+   CONV(SCALER_FMT_0RGB1555, SCALER_FMT_ARGB8888, conv_0rgb1555_argb8888),
+   CONV(SCALER_FMT_BGR24,    SCALER_FMT_ARGB8888, conv_bgr24_argb8888),
+   CONV(SCALER_FMT_ARGB8888, SCALER_FMT_0RGB1555, conv_argb8888_0rgb1555),
+   CONV(SCALER_FMT_ARGB8888, SCALER_FMT_BGR24,    conv_argb8888_bgr24),
+   CONV(SCALER_FMT_0RGB1555, SCALER_FMT_BGR24,    conv_0rgb1555_bgr24),
+   CONV(SCALER_FMT_ARGB8888, SCALER_FMT_ARGB8888, conv_copy),
+   CONV(SCALER_FMT_RGB565,   SCALER_FMT_ARGB8888, conv_rgb565_argb8888),
+   CONV(SCALER_FMT_ARGB8888, SCALER_FMT_RGB565,   conv_argb8888_rgb565),
+   CONV(SCALER_FMT_ARGB8888, SCALER_FMT_YUV420,   conv_argb8888_yuv420),
+   CONV(SCALER_FMT_ARGB8888, SCALER_FMT_NV12,     conv_argb8888_nv12),
+   CONV(SCALER_FMT_YUV420,   SCALER_FMT_ARGB8888, conv_yuv420_argb8888),
+   CONV(SCALER_FMT_NV12,     SCALER_FMT_ARGB8888, conv_nv12_argb8888),
+   CONV(SCALER_FMT_YUV420,   SCALER_FMT_YUV420,   conv_yuv420_copy),
+   CONV(SCALER_FMT_NV12,     SCALER_FMT_NV12,     conv_nv12_copy),
+};
+
+static const struct
+{
+   const char *name;
+   enum scaler_type type;
+} scaler_types[] = {
+   { "point",    SCALER_TYPE_POINT },
+   { "bilinear", SCALER_TYPE_BILINEAR },
+   { "sinc",     SCALER_TYPE_SINC },
+   { "lanczos",  SCALER_TYPE_LANCZOS },
+};
+
+static const struct
+{
+   int in_width, in_height;
+   int out_width, out_height;
+} sizes[] = {
+   {  256,  224, 1920, 1080 },
+   {  320,  240,  640,  480 },
+   {  640,  480, 1920, 1080 },
+   { 1920, 1080,  640,  360 },
+   // Odd and not a multiple of 8, so SIMD tails and odd chroma are checked too.
+   {  317,  239,  635,  477 },
+   {  640,  480,  317,  239 },
+};
+
+static unsigned threads = 1;
+static const char *filter;
+static unsigned failed;
+
+static double get_time(void)
+{
+   struct timespec tv;
+   clock_gettime(CLOCK_MONOTONIC, &tv);
+   return tv.tv_sec + tv.tv_nsec / 1000000000.0;
+}
+
+static unsigned pix_size(enum scaler_pix_fmt fmt)
+{
+   for (unsigned i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+      if (formats[i].fmt == fmt)
+         return formats[i].pix_size;
+   return 0;
+}
+
+static const char *fmt_name(enum scaler_pix_fmt fmt)
+{
+   for (unsigned i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+      if (formats[i].fmt == fmt)
+         return formats[i].name;
+   return "?";
+}
+
+// Large enough for any of the formats, including chroma planes.
+static size_t frame_size(enum scaler_pix_fmt fmt, int width, int height)
+{
+   size_t stride = width * pix_size(fmt);
+   size_t size   = stride * height;
+   if (fmt == SCALER_FMT_YUV420 || fmt == SCALER_FMT_NV12)
+      size += NV12_CHROMA_STRIDE(stride) * YUV_CHROMA_LINES(height);
+   return size;
+}
+
+static void *alloc_frame(size_t size, bool random)
+{
+   uint8_t *frame = (uint8_t*)malloc(size);
+   if (!frame)
+   {
+      fprintf(stderr, "Out of memory.\n");
+      exit(1);
+   }
+
+   for (size_t i = 0; i < size; i++)
+      frame[i] = random ? rand() : 0;
+   return frame;
+}
+
+static void report(const char *name, int pixels, unsigned ref_iter, double ref_time,
+      unsigned simd_iter, double simd_time, bool match)
+{
+   double ref_mpix  = (double)pixels * ref_iter / ref_time / 1000000.0;
+   double simd_mpix = (double)pixels * simd_iter / simd_time / 1000000.0;
+
+   printf("%-48s C: %9.2f MPix/s  SIMD: %9.2f MPix/s  (x%5.2f)  %s\n",
+         name, ref_mpix, simd_mpix, simd_mpix / ref_mpix, match ? "OK" : "MISMATCH");
+   fflush(stdout);
+
+   if (!match)
+      failed++;
+}
+
+static void bench_pixconv(unsigned index, int width, int height)
+{
+   char name[128];
+   snprintf(name, sizeof(name), "%s %dx%d", pixconvs[index].name, width, height);
+   if (filter && !strstr(name, filter))
+      return;
+
+   int in_stride  = width * pix_size(pixconvs[index].in_fmt);
+   int out_stride = width * pix_size(pixconvs[index].out_fmt);
+   size_t in_size  = frame_size(pixconvs[index].in_fmt, width, height);
+   size_t out_size = frame_size(pixconvs[index].out_fmt, width, height);
+
+   void *input    = alloc_frame(in_size, true);
+   void *out_ref  = alloc_frame(out_size, false);
+   void *out_simd = alloc_frame(out_size, false);
+
+   unsigned ref_iter = 0, simd_iter = 0;
+   double start = get_time(), ref_time, simd_time;
+   do
+   {
+      pixconvs[index].ref(out_ref, input, width, height, out_stride, in_stride);
+      ref_iter++;
+   } while ((ref_time = get_time() - start) < MIN_BENCH_TIME);
+
+   start = get_time();
+   do
+   {
+      pixconvs[index].simd(out_simd, input, width, height, out_stride, in_stride);
+      simd_iter++;
+   } while ((simd_time = get_time() - start) < MIN_BENCH_TIME);
+
+   report(name, width * height, ref_iter, ref_time, simd_iter, simd_time,
+         memcmp(out_ref, out_simd, out_size) == 0);
+
+   free(input);
+   free(out_ref);
+   free(out_simd);
+}
+
+static void bench_scaler(unsigned type, enum scaler_pix_fmt in_fmt, enum scaler_pix_fmt out_fmt,
+      int in_width, int in_height, int out_width, int out_height)
+{
+   char name[128];
+   snprintf(name, sizeof(name), "%s %s->%s %dx%d->%dx%d", scaler_types[type].name,
+         fmt_name(in_fmt), fmt_name(out_fmt), in_width, in_height, out_width, out_height);
+   if (filter && !strstr(name, filter))
+      return;
+
+   struct scaler_ctx ref, simd;
+   memset(&ref, 0, sizeof(ref));
+
+   ref.in_width    = in_width;
+   ref.in_height   = in_height;
+   ref.in_stride   = in_width * pix_size(in_fmt);
+   ref.out_width   = out_width;
+   ref.out_height  = out_height;
+   ref.out_stride  = out_width * pix_size(out_fmt);
+   ref.in_fmt      = in_fmt;
+   ref.out_fmt     = out_fmt;
+   ref.scaler_type = scaler_types[type].type;
+
+   simd = ref;
+   simd.threads = threads;
+
+   if (!ref_scaler_ctx_gen_filter(&ref) || !scaler_ctx_gen_filter(&simd))
+   {
+      printf("%-48s Failed to create scaler.\n", name);
+      failed++;
+      ref_scaler_ctx_gen_reset(&ref);
+      scaler_ctx_gen_reset(&simd);
+      return;
+   }
+
+   size_t in_size  = frame_size(in_fmt, in_width, in_height);
+   size_t out_size = frame_size(out_fmt, out_width, out_height);
+
+   void *input    = alloc_frame(in_size, true);
+   void *out_ref  = alloc_frame(out_size, false);
+   void *out_simd = alloc_frame(out_size, false);
+
+   unsigned ref_iter = 0, simd_iter = 0;
+   double start = get_time(), ref_time, simd_time;
+   do
+   {
+      ref_scaler_ctx_scale(&ref, out_ref, input);
+      ref_iter++;
+   } while ((ref_time = get_time() - start) < MIN_BENCH_TIME);
+
+   start = get_time();
+   do
+   {
+      scaler_ctx_scale(&simd, out_simd, input);
+      simd_iter++;
+   } while ((simd_time = get_time() - start) < MIN_BENCH_TIME);
+
+   report(name, out_width * out_height, ref_iter, ref_time, simd_iter, simd_time,
+         memcmp(out_ref, out_simd, out_size) == 0);
+
+   ref_scaler_ctx_gen_reset(&ref);
+   scaler_ctx_gen_reset(&simd);
+   free(input);
+   free(out_ref);
+   free(out_simd);
+}
+
+int main(int argc, char *argv[])
+{
+   for (int i = 1; i < argc; i++)
+   {
+      if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+         threads = strtoul(argv[++i], NULL, 0);
+      else
+         filter = argv[i];
+   }
+
+   struct rarch_cpu_features cpu;
+   rarch_get_cpu_features(&cpu);
+   printf("CPU: SSE2: %s, AVX2: %s. Scaler threads: %u.\n",
+         cpu.simd & RARCH_SIMD_SSE2 ? "yes" : "no",
+         cpu.simd & RARCH_SIMD_AVX2 ? "yes" : "no",
+         threads);
+
+   for (unsigned i = 0; i < sizeof(pixconvs) / sizeof(pixconvs[0]); i++)
+   {
+      bench_pixconv(i, 256, 224);
+      bench_pixconv(i, 317, 239);
+      bench_pixconv(i, 1920, 1080);
+   }
+
+   for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+      for (unsigned type = 0; type < sizeof(scaler_types) / sizeof(scaler_types[0]); type++)
+         for (unsigned in = 0; in < sizeof(formats) / sizeof(formats[0]); in++)
+            for (unsigned out = 0; out < sizeof(formats) / sizeof(formats[0]); out++)
+               bench_scaler(type, formats[in].fmt, formats[out].fmt,
+                     sizes[s].in_width, sizes[s].in_height,
+                     sizes[s].out_width, sizes[s].out_height);
+
+   if (failed)
+   {
+      printf("%u case(s) failed.\n", failed);
+      return 1;
+   }
+
+   printf("All cases match the C reference.\n");
+   return 0;
+}
+
@@ -0,0 +1,48 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2012 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Renames every symbol of the scaler so a plain C build can be linked
+// next to the SIMD build as a reference.
+
+#ifndef SCALER_REF_NAMES_H__
+#define SCALER_REF_NAMES_H__
+
+#define scaler_ctx_gen_filter         ref_scaler_ctx_gen_filter
+#define scaler_ctx_gen_reset          ref_scaler_ctx_gen_reset
+#define scaler_ctx_scale              ref_scaler_ctx_scale
+#define scaler_alloc                  ref_scaler_alloc
+#define scaler_free                   ref_scaler_free
+#define scaler_gen_filter             ref_scaler_gen_filter
+#define scaler_argb8888_vert          ref_scaler_argb8888_vert
+#define scaler_argb8888_horiz         ref_scaler_argb8888_horiz
+#define scaler_argb8888_point_special ref_scaler_argb8888_point_special
+
+#define conv_0rgb1555_argb8888        ref_conv_0rgb1555_argb8888
+#define conv_bgr24_argb8888           ref_conv_bgr24_argb8888
+#define conv_argb8888_0rgb1555        ref_conv_argb8888_0rgb1555
+#define conv_argb8888_bgr24           ref_conv_argb8888_bgr24
+#define conv_0rgb1555_bgr24           ref_conv_0rgb1555_bgr24
+#define conv_copy                     ref_conv_copy
+#define conv_rgb565_argb8888          ref_conv_rgb565_argb8888
+#define conv_argb8888_rgb565          ref_conv_argb8888_rgb565
+#define conv_argb8888_yuv420          ref_conv_argb8888_yuv420
+#define conv_argb8888_nv12            ref_conv_argb8888_nv12
+#define conv_yuv420_argb8888          ref_conv_yuv420_argb8888
+#define conv_nv12_argb8888            ref_conv_nv12_argb8888
+#define conv_yuv420_copy              ref_conv_yuv420_copy
+#define conv_nv12_copy                ref_conv_nv12_copy
+
+#endif
+
@@ -50,6 +50,8 @@ typedef struct sdl_video
 
 #ifdef HAVE_FREETYPE
    font_renderer_t *font;
+   struct font_bitmap font_bitmap;
+   unsigned font_msg_id;
    uint8_t font_r;
    uint8_t font_g;
    uint8_t font_b;
@@ -74,6 +76,7 @@ static void sdl_gfx_free(void *data)
 #ifdef HAVE_FREETYPE
    if (vid->font)
       font_renderer_free(vid->font);
+   font_renderer_free_bitmap(&vid->font_bitmap);
 #endif
 
    scaler_ctx_gen_reset(&vid->scaler);
@@ -128,6 +131,19 @@ static void sdl_init_font(sdl_video_t *vid, const char *font_path, unsigned font
 #endif
 }
 
+#ifdef HAVE_FREETYPE
+// Messages usually stay up for many frames, so only render them again when they change.
+static const struct font_bitmap *sdl_msg_bitmap(sdl_video_t *vid, const char *msg)
+{
+   if (!g_extern.msg_id || g_extern.msg_id != vid->font_msg_id)
+   {
+      font_renderer_bitmap(vid->font, msg, &vid->font_bitmap);
+      vid->font_msg_id = g_extern.msg_id;
+   }
+   return &vid->font_bitmap;
+}
+#endif
+
 // Not very optimized, but hey :D
 static void sdl_render_msg_15(sdl_video_t *vid, SDL_Surface *buffer, const char *msg, unsigned width, unsigned height, const SDL_PixelFormat *fmt)
 {
@@ -135,9 +151,7 @@ static void sdl_render_msg_15(sdl_video_t *vid, SDL_Surface *buffer, const char
    if (!vid->font)
       return;
 
-   struct font_output_list out;
-   font_renderer_msg(vid->font, msg, &out);
-   struct font_output *head = out.head;
+   const struct font_bitmap *bitmap = sdl_msg_bitmap(vid, msg);
 
    int base_x = g_settings.video.msg_pos_x * width;
    int base_y = (1.0 - g_settings.video.msg_pos_y) * height;
@@ -146,41 +160,34 @@ static void sdl_render_msg_15(sdl_video_t *vid, SDL_Surface *buffer, const char
    unsigned gshift = fmt->Gshift;
    unsigned bshift = fmt->Bshift;
 
-   while (head)
+   int rbase_x = base_x + bitmap->off_x;
+   int rbase_y = base_y - bitmap->off_y;
+   if (rbase_y >= 0)
    {
-      int rbase_x = base_x + head->off_x;
-      int rbase_y = base_y - head->off_y;
-      if (rbase_y >= 0)
+      for (int y = 0; y < (int)bitmap->height && (y + rbase_y) < (int)height; y++)
       {
-         for (int y = 0; y < (int)head->height && (y + rbase_y) < (int)height; y++)
+         if (rbase_x < 0)
+            continue;
+
+         const uint8_t *a = bitmap->buffer + bitmap->width * y;
+         uint16_t *out = (uint16_t*)buffer->pixels + (rbase_y - bitmap->height + y) * (buffer->pitch >> 1) + rbase_x;
+
+         for (int x = 0; x < (int)bitmap->width && (x + rbase_x) < (int)width; x++)
          {
-            if (rbase_x < 0)
-               continue;
-
-            const uint8_t *a = head->output + head->pitch * y;
-            uint16_t *out = (uint16_t*)buffer->pixels + (rbase_y - head->height + y) * (buffer->pitch >> 1) + rbase_x;
-
-            for (int x = 0; x < (int)head->width && (x + rbase_x) < (int)width; x++)
-            {
-               unsigned blend = a[x];
-               unsigned out_pix = out[x];
-               unsigned r = (out_pix >> rshift) & 0x1f;
-               unsigned g = (out_pix >> gshift) & 0x1f;
-               unsigned b = (out_pix >> bshift) & 0x1f;
-
-               unsigned out_r = (r * (256 - blend) + vid->font_r * blend) >> 8;
-               unsigned out_g = (g * (256 - blend) + vid->font_g * blend) >> 8;
-               unsigned out_b = (b * (256 - blend) + vid->font_b * blend) >> 8;
-               out[x] = (out_r << rshift) | (out_g << gshift) | (out_b << bshift);
-            }
+            unsigned blend = a[x];
+            unsigned out_pix = out[x];
+            unsigned r = (out_pix >> rshift) & 0x1f;
+            unsigned g = (out_pix >> gshift) & 0x1f;
+            unsigned b = (out_pix >> bshift) & 0x1f;
+
+            unsigned out_r = (r * (256 - blend) + vid->font_r * blend) >> 8;
+            unsigned out_g = (g * (256 - blend) + vid->font_g * blend) >> 8;
+            unsigned out_b = (b * (256 - blend) + vid->font_b * blend) >> 8;
+            out[x] = (out_r << rshift) | (out_g << gshift) | (out_b << bshift);
          }
       }
-
-      head = head->next;
    }
 
-   font_renderer_free_output(&out);
-
 #else
    (void)vid;
    (void)buffer;
@@ -196,9 +203,7 @@ static void sdl_render_msg_32(sdl_video_t *vid, SDL_Surface *buffer, const char
    if (!vid->font)
       return;
 
-   struct font_output_list out;
-   font_renderer_msg(vid->font, msg, &out);
-   struct font_output *head = out.head;
+   const struct font_bitmap *bitmap = sdl_msg_bitmap(vid, msg);
 
    int base_x = g_settings.video.msg_pos_x * width;
    int base_y = (1.0 - g_settings.video.msg_pos_y) * height;
@@ -207,41 +212,34 @@ static void sdl_render_msg_32(sdl_video_t *vid, SDL_Surface *buffer, const char
    unsigned gshift = fmt->Gshift;
    unsigned bshift = fmt->Bshift;
 
-   while (head)
+   int rbase_x = base_x + bitmap->off_x;
+   int rbase_y = base_y - bitmap->off_y;
+   if (rbase_y >= 0)
    {
-      int rbase_x = base_x + head->off_x;
-      int rbase_y = base_y - head->off_y;
-      if (rbase_y >= 0)
+      for (int y = 0; y < (int)bitmap->height && (y + rbase_y) < (int)height; y++)
       {
-         for (int y = 0; y < (int)head->height && (y + rbase_y) < (int)height; y++)
+         if (rbase_x < 0)
+            continue;
+
+         const uint8_t *a = bitmap->buffer + bitmap->width * y;
+         uint32_t *out = (uint32_t*)buffer->pixels + (rbase_y - bitmap->height + y) * (buffer->pitch >> 2) + rbase_x;
+
+         for (int x = 0; x < (int)bitmap->width && (x + rbase_x) < (int)width; x++)
          {
-            if (rbase_x < 0)
-               continue;
-
-            const uint8_t *a = head->output + head->pitch * y;
-            uint32_t *out = (uint32_t*)buffer->pixels + (rbase_y - head->height + y) * (buffer->pitch >> 2) + rbase_x;
-
-            for (int x = 0; x < (int)head->width && (x + rbase_x) < (int)width; x++)
-            {
-               unsigned blend = a[x];
-               unsigned out_pix = out[x];
-               unsigned r = (out_pix >> rshift) & 0xff;
-               unsigned g = (out_pix >> gshift) & 0xff;
-               unsigned b = (out_pix >> bshift) & 0xff;
-
-               unsigned out_r = (r * (256 - blend) + vid->font_r * blend) >> 8;
-               unsigned out_g = (g * (256 - blend) + vid->font_g * blend) >> 8;
-               unsigned out_b = (b * (256 - blend) + vid->font_b * blend) >> 8;
-               out[x] = (out_r << rshift) | (out_g << gshift) | (out_b << bshift);
-            }
+            unsigned blend = a[x];
+            unsigned out_pix = out[x];
+            unsigned r = (out_pix >> rshift) & 0xff;
+            unsigned g = (out_pix >> gshift) & 0xff;
+            unsigned b = (out_pix >> bshift) & 0xff;
+
+            unsigned out_r = (r * (256 - blend) + vid->font_r * blend) >> 8;
+            unsigned out_g = (g * (256 - blend) + vid->font_g * blend) >> 8;
+            unsigned out_b = (b * (256 - blend) + vid->font_b * blend) >> 8;
+            out[x] = (out_r << rshift) | (out_g << gshift) | (out_b << bshift);
          }
       }
-
-      head = head->next;
    }
 
-   font_renderer_free_output(&out);
-
 #else
    (void)vid;
    (void)buffer;
@@ -364,6 +362,10 @@ static void *sdl_gfx_init(const video_info_t *video, const input_driver_t **inpu
    vid->scaler.in_fmt  = vid->render32 ? SCALER_FMT_ARGB8888 : SCALER_FMT_0RGB1555;
    vid->scaler.out_fmt = vid->scaler.in_fmt;
 
+#ifdef HAVE_THREADS
+   vid->scaler.threads = g_settings.video.scaler_threads ? g_settings.video.scaler_threads : sthread_get_cpu_cores();
+#endif
+
    return vid;
 
 error:
@@ -23,20 +23,22 @@
 #include "py_state/py_state.h"
 #endif
 
+// state_tracker_init() compiles the uniform list into a small program.
+// Every unique memory location is fetched once per frame,
+// and elements are sorted by type so each type is evaluated in one tight loop.
+
 struct state_tracker_internal
 {
    char id[64];
+   unsigned index; // Index in uniform list.
+   unsigned source; // Index into fetched values.
 
-   bool is_input;
-   const uint16_t *input_ptr;
-   const uint8_t *ptr;
 #ifdef HAVE_PYTHON
    py_state_t *py;
+   float py_value;
 #endif
 
-   uint32_t addr;
    uint16_t mask;
-
    uint16_t equal;
 
    enum state_tracker_type type;
@@ -48,18 +50,88 @@ struct state_tracker_internal
    int transition_count;
 };
 
+struct state_tracker_group
+{
+   enum state_tracker_type type;
+   unsigned begin, end;
+};
+
 struct state_tracker
 {
    struct state_tracker_internal *info;
    unsigned info_elem;
 
+   struct state_tracker_group *groups;
+   unsigned num_groups;
+
+   // Values fetched this frame. The two input slots come first, then every unique WRAM location.
+   uint16_t *values;
+   const uint8_t **wram_sources;
+   unsigned num_wram_sources;
+
    uint16_t input_state[2];
+   bool input_used[2];
 
 #ifdef HAVE_PYTHON
    py_state_t *py;
+   unsigned py_frame_count;
+   bool py_valid;
 #endif
 };
 
+#define INPUT_SOURCES 2
+
+static unsigned add_wram_source(state_tracker_t *tracker, const uint8_t *ptr)
+{
+   for (unsigned i = 0; i < tracker->num_wram_sources; i++)
+      if (tracker->wram_sources[i] == ptr)
+         return INPUT_SOURCES + i;
+
+   tracker->wram_sources[tracker->num_wram_sources] = ptr;
+   return INPUT_SOURCES + tracker->num_wram_sources++;
+}
+
+static unsigned add_input_source(state_tracker_t *tracker, unsigned slot)
+{
+   tracker->input_used[slot] = true;
+   return slot;
+}
+
+// Sorts by type, keeping uniform order within a type.
+static int element_cmp(const void *a_, const void *b_)
+{
+   const struct state_tracker_internal *a = (const struct state_tracker_internal*)a_;
+   const struct state_tracker_internal *b = (const struct state_tracker_internal*)b_;
+
+   if (a->type != b->type)
+      return a->type < b->type ? -1 : 1;
+   return a->index < b->index ? -1 : (a->index > b->index ? 1 : 0);
+}
+
+static bool compile_program(state_tracker_t *tracker)
+{
+   unsigned elems = tracker->info_elem;
+
+   if (elems)
+      qsort(tracker->info, elems, sizeof(*tracker->info), element_cmp);
+
+   tracker->groups = (struct state_tracker_group*)calloc(elems ? elems : 1, sizeof(*tracker->groups));
+   if (!tracker->groups)
+      return false;
+
+   for (unsigned i = 0; i < elems; )
+   {
+      struct state_tracker_group *group = &tracker->groups[tracker->num_groups++];
+      group->type = tracker->info[i].type;
+      group->begin = i;
+      while (i < elems && tracker->info[i].type == group->type)
+         i++;
+      group->end = i;
+   }
+
+   return true;
+}
+
 state_tracker_t* state_tracker_init(const struct state_tracker_info *info)
 {
    state_tracker_t *tracker = (state_tracker_t*)calloc(1, sizeof(*tracker));
@@ -79,20 +151,29 @@ state_tracker_t* state_tracker_init(const struct state_tracker_info *info)
    }
 #endif
 
-   tracker->info = (struct state_tracker_internal*)calloc(info->info_elem, sizeof(struct state_tracker_internal));
-   tracker->info_elem = info->info_elem;
+   unsigned elems = info->info_elem;
+   tracker->info = (struct state_tracker_internal*)calloc(elems ? elems : 1, sizeof(struct state_tracker_internal));
+   tracker->wram_sources = (const uint8_t**)calloc(elems ? elems : 1, sizeof(*tracker->wram_sources));
+   tracker->values = (uint16_t*)calloc(INPUT_SOURCES + elems, sizeof(*tracker->values));
+   tracker->info_elem = elems;
 
-   for (unsigned i = 0; i < info->info_elem; i++)
+   if (!tracker->info || !tracker->wram_sources || !tracker->values)
+      goto error;
+
+   for (unsigned i = 0; i < elems; i++)
    {
       strlcpy(tracker->info[i].id, info->info[i].id, sizeof(tracker->info[i].id));
-      tracker->info[i].addr  = info->info[i].addr;
+      tracker->info[i].index = i;
       tracker->info[i].type  = info->info[i].type;
       tracker->info[i].mask  = (info->info[i].mask == 0) ? 0xffff : info->info[i].mask;
       tracker->info[i].equal = info->info[i].equal;
 
 #ifdef HAVE_PYTHON
       if (info->info[i].type == RARCH_STATE_PYTHON)
+      {
          tracker->info[i].py = tracker->py;
+         continue;
+      }
 #endif
 
       // If we don't have a valid pointer.
@@ -101,43 +182,61 @@ state_tracker_t* state_tracker_init(const struct state_tracker_info *info)
       switch (info->info[i].ram_type)
       {
          case RARCH_STATE_WRAM:
-            tracker->info[i].ptr = info->wram ? info->wram : &empty;
+            tracker->info[i].source = add_wram_source(tracker,
+                  info->wram ? info->wram + info->info[i].addr : &empty);
             break;
          case RARCH_STATE_INPUT_SLOT1:
-            tracker->info[i].input_ptr = &tracker->input_state[0];
-            tracker->info[i].is_input = true;
+            tracker->info[i].source = add_input_source(tracker, 0);
             break;
          case RARCH_STATE_INPUT_SLOT2:
-            tracker->info[i].input_ptr = &tracker->input_state[1];
-            tracker->info[i].is_input = true;
+            tracker->info[i].source = add_input_source(tracker, 1);
             break;
 
          default:
-            tracker->info[i].ptr = &empty;
+            tracker->info[i].source = add_wram_source(tracker, &empty);
       }
    }
 
+   if (!compile_program(tracker))
+      goto error;
+
+   RARCH_LOG("State tracker: %u uniforms, %u memory fetches, %u groups.\n",
+         elems, tracker->num_wram_sources, tracker->num_groups);
+
    return tracker;
+
+error:
+   RARCH_ERR("Failed to allocate state tracker.\n");
+   state_tracker_free(tracker);
+   return NULL;
 }
 
 void state_tracker_free(state_tracker_t *tracker)
 {
    free(tracker->info);
+   free(tracker->groups);
+   free(tracker->wram_sources);
+   free(tracker->values);
 #ifdef HAVE_PYTHON
-   py_state_free(tracker->py);
+   if (tracker->py)
+      py_state_free(tracker->py);
 #endif
    free(tracker);
 }
 
-static inline uint16_t fetch(const struct state_tracker_internal *info)
+static void fetch_values(state_tracker_t *tracker)
 {
-   uint16_t val = 0;
-   if (info->is_input)
-      val = *info->input_ptr;
-   else
-      val = info->ptr[info->addr];
+   uint16_t *values = tracker->values;
 
-   val &= info->mask;
+   for (unsigned i = 0; i < INPUT_SOURCES; i++)
+      *values++ = tracker->input_state[i];
+   for (unsigned i = 0; i < tracker->num_wram_sources; i++)
+      *values++ = *tracker->wram_sources[i];
+}
+
+static inline uint16_t fetch(const state_tracker_t *tracker, const struct state_tracker_internal *info)
+{
+   uint16_t val = tracker->values[info->source] & info->mask;
 
    if (info->equal && val != info->equal)
       val = 0;
@@ -145,62 +244,107 @@ static inline uint16_t fetch(const struct state_tracker_internal *info)
    return val;
 }
 
-static void update_element(
-      struct state_tracker_uniform *uniform,
-      struct state_tracker_internal *info,
+static void update_group(state_tracker_t *tracker,
+      const struct state_tracker_group *group,
+      struct state_tracker_uniform *uniforms, unsigned elems,
       unsigned frame_count)
 {
-   uniform->id = info->id;
+   struct state_tracker_internal *info = tracker->info + group->begin;
+   struct state_tracker_internal *end = tracker->info + group->end;
 
-   switch (info->type)
+   switch (group->type)
    {
       case RARCH_STATE_CAPTURE:
-         uniform->value = fetch(info);
+         for (; info < end; info++)
+         {
+            if (info->index < elems)
+               uniforms[info->index].value = fetch(tracker, info);
+         }
          break;
 
       case RARCH_STATE_CAPTURE_PREV:
-         if (info->prev[0] != fetch(info))
+         for (; info < end; info++)
          {
-            info->prev[1] = info->prev[0];
-            info->prev[0] = fetch(info);
+            if (info->index >= elems)
+               continue;
+
+            uint16_t val = fetch(tracker, info);
+            if (info->prev[0] != val)
+            {
+               info->prev[1] = info->prev[0];
+               info->prev[0] = val;
+            }
+            uniforms[info->index].value = info->prev[1];
          }
-         uniform->value = info->prev[1];
          break;
 
       case RARCH_STATE_TRANSITION:
-         if (info->old_value != fetch(info))
+         for (; info < end; info++)
          {
-            info->old_value = fetch(info);
-            info->frame_count = frame_count;
+            if (info->index >= elems)
+               continue;
+
+            uint16_t val = fetch(tracker, info);
+            if (info->old_value != val)
+            {
+               info->old_value = val;
+               info->frame_count = frame_count;
+            }
+            uniforms[info->index].value = info->frame_count;
          }
-         uniform->value = info->frame_count;
          break;
 
       case RARCH_STATE_TRANSITION_COUNT:
-         if (info->old_value != fetch(info))
+         for (; info < end; info++)
          {
-            info->old_value = fetch(info);
-            info->transition_count++;
+            if (info->index >= elems)
+               continue;
+
+            uint16_t val = fetch(tracker, info);
+            if (info->old_value != val)
+            {
+               info->old_value = val;
+               info->transition_count++;
+            }
+            uniforms[info->index].value = info->transition_count;
          }
-         uniform->value = info->transition_count;
          break;
 
       case RARCH_STATE_TRANSITION_PREV:
-         if (info->old_value != fetch(info))
+         for (; info < end; info++)
          {
-            info->old_value = fetch(info);
-            info->frame_count_prev = info->frame_count;
-            info->frame_count = frame_count;
+            if (info->index >= elems)
+               continue;
+
+            uint16_t val = fetch(tracker, info);
+            if (info->old_value != val)
+            {
+               info->old_value = val;
+               info->frame_count_prev = info->frame_count;
+               info->frame_count = frame_count;
+            }
+            uniforms[info->index].value = info->frame_count_prev;
          }
-         uniform->value = info->frame_count_prev;
          break;
-      
+
 #ifdef HAVE_PYTHON
+      // Scripts can read any memory, so the only dependency we can track is the frame count.
       case RARCH_STATE_PYTHON:
-         uniform->value = py_state_get(info->py, info->id, frame_count);
+      {
+         bool update = !tracker->py_valid || tracker->py_frame_count != frame_count;
+         for (; info < end; info++)
+         {
+            if (info->index >= elems)
+               continue;
+
+            if (update)
+               info->py_value = py_state_get(info->py, info->id, frame_count);
+            uniforms[info->index].value = info->py_value;
+         }
          break;
+      }
 #endif
-      
+
       default:
          break;
    }
@@ -233,15 +377,17 @@ static void update_input(state_tracker_t *tracker)
       g_settings.input.binds[1],
    };
 
-   uint16_t state[2] = {0};
-   for (unsigned i = 4; i < 16; i++)
+   // Only poll players which are actually tracked.
+   for (unsigned p = 0; p < 2; p++)
    {
-      state[0] |= (input_input_state_func(binds, 0, RETRO_DEVICE_JOYPAD, 0, buttons[i - 4]) ? 1 : 0) << i;
-      state[1] |= (input_input_state_func(binds, 1, RETRO_DEVICE_JOYPAD, 0, buttons[i - 4]) ? 1 : 0) << i;
-   }
+      if (!tracker->input_used[p])
+         continue;
 
-   for (unsigned i = 0; i < 2; i++)
-      tracker->input_state[i] = state[i];
+      uint16_t state = 0;
+      for (unsigned i = 4; i < 16; i++)
+         state |= (input_input_state_func(binds, p, RETRO_DEVICE_JOYPAD, 0, buttons[i - 4]) ? 1 : 0) << i;
+      tracker->input_state[p] = state;
+   }
 }
 
 unsigned state_get_uniform(state_tracker_t *tracker, struct state_tracker_uniform *uniforms, unsigned elem, unsigned frame_count)
@@ -249,10 +395,22 @@ unsigned state_get_uniform(state_tracker_t *tracker, struct state_tracker_unifor
    unsigned elems = tracker->info_elem < elem ? tracker->info_elem : elem;
 
    update_input(tracker);
+   fetch_values(tracker);
 
-   for (unsigned i = 0; i < elems; i++)
-      update_element(&uniforms[i], &tracker->info[i], frame_count);
+   // IDs never change, but the caller might hand us a different array.
+   for (unsigned i = 0; i < tracker->info_elem; i++)
+   {
+      if (tracker->info[i].index < elems)
+         uniforms[tracker->info[i].index].id = tracker->info[i].id;
+   }
+
+   for (unsigned i = 0; i < tracker->num_groups; i++)
+      update_group(tracker, &tracker->groups[i], uniforms, elems, frame_count);
+
+#ifdef HAVE_PYTHON
+   tracker->py_frame_count = frame_count;
+   tracker->py_valid = true;
+#endif
 
    return elems;
 }
-
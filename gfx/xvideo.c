@@ -23,6 +23,7 @@
 #include "fonts/fonts.h"
 #endif
 #include "gfx_common.h"
+#include "../performance.h"
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
@@ -57,12 +58,13 @@ typedef struct xv
    unsigned height;
    bool keep_aspect;
 
-   uint8_t *ytable;
-   uint8_t *utable;
-   uint8_t *vtable;
+   // Packs one line of frame pixels into two identical lines of 2x wide YUV macropixels.
+   void (*pack_line)(uint32_t *out0, uint32_t *out1, const void *input, unsigned width);
 
 #ifdef HAVE_FREETYPE
    font_renderer_t *font;
+   struct font_bitmap font_bitmap;
+   unsigned font_msg_id;
 
    unsigned luma_index[2];
    unsigned chroma_u_index;
@@ -73,7 +75,6 @@ typedef struct xv
    uint8_t font_v;
 #endif
 
-   void (*render_func)(struct xv*, const void *frame, unsigned width, unsigned height, unsigned pitch);
 } xv_t;
 
 static void xv_set_nonblock_state(void *data, bool state)
@@ -92,33 +93,13 @@ static void sighandler(int sig)
    g_quit = 1;
 }
 
+// BT.601 limited range, same integer approximation as the software scaler uses for YUV recording.
 static inline void calculate_yuv(uint8_t *y, uint8_t *u, uint8_t *v, unsigned r, unsigned g, unsigned b)
 {
-   int y_ = (int)(+((double)r * 0.257) + ((double)g * 0.504) + ((double)b * 0.098) +  16.0);
-   int u_ = (int)(-((double)r * 0.148) - ((double)g * 0.291) + ((double)b * 0.439) + 128.0);
-   int v_ = (int)(+((double)r * 0.439) - ((double)g * 0.368) - ((double)b * 0.071) + 128.0);
-
-   *y = y_ < 0 ? 0 : (y_ > 255 ? 255 : y_);
-   *u = y_ < 0 ? 0 : (u_ > 255 ? 255 : u_);
-   *v = v_ < 0 ? 0 : (v_ > 255 ? 255 : v_);
-}
-
-static void init_yuv_tables(xv_t *xv)
-{
-   xv->ytable = (uint8_t*)malloc(0x8000);
-   xv->utable = (uint8_t*)malloc(0x8000);
-   xv->vtable = (uint8_t*)malloc(0x8000);
-
-   for (unsigned i = 0; i < 0x8000; i++)
-   {
-      // Extract RGB555 color data from i
-      unsigned r = (i >> 10) & 0x1F, g = (i >> 5) & 0x1F, b = (i) & 0x1F;
-      r = (r << 3) | (r >> 2);  // R5->R8
-      g = (g << 3) | (g >> 2);  // G5->G8
-      b = (b << 3) | (b >> 2);  // B5->B8
-
-      calculate_yuv(&xv->ytable[i], &xv->utable[i], &xv->vtable[i], r, g, b);
-   }
+   int r_ = r, g_ = g, b_ = b;
+   *y = ((  66 * r_ + 129 * g_ +  25 * b_ + 128) >> 8) +  16;
+   *u = (( -38 * r_ -  74 * g_ + 112 * b_ + 128) >> 8) + 128;
+   *v = (( 112 * r_ -  94 * g_ -  18 * b_ + 128) >> 8) + 128;
 }
 
 // Source: MPlayer
@@ -212,126 +193,383 @@ static void xv_init_font(xv_t *xv, const char *font_path, unsigned font_size)
 }
 
 // We render @ 2x scale to combat chroma downsampling. Also makes fonts more bearable :)
-static void render16_yuy2(xv_t *xv, const void *input_, unsigned width, unsigned height, unsigned pitch)
+// Every frame pixel becomes one macropixel (two luma samples sharing its chroma),
+// and every frame line is written twice.
+//
+// A YUY2 macropixel is Y U Y V in memory. UYVY is the same word rotated by one byte.
+static inline uint32_t pack_yuy2(unsigned r, unsigned g, unsigned b)
 {
-   const uint16_t *input = (const uint16_t*)input_;
-   uint8_t *output = (uint8_t*)xv->image->data;
+   uint8_t y, u, v;
+   calculate_yuv(&y, &u, &v, r, g, b);
+   return y | (u << 8) | (y << 16) | ((uint32_t)v << 24);
+}
+
+static inline uint32_t yuy2_to_uyvy(uint32_t p)
+{
+   return (p >> 8) | (p << 24);
+}
 
-   for (unsigned y = 0; y < height; y++)
+static inline void pack_line_c(uint32_t *out0, uint32_t *out1,
+      const void *input, unsigned width, bool rgb32, bool uyvy)
+{
+   for (unsigned x = 0; x < width; x++)
    {
-      for (unsigned x = 0; x < width; x++)
+      unsigned r, g, b;
+      if (rgb32)
+      {
+         uint32_t p = ((const uint32_t*)input)[x];
+         r = (p >> 16) & 0xff;
+         g = (p >>  8) & 0xff;
+         b = (p >>  0) & 0xff;
+      }
+      else
       {
-         uint16_t p = *input++;
-
-         uint8_t y0 = xv->ytable[p];
-         uint8_t u = xv->utable[p];
-         uint8_t v = xv->vtable[p];
-
-         unsigned img_width = xv->width << 1;
-         output[0] = output[img_width] = y0;
-         output[1] = output[img_width + 1] = u;
-         output[2] = output[img_width + 2] = y0;
-         output[3] = output[img_width + 3] = v;
-         output += 4;
+         uint16_t p = ((const uint16_t*)input)[x];
+         r = (p >> 10) & 0x1f;
+         g = (p >>  5) & 0x1f;
+         b = (p >>  0) & 0x1f;
+         r = (r << 3) | (r >> 2);  // R5->R8
+         g = (g << 3) | (g >> 2);  // G5->G8
+         b = (b << 3) | (b >> 2);  // B5->B8
       }
 
-      input  += (pitch >> 1) - width;
-      output += (xv->width - width) << 2;
+      uint32_t p = pack_yuy2(r, g, b);
+      if (uyvy)
+         p = yuy2_to_uyvy(p);
+      out0[x] = out1[x] = p;
+   }
+}
+
+// SIMD packers convert to YUV with the same integer math as calculate_yuv() on 16-bit lanes.
+// U and V are biased by 0x8000 before shifting so everything can stay unsigned.
+#define XV_PACKERS(impl, attr) \
+   attr static void pack16_yuy2_##impl(uint32_t *out0, uint32_t *out1, const void *input, unsigned width) \
+   { pack_line_##impl(out0, out1, input, width, false, false); } \
+   attr static void pack16_uyvy_##impl(uint32_t *out0, uint32_t *out1, const void *input, unsigned width) \
+   { pack_line_##impl(out0, out1, input, width, false, true); } \
+   attr static void pack32_yuy2_##impl(uint32_t *out0, uint32_t *out1, const void *input, unsigned width) \
+   { pack_line_##impl(out0, out1, input, width, true, false); } \
+   attr static void pack32_uyvy_##impl(uint32_t *out0, uint32_t *out1, const void *input, unsigned width) \
+   { pack_line_##impl(out0, out1, input, width, true, true); }
+
+XV_PACKERS(c, )
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+#define XV_HAVE_SSE2
+// Runtime dispatched. Requires a compiler which supports per-function target attributes.
+#if defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#include <immintrin.h>
+#define XV_HAVE_AVX2
+#endif
+
+static inline __m128i expand5_sse2(__m128i c)
+{
+   return _mm_or_si128(_mm_slli_epi16(c, 3), _mm_srli_epi16(c, 2));
+}
+
+// Packs eight pixels, given as 8-bit channels in 16-bit lanes.
+static inline void pack_yuv_sse2(uint32_t *out0, uint32_t *out1,
+      __m128i r, __m128i g, __m128i b, bool uyvy)
+{
+   __m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)),
+         _mm_add_epi16(_mm_mullo_epi16(g, _mm_set1_epi16(129)),
+            _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(25)), _mm_set1_epi16(128))));
+   y = _mm_add_epi16(_mm_srli_epi16(y, 8), _mm_set1_epi16(16));
+
+   __m128i u = _mm_sub_epi16(_mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(112)), _mm_set1_epi16((int16_t)0x8080)),
+         _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(38)), _mm_mullo_epi16(g, _mm_set1_epi16(74))));
+   u = _mm_srli_epi16(u, 8);
+
+   __m128i v = _mm_sub_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(112)), _mm_set1_epi16((int16_t)0x8080)),
+         _mm_add_epi16(_mm_mullo_epi16(g, _mm_set1_epi16(94)), _mm_mullo_epi16(b, _mm_set1_epi16(18))));
+   v = _mm_srli_epi16(v, 8);
+
+   __m128i lo, hi;
+   if (uyvy)
+   {
+      __m128i uy = _mm_or_si128(u, _mm_slli_epi16(y, 8));
+      __m128i vy = _mm_or_si128(v, _mm_slli_epi16(y, 8));
+      lo = _mm_unpacklo_epi16(uy, vy);
+      hi = _mm_unpackhi_epi16(uy, vy);
+   }
+   else
+   {
+      __m128i yu = _mm_or_si128(y, _mm_slli_epi16(u, 8));
+      __m128i yv = _mm_or_si128(y, _mm_slli_epi16(v, 8));
+      lo = _mm_unpacklo_epi16(yu, yv);
+      hi = _mm_unpackhi_epi16(yu, yv);
    }
+
+   _mm_storeu_si128((__m128i*)(out0 + 0), lo);
+   _mm_storeu_si128((__m128i*)(out0 + 4), hi);
+   _mm_storeu_si128((__m128i*)(out1 + 0), lo);
+   _mm_storeu_si128((__m128i*)(out1 + 4), hi);
 }
 
-static void render16_uyvy(xv_t *xv, const void *input_, unsigned width, unsigned height, unsigned pitch)
+static inline void pack_line_sse2(uint32_t *out0, uint32_t *out1,
+      const void *input, unsigned width, bool rgb32, bool uyvy)
 {
-   const uint16_t *input = (const uint16_t*)input_;
-   uint8_t *output = (uint8_t*)xv->image->data;
+   const __m128i mask = rgb32 ? _mm_set1_epi32(0xff) : _mm_set1_epi16(0x1f);
+   unsigned x;
 
-   for (unsigned y = 0; y < height; y++)
+   for (x = 0; x + 8 <= width; x += 8)
    {
-      for (unsigned x = 0; x < width; x++)
+      __m128i r, g, b;
+      if (rgb32)
+      {
+         const uint32_t *in = (const uint32_t*)input + x;
+         __m128i p0 = _mm_loadu_si128((const __m128i*)(in + 0));
+         __m128i p1 = _mm_loadu_si128((const __m128i*)(in + 4));
+
+         // Isolate each channel in its 32-bit lane, then narrow to 16-bit lanes.
+         r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask), _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+         g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0,  8), mask), _mm_and_si128(_mm_srli_epi32(p1,  8), mask));
+         b = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+      }
+      else
       {
-         uint16_t p = *input++;
-
-         uint8_t y0 = xv->ytable[p];
-         uint8_t u = xv->utable[p];
-         uint8_t v = xv->vtable[p];
-
-         unsigned img_width = xv->width << 1;
-         output[0] = output[img_width] = u;
-         output[1] = output[img_width + 1] = y0;
-         output[2] = output[img_width + 2] = v;
-         output[3] = output[img_width + 3] = y0;
-         output += 4;
+         __m128i p = _mm_loadu_si128((const __m128i*)((const uint16_t*)input + x));
+         r = expand5_sse2(_mm_and_si128(_mm_srli_epi16(p, 10), mask));
+         g = expand5_sse2(_mm_and_si128(_mm_srli_epi16(p, 5), mask));
+         b = expand5_sse2(_mm_and_si128(p, mask));
       }
 
-      input  += (pitch >> 1) - width;
-      output += (xv->width - width) << 2;
+      pack_yuv_sse2(out0 + x, out1 + x, r, g, b, uyvy);
+   }
+
+   if (x < width)
+   {
+      const uint8_t *in = (const uint8_t*)input + x * (rgb32 ? sizeof(uint32_t) : sizeof(uint16_t));
+      pack_line_c(out0 + x, out1 + x, in, width - x, rgb32, uyvy);
+   }
+}
+
+XV_PACKERS(sse2, )
+#endif
+
+#ifdef XV_HAVE_AVX2
+#define XV_AVX2 __attribute__((target("avx2")))
+
+XV_AVX2 static inline __m256i expand5_avx2(__m256i c)
+{
+   return _mm256_or_si256(_mm256_slli_epi16(c, 3), _mm256_srli_epi16(c, 2));
+}
+
+// Packs sixteen pixels, given as 8-bit channels in 16-bit lanes.
+XV_AVX2 static inline void pack_yuv_avx2(uint32_t *out0, uint32_t *out1,
+      __m256i r, __m256i g, __m256i b, bool uyvy)
+{
+   __m256i y = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(66)),
+         _mm256_add_epi16(_mm256_mullo_epi16(g, _mm256_set1_epi16(129)),
+            _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(25)), _mm256_set1_epi16(128))));
+   y = _mm256_add_epi16(_mm256_srli_epi16(y, 8), _mm256_set1_epi16(16));
+
+   __m256i u = _mm256_sub_epi16(_mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(112)),
+            _mm256_set1_epi16((int16_t)0x8080)),
+         _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(38)), _mm256_mullo_epi16(g, _mm256_set1_epi16(74))));
+   u = _mm256_srli_epi16(u, 8);
+
+   __m256i v = _mm256_sub_epi16(_mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(112)),
+            _mm256_set1_epi16((int16_t)0x8080)),
+         _mm256_add_epi16(_mm256_mullo_epi16(g, _mm256_set1_epi16(94)), _mm256_mullo_epi16(b, _mm256_set1_epi16(18))));
+   v = _mm256_srli_epi16(v, 8);
+
+   __m256i lo, hi;
+   if (uyvy)
+   {
+      __m256i uy = _mm256_or_si256(u, _mm256_slli_epi16(y, 8));
+      __m256i vy = _mm256_or_si256(v, _mm256_slli_epi16(y, 8));
+      lo = _mm256_unpacklo_epi16(uy, vy);
+      hi = _mm256_unpackhi_epi16(uy, vy);
+   }
+   else
+   {
+      __m256i yu = _mm256_or_si256(y, _mm256_slli_epi16(u, 8));
+      __m256i yv = _mm256_or_si256(y, _mm256_slli_epi16(v, 8));
+      lo = _mm256_unpacklo_epi16(yu, yv);
+      hi = _mm256_unpackhi_epi16(yu, yv);
    }
+
+   // Unpacking works within 128-bit lanes, so lo holds pixels 0-3 and 8-11.
+   __m256i first  = _mm256_permute2x128_si256(lo, hi, 0x20);
+   __m256i second = _mm256_permute2x128_si256(lo, hi, 0x31);
+
+   _mm256_storeu_si256((__m256i*)(out0 + 0), first);
+   _mm256_storeu_si256((__m256i*)(out0 + 8), second);
+   _mm256_storeu_si256((__m256i*)(out1 + 0), first);
+   _mm256_storeu_si256((__m256i*)(out1 + 8), second);
 }
 
-static void render32_yuy2(xv_t *xv, const void *input_, unsigned width, unsigned height, unsigned pitch)
+XV_AVX2 static inline void pack_line_avx2(uint32_t *out0, uint32_t *out1,
+      const void *input, unsigned width, bool rgb32, bool uyvy)
 {
-   const uint32_t *input = (const uint32_t*)input_;
-   uint8_t *output = (uint8_t*)xv->image->data;
+   const __m256i mask = rgb32 ? _mm256_set1_epi32(0xff) : _mm256_set1_epi16(0x1f);
+   unsigned x;
 
-   for (unsigned y = 0; y < height; y++)
+   for (x = 0; x + 16 <= width; x += 16)
    {
-      for (unsigned x = 0; x < width; x++)
+      __m256i r, g, b;
+      if (rgb32)
       {
-         uint32_t p = *input++;
-         p = ((p >> 9) & 0x7c00) | ((p >> 6) & 0x03e0) | ((p >> 3) & 0x1f); // ARGB -> RGB15
-
-         uint8_t y0 = xv->ytable[p];
-         uint8_t u = xv->utable[p];
-         uint8_t v = xv->vtable[p];
-
-         unsigned img_width = xv->width << 1;
-         output[0] = output[img_width] = y0;
-         output[1] = output[img_width + 1] = u;
-         output[2] = output[img_width + 2] = y0;
-         output[3] = output[img_width + 3] = v;
-         output += 4;
+         const uint32_t *in = (const uint32_t*)input + x;
+         __m256i p0 = _mm256_loadu_si256((const __m256i*)(in + 0));
+         __m256i p1 = _mm256_loadu_si256((const __m256i*)(in + 8));
+
+         // Packing interleaves 128-bit lanes, permute back to pixel order.
+         r = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 16), mask),
+               _mm256_and_si256(_mm256_srli_epi32(p1, 16), mask));
+         g = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0,  8), mask),
+               _mm256_and_si256(_mm256_srli_epi32(p1,  8), mask));
+         b = _mm256_packs_epi32(_mm256_and_si256(p0, mask), _mm256_and_si256(p1, mask));
+         r = _mm256_permute4x64_epi64(r, 0xd8);
+         g = _mm256_permute4x64_epi64(g, 0xd8);
+         b = _mm256_permute4x64_epi64(b, 0xd8);
       }
+      else
+      {
+         __m256i p = _mm256_loadu_si256((const __m256i*)((const uint16_t*)input + x));
+         r = expand5_avx2(_mm256_and_si256(_mm256_srli_epi16(p, 10), mask));
+         g = expand5_avx2(_mm256_and_si256(_mm256_srli_epi16(p, 5), mask));
+         b = expand5_avx2(_mm256_and_si256(p, mask));
+      }
+
+      pack_yuv_avx2(out0 + x, out1 + x, r, g, b, uyvy);
+   }
 
-      input  += (pitch >> 2) - width;
-      output += (xv->width - width) << 2;
+   if (x < width)
+   {
+      const uint8_t *in = (const uint8_t*)input + x * (rgb32 ? sizeof(uint32_t) : sizeof(uint16_t));
+      pack_line_sse2(out0 + x, out1 + x, in, width - x, rgb32, uyvy);
    }
 }
 
-static void render32_uyvy(xv_t *xv, const void *input_, unsigned width, unsigned height, unsigned pitch)
+XV_PACKERS(avx2, XV_AVX2)
+#endif
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define XV_HAVE_NEON
+
+static inline uint16x8_t expand5_neon(uint16x8_t c)
+{
+   return vorrq_u16(vshlq_n_u16(c, 3), vshrq_n_u16(c, 2));
+}
+
+static inline void pack_line_neon(uint32_t *out0, uint32_t *out1,
+      const void *input, unsigned width, bool rgb32, bool uyvy)
 {
-   const uint32_t *input = (const uint32_t*)input_;
-   uint16_t *output = (uint16_t*)xv->image->data;
+   unsigned x;
 
-   for (unsigned y = 0; y < height; y++)
+   for (x = 0; x + 8 <= width; x += 8)
    {
-      for (unsigned x = 0; x < width; x++)
+      uint16x8_t r, g, b;
+      if (rgb32)
+      {
+         // B, G, R, A in memory.
+         uint8x8x4_t p = vld4_u8((const uint8_t*)((const uint32_t*)input + x));
+         r = vmovl_u8(p.val[2]);
+         g = vmovl_u8(p.val[1]);
+         b = vmovl_u8(p.val[0]);
+      }
+      else
+      {
+         const uint16x8_t mask = vdupq_n_u16(0x1f);
+         uint16x8_t p = vld1q_u16((const uint16_t*)input + x);
+         r = expand5_neon(vandq_u16(vshrq_n_u16(p, 10), mask));
+         g = expand5_neon(vandq_u16(vshrq_n_u16(p, 5), mask));
+         b = expand5_neon(vandq_u16(p, mask));
+      }
+
+      uint16x8_t y = vmlaq_n_u16(vmlaq_n_u16(vmlaq_n_u16(vdupq_n_u16(128), r, 66), g, 129), b, 25);
+      uint16x8_t u = vmlsq_n_u16(vmlsq_n_u16(vmlaq_n_u16(vdupq_n_u16(0x8080), b, 112), r, 38), g, 74);
+      uint16x8_t v = vmlsq_n_u16(vmlsq_n_u16(vmlaq_n_u16(vdupq_n_u16(0x8080), r, 112), g, 94), b, 18);
+
+      uint8x8_t y8 = vadd_u8(vshrn_n_u16(y, 8), vdup_n_u8(16));
+      uint8x8_t u8 = vshrn_n_u16(u, 8);
+      uint8x8_t v8 = vshrn_n_u16(v, 8);
+
+      uint8x8x4_t res;
+      if (uyvy)
       {
-         uint32_t p = *input++;
-         p = ((p >> 9) & 0x7c00) | ((p >> 6) & 0x03e0) | ((p >> 3) & 0x1f); // ARGB -> RGB15
-
-         uint8_t y0 = xv->ytable[p];
-         uint8_t u = xv->utable[p];
-         uint8_t v = xv->vtable[p];
-
-         unsigned img_width = xv->width << 1;
-         output[0] = output[img_width] = u;
-         output[1] = output[img_width + 1] = y0;
-         output[2] = output[img_width + 2] = v;
-         output[3] = output[img_width + 3] = y0;
-         output += 4;
+         res.val[0] = u8;
+         res.val[1] = y8;
+         res.val[2] = v8;
+         res.val[3] = y8;
       }
+      else
+      {
+         res.val[0] = y8;
+         res.val[1] = u8;
+         res.val[2] = y8;
+         res.val[3] = v8;
+      }
+
+      vst4_u8((uint8_t*)(out0 + x), res);
+      vst4_u8((uint8_t*)(out1 + x), res);
+   }
 
-      input  += (pitch >> 2) - width;
-      output += (xv->width - width) << 2;
+   if (x < width)
+   {
+      const uint8_t *in = (const uint8_t*)input + x * (rgb32 ? sizeof(uint32_t) : sizeof(uint16_t));
+      pack_line_c(out0 + x, out1 + x, in, width - x, rgb32, uyvy);
    }
 }
 
+XV_PACKERS(neon, )
+#endif
+
+typedef void (*pack_line_t)(uint32_t *out0, uint32_t *out1, const void *input, unsigned width);
+
+struct packer_desc
+{
+   const char *ident;
+   pack_line_t pack[2][2]; // [rgb32][uyvy]
+};
+
+#define XV_PACKER_DESC(impl) { #impl, { \
+   { pack16_yuy2_##impl, pack16_uyvy_##impl }, \
+   { pack32_yuy2_##impl, pack32_uyvy_##impl } } }
+
+static const struct packer_desc *find_packer(void)
+{
+   static const struct packer_desc packers[] = {
+#ifdef XV_HAVE_AVX2
+      XV_PACKER_DESC(avx2),
+#endif
+#ifdef XV_HAVE_SSE2
+      XV_PACKER_DESC(sse2),
+#endif
+#ifdef XV_HAVE_NEON
+      XV_PACKER_DESC(neon),
+#endif
+      XV_PACKER_DESC(c),
+   };
+
+   struct rarch_cpu_features cpu;
+   rarch_get_cpu_features(&cpu);
+
+   unsigned i = 0;
+#ifdef XV_HAVE_AVX2
+   if (!(cpu.simd & RARCH_SIMD_AVX2))
+      i++;
+#endif
+   return &packers[i];
+}
+
+static void xv_render(xv_t *xv, const void *input, unsigned width, unsigned height, unsigned pitch)
+{
+   uint32_t *output = (uint32_t*)xv->image->data;
+   unsigned out_pitch = xv->width >> 1; // In macropixels.
+
+   for (unsigned y = 0; y < height; y++, output += out_pitch << 1)
+      xv->pack_line(output, output + out_pitch, (const uint8_t*)input + y * pitch, width);
+}
+
 struct format_desc
 {
-   void (*render_16)(xv_t *xv, const void *input,
-         unsigned width, unsigned height, unsigned pitch);
-   void (*render_32)(xv_t *xv, const void *input,
-         unsigned width, unsigned height, unsigned pitch);
+   bool uyvy;
    char components[4];
    unsigned luma_index[2];
    unsigned u_index;
@@ -340,16 +578,14 @@ struct format_desc
 
 static const struct format_desc formats[] = {
    {
-      render16_yuy2,
-      render32_yuy2,
+      false,
       { 'Y', 'U', 'Y', 'V' },
       { 0, 2 },
       1,
       3,
    },
    {
-      render16_uyvy,
-      render32_uyvy,
+      true,
       { 'U', 'Y', 'V', 'Y' },
       { 1, 3 },
       0,
@@ -376,7 +612,10 @@ static bool adaptor_set_format(xv_t *xv, Display *dpy, XvPortID port, const vide
                   format[i].component_order[3] == formats[j].components[3])
             {
                xv->fourcc = format[i].id;
-               xv->render_func = video->rgb32 ? formats[j].render_32 : formats[j].render_16;
+
+               const struct packer_desc *packer = find_packer();
+               xv->pack_line = packer->pack[video->rgb32][formats[j].uyvy];
+               RARCH_LOG("XVideo: Using %s YUV packer.\n", packer->ident);
 
 #ifdef HAVE_FREETYPE
                xv->luma_index[0] = formats[j].luma_index[0];
@@ -539,7 +778,6 @@ static void *xv_init(const video_info_t *video, const input_driver_t **input, vo
    else
       *input = NULL;
 
-   init_yuv_tables(xv);
    xv_init_font(xv, g_settings.video.font_path, g_settings.video.font_size);
 
    return xv;
@@ -624,6 +862,19 @@ static void calc_out_rect(bool keep_aspect, unsigned *x, unsigned *y, unsigned *
    }
 }
 
+#ifdef HAVE_FREETYPE
+// The message bitmap is only rendered again when the message changes.
+static const struct font_bitmap *xv_msg_bitmap(xv_t *xv, const char *msg)
+{
+   if (!g_extern.msg_id || g_extern.msg_id != xv->font_msg_id)
+   {
+      font_renderer_bitmap(xv->font, msg, &xv->font_bitmap);
+      xv->font_msg_id = g_extern.msg_id;
+   }
+   return &xv->font_bitmap;
+}
+#endif
+
 // TODO: Is there some way to render directly like GL? :(
 // Hacky C code is hacky :D Yay.
 static void xv_render_msg(xv_t *xv, const char *msg, unsigned width, unsigned height)
@@ -632,9 +883,7 @@ static void xv_render_msg(xv_t *xv, const char *msg, unsigned width, unsigned he
    if (!xv->font)
       return;
 
-   struct font_output_list out;
-   font_renderer_msg(xv->font, msg, &out);
-   struct font_output *head = out.head;
+   const struct font_bitmap *bitmap = xv_msg_bitmap(xv, msg);
 
    int _base_x = g_settings.video.msg_pos_x * width;
    int _base_y = height - g_settings.video.msg_pos_y * height;
@@ -645,54 +894,47 @@ static void xv_render_msg(xv_t *xv, const char *msg, unsigned width, unsigned he
 
    unsigned pitch = width << 1; // YUV formats used are 16 bpp.
 
-   while (head)
-   {
-      int base_x = (_base_x + head->off_x) << 1;
-      base_x &= ~3; // Make sure we always start on the correct boundary so the indices are correct.
+   int base_x = (_base_x + bitmap->off_x) << 1;
+   base_x &= ~3; // Make sure we always start on the correct boundary so the indices are correct.
 
-      int base_y = _base_y - head->off_y;
-      if (base_y >= 0)
+   int base_y = _base_y - bitmap->off_y;
+   if (base_y >= 0)
+   {
+      for (int y = 0; y < (int)bitmap->height && (base_y + y) < (int)height; y++)
       {
-         for (int y = 0; y < (int)head->height && (base_y + y) < (int)height; y++)
-         {
-            if (base_x < 0)
-               continue;
+         if (base_x < 0)
+            continue;
 
-            const uint8_t *a = head->output + head->pitch * y;
-            uint8_t *out = (uint8_t*)xv->image->data + (base_y - head->height + y) * pitch + base_x;
+         const uint8_t *a = bitmap->buffer + bitmap->width * y;
+         uint8_t *out = (uint8_t*)xv->image->data + (base_y - bitmap->height + y) * pitch + base_x;
 
-            for (int x = 0; x < (int)(head->width << 1) && (base_x + x) < (int)pitch; x += 4)
-            {
-               unsigned alpha[2];
-               alpha[0] = a[(x >> 1) + 0];
+         for (int x = 0; x < (int)(bitmap->width << 1) && (base_x + x) < (int)pitch; x += 4)
+         {
+            unsigned alpha[2];
+            alpha[0] = a[(x >> 1) + 0];
 
-               if (((x >> 1) + 1) == (int)head->width) // We reached the end, uhoh. Branching like a BOSS. :D
-                  alpha[1] = 0;
-               else
-                  alpha[1] = a[(x >> 1) + 1];
+            if (((x >> 1) + 1) == (int)bitmap->width) // We reached the end, uhoh. Branching like a BOSS. :D
+               alpha[1] = 0;
+            else
+               alpha[1] = a[(x >> 1) + 1];
 
-               unsigned alpha_sub = (alpha[0] + alpha[1]) >> 1; // Blended alpha for the sub-samples U/V channels.
+            unsigned alpha_sub = (alpha[0] + alpha[1]) >> 1; // Blended alpha for the sub-samples U/V channels.
 
-               for (unsigned i = 0; i < 2; i++)
-               {
-                  unsigned blended = (xv->font_y * alpha[i] + ((256 - alpha[i]) * out[x + luma_index[i]])) >> 8;
-                  out[x + luma_index[i]] = blended;
-               }
+            for (unsigned i = 0; i < 2; i++)
+            {
+               unsigned blended = (xv->font_y * alpha[i] + ((256 - alpha[i]) * out[x + luma_index[i]])) >> 8;
+               out[x + luma_index[i]] = blended;
+            }
 
-               // Blend chroma channels
-               unsigned blended = (xv->font_u * alpha_sub + ((256 - alpha_sub) * out[x + chroma_u_index])) >> 8;
-               out[x + chroma_u_index] = blended;
+            // Blend chroma channels
+            unsigned blended = (xv->font_u * alpha_sub + ((256 - alpha_sub) * out[x + chroma_u_index])) >> 8;
+            out[x + chroma_u_index] = blended;
 
-               blended = (xv->font_v * alpha_sub + ((256 - alpha_sub) * out[x + chroma_v_index])) >> 8;
-               out[x + chroma_v_index] = blended;
-            }
+            blended = (xv->font_v * alpha_sub + ((256 - alpha_sub) * out[x + chroma_v_index])) >> 8;
+            out[x + chroma_v_index] = blended;
          }
       }
-
-      head = head->next;
    }
-
-   font_renderer_free_output(&out);
 #else
    (void)xv;
    (void)msg;
@@ -713,7 +955,7 @@ static bool xv_frame(void *data, const void *frame, unsigned width, unsigned hei
 
    XWindowAttributes target;
    XGetWindowAttributes(xv->display, xv->window, &target);
-   xv->render_func(xv, frame, width, height, pitch);
+   xv_render(xv, frame, width, height, pitch);
 
    unsigned x, y, owidth, oheight;
    calc_out_rect(xv->keep_aspect, &x, &y, &owidth, &oheight, target.width, target.height);
@@ -786,13 +1028,10 @@ static void xv_free(void *data)
 
    XCloseDisplay(xv->display);
 
-   free(xv->ytable);
-   free(xv->utable);
-   free(xv->vtable);
-
 #ifdef HAVE_FREETYPE
    if (xv->font)
       font_renderer_free(xv->font);
+   font_renderer_free_bitmap(&xv->font_bitmap);
 #endif
 
    free(xv);
@@ -0,0 +1,1025 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2012 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Reads keyboards, mice and joypads directly from /dev/input/event* on a dedicated thread.
+// Does not depend on X or a terminal, and picks up devices as they are plugged in.
+
+#include "../driver.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <linux/input.h>
+#include "../general.h"
+#include "../thread.h"
+#include "../performance.h"
+
+#define EVDEV_DIR "/dev/input"
+
+#define EVDEV_MAX_DEVICES 32
+#define EVDEV_MAX_BUTTONS 64
+#define EVDEV_MAX_AXES    16
+#define EVDEV_MAX_HATS    4
+#define EVDEV_NO_MAP      0xff
+
+// Tags for epoll events which are not devices.
+#define EVDEV_TAG_INOTIFY EVDEV_MAX_DEVICES
+#define EVDEV_TAG_QUIT    (EVDEV_MAX_DEVICES + 1)
+
+// Set in evdev_input_t::latest when the input thread has published a state the main thread has not seen.
+#define EVDEV_FRESH 4
+
+#define EVDEV_LONG_BITS (8 * sizeof(long))
+#define EVDEV_NLONGS(x) (((x) + EVDEV_LONG_BITS - 1) / EVDEV_LONG_BITS)
+#define EVDEV_TEST_BIT(bit, array) ((array[(bit) / EVDEV_LONG_BITS] >> ((bit) % EVDEV_LONG_BITS)) & 1)
+
+#define EVDEV_KEY_HELD(keys, code) ((keys[(code) >> 3] >> ((code) & 7)) & 1)
+
+struct evdev_pad
+{
+   bool connected;
+   uint32_t connections; // Bumped whenever a device takes this pad, which restarts presses.
+   uint64_t buttons; // Held buttons, bitmask over button indices.
+   uint8_t presses[EVDEV_MAX_BUTTONS];
+   int16_t axes[EVDEV_MAX_AXES];
+   int8_t hats[EVDEV_MAX_HATS][2]; // -1, 0 or 1 for X and Y.
+};
+
+// Merged state of all devices, as published by the input thread.
+// Press counters are incremented on every press, so that the main thread
+// notices presses which were released again before it polled.
+struct evdev_state
+{
+   uint8_t keys[KEY_CNT / 8]; // Held keys and mouse buttons of all keyboards and mice.
+   uint8_t presses[KEY_CNT];
+   int32_t mouse_x; // Accumulated relative motion.
+   int32_t mouse_y;
+   struct evdev_pad pads[MAX_PLAYERS];
+
+   rarch_time_t event_time; // Monotonic timestamp of newest event.
+   uint32_t event_count;
+};
+
+struct evdev_device
+{
+   int fd;
+   char path[PATH_MAX];
+   int pad; // Index into pads, or -1 for keyboards and mice.
+
+   uint8_t button_map[KEY_CNT]; // Key code to pad button index.
+   uint8_t axis_map[ABS_CNT];   // Axis code to pad axis index.
+   int32_t axis_min[EVDEV_MAX_AXES];
+   int32_t axis_max[EVDEV_MAX_AXES];
+   bool monotonic; // Kernel timestamps use CLOCK_MONOTONIC.
+};
+
+typedef struct evdev_input
+{
+   // Owned by the input thread once started.
+   sthread_t *thread;
+   int epoll_fd;
+   int inotify_fd;
+   int quit_pipe[2];
+   struct evdev_device *devices[EVDEV_MAX_DEVICES];
+   struct evdev_state live;
+   unsigned write_idx;
+
+   // Triple buffer. Neither side ever waits on the other.
+   struct evdev_state buffers[3];
+   volatile unsigned latest;
+
+   // Owned by the main thread.
+   unsigned read_idx;
+   uint8_t frame_keys[KEY_CNT / 8]; // Held, or pressed since last poll.
+   uint8_t last_presses[KEY_CNT];
+   uint64_t frame_buttons[MAX_PLAYERS];
+   uint8_t last_pad_presses[MAX_PLAYERS][EVDEV_MAX_BUTTONS];
+   uint32_t last_pad_connections[MAX_PLAYERS];
+   int32_t last_mouse_x;
+   int32_t last_mouse_y;
+   int16_t mouse_dx;
+   int16_t mouse_dy;
+   uint32_t last_event_count;
+} evdev_input_t;
+
+// Age of the newest input event when the frame polled it.
+static struct rarch_perf_counter evdev_perf_input_age = { "input_age" };
+
+static unsigned keysym_lut[RETROK_LAST];
+static const struct
+{
+   uint16_t code;
+   enum retro_key sk;
+} lut_binds[] = {
+   { KEY_ESC, RETROK_ESCAPE },
+   { KEY_1, RETROK_1 },
+   { KEY_2, RETROK_2 },
+   { KEY_3, RETROK_3 },
+   { KEY_4, RETROK_4 },
+   { KEY_5, RETROK_5 },
+   { KEY_6, RETROK_6 },
+   { KEY_7, RETROK_7 },
+   { KEY_8, RETROK_8 },
+   { KEY_9, RETROK_9 },
+   { KEY_0, RETROK_0 },
+   { KEY_MINUS, RETROK_MINUS },
+   { KEY_EQUAL, RETROK_EQUALS },
+   { KEY_BACKSPACE, RETROK_BACKSPACE },
+   { KEY_TAB, RETROK_TAB },
+   { KEY_Q, RETROK_q },
+   { KEY_W, RETROK_w },
+   { KEY_E, RETROK_e },
+   { KEY_R, RETROK_r },
+   { KEY_T, RETROK_t },
+   { KEY_Y, RETROK_y },
+   { KEY_U, RETROK_u },
+   { KEY_I, RETROK_i },
+   { KEY_O, RETROK_o },
+   { KEY_P, RETROK_p },
+   { KEY_LEFTBRACE, RETROK_LEFTBRACKET },
+   { KEY_RIGHTBRACE, RETROK_RIGHTBRACKET },
+   { KEY_ENTER, RETROK_RETURN },
+   { KEY_LEFTCTRL, RETROK_LCTRL },
+   { KEY_A, RETROK_a },
+   { KEY_S, RETROK_s },
+   { KEY_D, RETROK_d },
+   { KEY_F, RETROK_f },
+   { KEY_G, RETROK_g },
+   { KEY_H, RETROK_h },
+   { KEY_J, RETROK_j },
+   { KEY_K, RETROK_k },
+   { KEY_L, RETROK_l },
+   { KEY_SEMICOLON, RETROK_SEMICOLON },
+   { KEY_APOSTROPHE, RETROK_QUOTE },
+   { KEY_GRAVE, RETROK_BACKQUOTE },
+   { KEY_LEFTSHIFT, RETROK_LSHIFT },
+   { KEY_BACKSLASH, RETROK_BACKSLASH },
+   { KEY_Z, RETROK_z },
+   { KEY_X, RETROK_x },
+   { KEY_C, RETROK_c },
+   { KEY_V, RETROK_v },
+   { KEY_B, RETROK_b },
+   { KEY_N, RETROK_n },
+   { KEY_M, RETROK_m },
+   { KEY_COMMA, RETROK_COMMA },
+   { KEY_DOT, RETROK_PERIOD },
+   { KEY_SLASH, RETROK_SLASH },
+   { KEY_RIGHTSHIFT, RETROK_RSHIFT },
+   { KEY_KPASTERISK, RETROK_KP_MULTIPLY },
+   { KEY_LEFTALT, RETROK_LALT },
+   { KEY_SPACE, RETROK_SPACE },
+   { KEY_CAPSLOCK, RETROK_CAPSLOCK },
+   { KEY_F1, RETROK_F1 },
+   { KEY_F2, RETROK_F2 },
+   { KEY_F3, RETROK_F3 },
+   { KEY_F4, RETROK_F4 },
+   { KEY_F5, RETROK_F5 },
+   { KEY_F6, RETROK_F6 },
+   { KEY_F7, RETROK_F7 },
+   { KEY_F8, RETROK_F8 },
+   { KEY_F9, RETROK_F9 },
+   { KEY_F10, RETROK_F10 },
+   { KEY_NUMLOCK, RETROK_NUMLOCK },
+   { KEY_SCROLLLOCK, RETROK_SCROLLOCK },
+   { KEY_KP7, RETROK_KP7 },
+   { KEY_KP8, RETROK_KP8 },
+   { KEY_KP9, RETROK_KP9 },
+   { KEY_KPMINUS, RETROK_KP_MINUS },
+   { KEY_KP4, RETROK_KP4 },
+   { KEY_KP5, RETROK_KP5 },
+   { KEY_KP6, RETROK_KP6 },
+   { KEY_KPPLUS, RETROK_KP_PLUS },
+   { KEY_KP1, RETROK_KP1 },
+   { KEY_KP2, RETROK_KP2 },
+   { KEY_KP3, RETROK_KP3 },
+   { KEY_KP0, RETROK_KP0 },
+   { KEY_KPDOT, RETROK_KP_PERIOD },
+
+   { KEY_F11, RETROK_F11 },
+   { KEY_F12, RETROK_F12 },
+
+   { KEY_KPENTER, RETROK_KP_ENTER },
+   { KEY_RIGHTCTRL, RETROK_RCTRL },
+   { KEY_KPSLASH, RETROK_KP_DIVIDE },
+   { KEY_SYSRQ, RETROK_PRINT },
+   { KEY_RIGHTALT, RETROK_RALT },
+
+   { KEY_HOME, RETROK_HOME },
+   { KEY_UP, RETROK_UP },
+   { KEY_PAGEUP, RETROK_PAGEUP },
+   { KEY_LEFT, RETROK_LEFT },
+   { KEY_RIGHT, RETROK_RIGHT },
+   { KEY_END, RETROK_END },
+   { KEY_DOWN, RETROK_DOWN },
+   { KEY_PAGEDOWN, RETROK_PAGEDOWN },
+   { KEY_INSERT, RETROK_INSERT },
+   { KEY_DELETE, RETROK_DELETE },
+
+   { KEY_PAUSE, RETROK_PAUSE },
+   { KEY_LEFTMETA, RETROK_LSUPER },
+   { KEY_RIGHTMETA, RETROK_RSUPER },
+   { KEY_COMPOSE, RETROK_MENU },
+};
+
+static void init_lut(void)
+{
+   memset(keysym_lut, 0, sizeof(keysym_lut));
+   for (unsigned i = 0; i < sizeof(lut_binds) / sizeof(lut_binds[0]); i++)
+      keysym_lut[lut_binds[i].sk] = lut_binds[i].code;
+}
+
+// Input thread.
+
+static void evdev_publish(evdev_input_t *evdev)
+{
+   memcpy(&evdev->buffers[evdev->write_idx], &evdev->live, sizeof(evdev->live));
+   __sync_synchronize();
+   evdev->write_idx = __sync_lock_test_and_set(&evdev->latest, evdev->write_idx | EVDEV_FRESH) & ~EVDEV_FRESH;
+}
+
+static void evdev_set_key(evdev_input_t *evdev, unsigned code, bool pressed)
+{
+   uint8_t mask = 1 << (code & 7);
+   if (pressed)
+   {
+      if (!(evdev->live.keys[code >> 3] & mask))
+         evdev->live.presses[code]++;
+      evdev->live.keys[code >> 3] |= mask;
+   }
+   else
+      evdev->live.keys[code >> 3] &= ~mask;
+}
+
+static void evdev_set_button(struct evdev_pad *pad, unsigned index, bool pressed)
+{
+   uint64_t mask = UINT64_C(1) << index;
+   if (pressed)
+   {
+      if (!(pad->buttons & mask))
+         pad->presses[index]++;
+      pad->buttons |= mask;
+   }
+   else
+      pad->buttons &= ~mask;
+}
+
+static int16_t evdev_normalize_axis(const struct evdev_device *dev, unsigned index, int32_t value)
+{
+   int32_t min = dev->axis_min[index];
+   int32_t max = dev->axis_max[index];
+   if (max <= min)
+      return 0;
+
+   int64_t scaled = ((int64_t)value - min) * 0xfffe / (max - min) - 0x7fff;
+   if (scaled < -0x7fff)
+      scaled = -0x7fff;
+   else if (scaled > 0x7fff)
+      scaled = 0x7fff;
+   return (int16_t)scaled;
+}
+
+static void evdev_handle_abs(evdev_input_t *evdev, const struct evdev_device *dev, unsigned code, int32_t value)
+{
+   struct evdev_pad *pad = &evdev->live.pads[dev->pad];
+
+   if (code >= ABS_HAT0X && code <= ABS_HAT3Y)
+   {
+      unsigned hat = (code - ABS_HAT0X) >> 1;
+      pad->hats[hat][(code - ABS_HAT0X) & 1] = value < 0 ? -1 : (value > 0 ? 1 : 0);
+   }
+   else if (dev->axis_map[code] != EVDEV_NO_MAP)
+      pad->axes[dev->axis_map[code]] = evdev_normalize_axis(dev, dev->axis_map[code], value);
+}
+
+// Reads current state of a device, used when it is opened and when events were dropped.
+static void evdev_sync_device(evdev_input_t *evdev, const struct evdev_device *dev)
+{
+   unsigned long keys[EVDEV_NLONGS(KEY_CNT)] = {0};
+   if (ioctl(dev->fd, EVIOCGKEY(sizeof(keys)), keys) < 0)
+      return;
+
+   if (dev->pad < 0)
+   {
+      // Keyboards and mice share the key state, so only keys held on this device are known.
+      for (unsigned code = 0; code < KEY_CNT; code++)
+      {
+         if (EVDEV_TEST_BIT(code, keys))
+            evdev_set_key(evdev, code, true);
+      }
+      return;
+   }
+
+   for (unsigned code = 0; code < KEY_CNT; code++)
+   {
+      if (dev->button_map[code] != EVDEV_NO_MAP)
+         evdev_set_button(&evdev->live.pads[dev->pad], dev->button_map[code], EVDEV_TEST_BIT(code, keys));
+   }
+
+   for (unsigned code = 0; code < ABS_CNT; code++)
+   {
+      struct input_absinfo info;
+      if ((dev->axis_map[code] != EVDEV_NO_MAP || (code >= ABS_HAT0X && code <= ABS_HAT3Y)) &&
+            ioctl(dev->fd, EVIOCGABS(code), &info) == 0)
+         evdev_handle_abs(evdev, dev, code, info.value);
+   }
+}
+
+static int evdev_find_free_pad(evdev_input_t *evdev)
+{
+   for (unsigned i = 0; i < MAX_PLAYERS; i++)
+   {
+      if (!evdev->live.pads[i].connected)
+         return i;
+   }
+   return -1;
+}
+
+static bool evdev_device_open(evdev_input_t *evdev, const char *path)
+{
+   unsigned slot;
+   for (slot = 0; slot < EVDEV_MAX_DEVICES; slot++)
+   {
+      if (evdev->devices[slot] && strcmp(evdev->devices[slot]->path, path) == 0)
+         return true;
+   }
+
+   for (slot = 0; slot < EVDEV_MAX_DEVICES && evdev->devices[slot]; slot++);
+   if (slot == EVDEV_MAX_DEVICES)
+      return false;
+
+   int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+   if (fd < 0)
+      return false; // Permissions might not be set up yet, retried on IN_ATTRIB.
+
+   unsigned long types[EVDEV_NLONGS(EV_CNT)] = {0};
+   unsigned long keys[EVDEV_NLONGS(KEY_CNT)] = {0};
+   unsigned long abs[EVDEV_NLONGS(ABS_CNT)] = {0};
+   unsigned long rel[EVDEV_NLONGS(REL_CNT)] = {0};
+
+   if (ioctl(fd, EVIOCGBIT(0, sizeof(types)), types) < 0)
+   {
+      close(fd);
+      return false;
+   }
+
+   ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys);
+   ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs)), abs);
+   ioctl(fd, EVIOCGBIT(EV_REL, sizeof(rel)), rel);
+
+   bool is_pad = EVDEV_TEST_BIT(EV_ABS, types) && EVDEV_TEST_BIT(ABS_X, abs) && EVDEV_TEST_BIT(ABS_Y, abs);
+   if (is_pad)
+   {
+      bool has_buttons = false;
+      for (unsigned code = BTN_JOYSTICK; code < BTN_DIGI && !has_buttons; code++)
+         has_buttons = EVDEV_TEST_BIT(code, keys);
+      is_pad = has_buttons;
+   }
+
+   bool is_mouse = EVDEV_TEST_BIT(EV_REL, types) && EVDEV_TEST_BIT(REL_X, rel) && EVDEV_TEST_BIT(BTN_LEFT, keys);
+   bool is_keyboard = EVDEV_TEST_BIT(EV_KEY, types) && EVDEV_TEST_BIT(KEY_A, keys) && EVDEV_TEST_BIT(KEY_SPACE, keys);
+
+   int pad = is_pad ? evdev_find_free_pad(evdev) : -1;
+   if ((is_pad && pad < 0) || (!is_pad && !is_mouse && !is_keyboard))
+   {
+      close(fd);
+      return false;
+   }
+
+   struct evdev_device *dev = (struct evdev_device*)calloc(1, sizeof(*dev));
+   if (!dev)
+   {
+      close(fd);
+      return false;
+   }
+
+   dev->fd = fd;
+   dev->pad = pad;
+   strlcpy(dev->path, path, sizeof(dev->path));
+   memset(dev->button_map, EVDEV_NO_MAP, sizeof(dev->button_map));
+   memset(dev->axis_map, EVDEV_NO_MAP, sizeof(dev->axis_map));
+
+   int clock = CLOCK_MONOTONIC;
+   dev->monotonic = ioctl(fd, EVIOCSCLOCKID, &clock) == 0;
+
+   char name[256] = "Unknown";
+   ioctl(fd, EVIOCGNAME(sizeof(name)), name);
+
+   if (is_pad)
+   {
+      // Same button and axis order as the Linux joystick API, so binds carry over from SDL.
+      unsigned buttons = 0;
+      for (unsigned code = BTN_JOYSTICK; code < KEY_CNT && buttons < EVDEV_MAX_BUTTONS; code++)
+      {
+         if (EVDEV_TEST_BIT(code, keys))
+            dev->button_map[code] = buttons++;
+      }
+      for (unsigned code = BTN_MISC; code < BTN_JOYSTICK && buttons < EVDEV_MAX_BUTTONS; code++)
+      {
+         if (EVDEV_TEST_BIT(code, keys))
+            dev->button_map[code] = buttons++;
+      }
+
+      unsigned axes = 0;
+      for (unsigned code = 0; code < ABS_MISC && axes < EVDEV_MAX_AXES; code++)
+      {
+         if (code >= ABS_HAT0X && code <= ABS_HAT3Y)
+            continue;
+
+         struct input_absinfo info;
+         if (EVDEV_TEST_BIT(code, abs) && ioctl(fd, EVIOCGABS(code), &info) == 0)
+         {
+            dev->axis_min[axes] = info.minimum;
+            dev->axis_max[axes] = info.maximum;
+            dev->axis_map[code] = axes++;
+         }
+      }
+
+      uint32_t connections = evdev->live.pads[pad].connections;
+      memset(&evdev->live.pads[pad], 0, sizeof(evdev->live.pads[pad]));
+      evdev->live.pads[pad].connections = connections + 1;
+      evdev->live.pads[pad].connected = true;
+      RARCH_LOG("evdev: Joypad #%d: %s (%s), %u buttons, %u axes.\n", pad, name, path, buttons, axes);
+   }
+   else
+      RARCH_LOG("evdev: %s%s: %s (%s).\n", is_keyboard ? "Keyboard" : "", is_mouse ? (is_keyboard ? "/mouse" : "Mouse") : "", name, path);
+
+   struct epoll_event event = {0};
+   event.events = EPOLLIN;
+   event.data.u32 = slot;
+   if (epoll_ctl(evdev->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+   {
+      RARCH_ERR("evdev: Failed to watch %s.\n", path);
+      if (is_pad)
+         evdev->live.pads[pad].connected = false;
+      close(fd);
+      free(dev);
+      return false;
+   }
+
+   evdev->devices[slot] = dev;
+   evdev_sync_device(evdev, dev);
+   return true;
+}
+
+static void evdev_device_close(evdev_input_t *evdev, unsigned slot)
+{
+   struct evdev_device *dev = evdev->devices[slot];
+
+   RARCH_LOG("evdev: Removed %s.\n", dev->path);
+
+   if (dev->pad >= 0)
+   {
+      uint32_t connections = evdev->live.pads[dev->pad].connections;
+      memset(&evdev->live.pads[dev->pad], 0, sizeof(evdev->live.pads[dev->pad]));
+      evdev->live.pads[dev->pad].connections = connections;
+   }
+   else
+   {
+      // Cannot know which held keys belonged to this device, so release all of them.
+      memset(evdev->live.keys, 0, sizeof(evdev->live.keys));
+   }
+
+   epoll_ctl(evdev->epoll_fd, EPOLL_CTL_DEL, dev->fd, NULL);
+   close(dev->fd);
+   free(dev);
+   evdev->devices[slot] = NULL;
+}
+
+static void evdev_device_read(evdev_input_t *evdev, unsigned slot)
+{
+   struct evdev_device *dev = evdev->devices[slot];
+   struct input_event events[64];
+   ssize_t ret;
+
+   while ((ret = read(dev->fd, events, sizeof(events))) > 0)
+   {
+      unsigned count = ret / sizeof(struct input_event);
+      for (unsigned i = 0; i < count; i++)
+      {
+         const struct input_event *event = &events[i];
+
+         switch (event->type)
+         {
+            case EV_KEY:
+               if (event->value == 2 || event->code >= KEY_CNT) // Autorepeat.
+                  break;
+
+               if (dev->pad >= 0)
+               {
+                  if (dev->button_map[event->code] != EVDEV_NO_MAP)
+                     evdev_set_button(&evdev->live.pads[dev->pad], dev->button_map[event->code], event->value);
+               }
+               else
+                  evdev_set_key(evdev, event->code, event->value);
+               break;
+
+            case EV_ABS:
+               if (dev->pad >= 0 && event->code < ABS_CNT)
+                  evdev_handle_abs(evdev, dev, event->code, event->value);
+               break;
+
+            case EV_REL:
+               if (event->code == REL_X)
+                  evdev->live.mouse_x += event->value;
+               else if (event->code == REL_Y)
+                  evdev->live.mouse_y += event->value;
+               break;
+
+            case EV_SYN:
+               if (event->code == SYN_DROPPED)
+                  evdev_sync_device(evdev, dev);
+               break;
+
+            default:
+               break;
+         }
+
+         evdev->live.event_time = dev->monotonic ?
+            (rarch_time_t)event->time.tv_sec * 1000000 + event->time.tv_usec :
+            rarch_get_time_usec();
+         evdev->live.event_count++;
+      }
+   }
+
+   if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EINTR))
+      evdev_device_close(evdev, slot);
+}
+
+static void evdev_handle_hotplug(evdev_input_t *evdev)
+{
+   union
+   {
+      struct inotify_event event;
+      char buf[4096];
+   } data;
+
+   ssize_t ret;
+   while ((ret = read(evdev->inotify_fd, &data, sizeof(data))) > 0)
+   {
+      for (ssize_t offset = 0; offset < ret; )
+      {
+         const struct inotify_event *event = (const struct inotify_event*)(data.buf + offset);
+         offset += sizeof(struct inotify_event) + event->len;
+
+         if (!event->len || strncmp(event->name, "event", 5) != 0)
+            continue;
+
+         char path[PATH_MAX];
+         snprintf(path, sizeof(path), EVDEV_DIR "/%s", event->name);
+
+         if (event->mask & (IN_CREATE | IN_ATTRIB))
+            evdev_device_open(evdev, path);
+         else if (event->mask & IN_DELETE)
+         {
+            for (unsigned slot = 0; slot < EVDEV_MAX_DEVICES; slot++)
+            {
+               if (evdev->devices[slot] && strcmp(evdev->devices[slot]->path, path) == 0)
+                  evdev_device_close(evdev, slot);
+            }
+         }
+      }
+   }
+}
+
+static void evdev_thread(void *data)
+{
+   evdev_input_t *evdev = (evdev_input_t*)data;
+
+   for (;;)
+   {
+      struct epoll_event events[EVDEV_MAX_DEVICES + 2];
+      int num = epoll_wait(evdev->epoll_fd, events, EVDEV_MAX_DEVICES + 2, -1);
+      if (num < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         RARCH_ERR("evdev: epoll_wait() failed. Input thread is stopping.\n");
+         return;
+      }
+
+      for (int i = 0; i < num; i++)
+      {
+         uint32_t tag = events[i].data.u32;
+         if (tag == EVDEV_TAG_QUIT)
+            return;
+         else if (tag == EVDEV_TAG_INOTIFY)
+            evdev_handle_hotplug(evdev);
+         else if (evdev->devices[tag])
+            evdev_device_read(evdev, tag);
+      }
+
+      evdev_publish(evdev);
+   }
+}
+
+// Main thread.
+
+static void evdev_input_free(void *data);
+
+static int evdev_cmp_names(const void *a_, const void *b_)
+{
+   const char *a = *(const char* const*)a_;
+   const char *b = *(const char* const*)b_;
+
+   // Numeric order, so that event10 comes after event9.
+   int diff = (int)strlen(a) - (int)strlen(b);
+   return diff ? diff : strcmp(a, b);
+}
+
+static void evdev_scan_devices(evdev_input_t *evdev)
+{
+   DIR *dir = opendir(EVDEV_DIR);
+   if (!dir)
+   {
+      RARCH_WARN("evdev: Cannot open %s.\n", EVDEV_DIR);
+      return;
+   }
+
+   char *names[128];
+   unsigned num_names = 0;
+
+   struct dirent *entry;
+   while ((entry = readdir(dir)) && num_names < sizeof(names) / sizeof(names[0]))
+   {
+      if (strncmp(entry->d_name, "event", 5) == 0)
+         names[num_names++] = strdup(entry->d_name);
+   }
+   closedir(dir);
+
+   qsort(names, num_names, sizeof(names[0]), evdev_cmp_names);
+
+   for (unsigned i = 0; i < num_names; i++)
+   {
+      if (names[i])
+      {
+         char path[PATH_MAX];
+         snprintf(path, sizeof(path), EVDEV_DIR "/%s", names[i]);
+         evdev_device_open(evdev, path);
+      }
+      free(names[i]);
+   }
+}
+
+static void *evdev_input_init(void)
+{
+   init_lut();
+
+   evdev_input_t *evdev = (evdev_input_t*)calloc(1, sizeof(*evdev));
+   if (!evdev)
+      return NULL;
+
+   evdev->inotify_fd = -1;
+   evdev->quit_pipe[0] = evdev->quit_pipe[1] = -1;
+   evdev->read_idx = 0;
+   evdev->latest = 1;
+   evdev->write_idx = 2;
+
+   evdev->epoll_fd = epoll_create(EVDEV_MAX_DEVICES + 2);
+   if (evdev->epoll_fd < 0 || pipe(evdev->quit_pipe) < 0)
+   {
+      RARCH_ERR("evdev: Failed to set up epoll.\n");
+      goto error;
+   }
+
+   struct epoll_event event = {0};
+   event.events = EPOLLIN;
+   event.data.u32 = EVDEV_TAG_QUIT;
+   epoll_ctl(evdev->epoll_fd, EPOLL_CTL_ADD, evdev->quit_pipe[0], &event);
+
+   evdev->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (evdev->inotify_fd >= 0 && inotify_add_watch(evdev->inotify_fd, EVDEV_DIR, IN_CREATE | IN_ATTRIB | IN_DELETE) >= 0)
+   {
+      event.data.u32 = EVDEV_TAG_INOTIFY;
+      epoll_ctl(evdev->epoll_fd, EPOLL_CTL_ADD, evdev->inotify_fd, &event);
+   }
+   else
+      RARCH_WARN("evdev: Failed to watch %s. Hotplugging will not work.\n", EVDEV_DIR);
+
+   evdev_scan_devices(evdev);
+   evdev_publish(evdev);
+
+   evdev->thread = sthread_create(evdev_thread, evdev);
+   if (!evdev->thread)
+   {
+      RARCH_ERR("evdev: Failed to start input thread.\n");
+      goto error;
+   }
+
+   rarch_perf_register(&evdev_perf_input_age);
+   return evdev;
+
+error:
+   evdev_input_free(evdev);
+   return NULL;
+}
+
+static void evdev_input_poll(void *data)
+{
+   evdev_input_t *evdev = (evdev_input_t*)data;
+
+   if (evdev->latest & EVDEV_FRESH)
+   {
+      __sync_synchronize();
+      evdev->read_idx = __sync_lock_test_and_set(&evdev->latest, evdev->read_idx) & ~EVDEV_FRESH;
+      __sync_synchronize();
+   }
+
+   const struct evdev_state *state = &evdev->buffers[evdev->read_idx];
+
+   memcpy(evdev->frame_keys, state->keys, sizeof(evdev->frame_keys));
+   for (unsigned code = 0; code < KEY_CNT; code++)
+   {
+      if (state->presses[code] != evdev->last_presses[code])
+         evdev->frame_keys[code >> 3] |= 1 << (code & 7);
+   }
+   memcpy(evdev->last_presses, state->presses, sizeof(evdev->last_presses));
+
+   for (unsigned i = 0; i < MAX_PLAYERS; i++)
+   {
+      const struct evdev_pad *pad = &state->pads[i];
+
+      // A device reconnected into this pad, so its press counters started over.
+      if (pad->connections != evdev->last_pad_connections[i])
+      {
+         memset(evdev->last_pad_presses[i], 0, sizeof(evdev->last_pad_presses[i]));
+         evdev->last_pad_connections[i] = pad->connections;
+      }
+
+      evdev->frame_buttons[i] = pad->buttons;
+      for (unsigned b = 0; b < EVDEV_MAX_BUTTONS; b++)
+      {
+         if (pad->presses[b] != evdev->last_pad_presses[i][b])
+            evdev->frame_buttons[i] |= UINT64_C(1) << b;
+      }
+      memcpy(evdev->last_pad_presses[i], pad->presses, sizeof(pad->presses));
+   }
+
+   int32_t dx = state->mouse_x - evdev->last_mouse_x;
+   int32_t dy = state->mouse_y - evdev->last_mouse_y;
+   evdev->mouse_dx = dx < -0x7fff ? -0x7fff : (dx > 0x7fff ? 0x7fff : dx);
+   evdev->mouse_dy = dy < -0x7fff ? -0x7fff : (dy > 0x7fff ? 0x7fff : dy);
+   evdev->last_mouse_x = state->mouse_x;
+   evdev->last_mouse_y = state->mouse_y;
+
+   if (state->event_count != evdev->last_event_count)
+   {
+      evdev->last_event_count = state->event_count;
+      rarch_perf_add_sample(&evdev_perf_input_age, rarch_get_time_usec() - state->event_time);
+   }
+}
+
+static bool evdev_key_pressed(evdev_input_t *evdev, int key)
+{
+   if (key <= 0 || key >= RETROK_LAST || !keysym_lut[key])
+      return false;
+   return EVDEV_KEY_HELD(evdev->frame_keys, keysym_lut[key]);
+}
+
+static const struct evdev_pad *evdev_get_pad(evdev_input_t *evdev, unsigned port_num)
+{
+   int pad = g_settings.input.joypad_map[port_num];
+   if (pad < 0 || pad >= MAX_PLAYERS)
+      return NULL;
+
+   const struct evdev_pad *state = &evdev->buffers[evdev->read_idx].pads[pad];
+   return state->connected ? state : NULL;
+}
+
+static bool evdev_joykey_pressed(evdev_input_t *evdev, unsigned port_num, uint16_t joykey)
+{
+   const struct evdev_pad *pad = evdev_get_pad(evdev, port_num);
+   if (!pad || joykey == NO_BTN)
+      return false;
+
+   if (GET_HAT_DIR(joykey))
+   {
+      uint16_t hat = GET_HAT(joykey);
+      if (hat >= EVDEV_MAX_HATS)
+         return false;
+
+      switch (GET_HAT_DIR(joykey))
+      {
+         case HAT_UP_MASK:
+            return pad->hats[hat][1] < 0;
+         case HAT_DOWN_MASK:
+            return pad->hats[hat][1] > 0;
+         case HAT_LEFT_MASK:
+            return pad->hats[hat][0] < 0;
+         case HAT_RIGHT_MASK:
+            return pad->hats[hat][0] > 0;
+         default:
+            return false;
+      }
+   }
+
+   int index = g_settings.input.joypad_map[port_num];
+   return joykey < EVDEV_MAX_BUTTONS && ((evdev->frame_buttons[index] >> joykey) & 1);
+}
+
+static int16_t evdev_axis_analog(evdev_input_t *evdev, unsigned port_num, uint32_t joyaxis)
+{
+   const struct evdev_pad *pad = evdev_get_pad(evdev, port_num);
+   if (!pad || joyaxis == AXIS_NONE)
+      return 0;
+
+   int16_t val = 0;
+   if (AXIS_NEG_GET(joyaxis) < EVDEV_MAX_AXES)
+   {
+      val = pad->axes[AXIS_NEG_GET(joyaxis)];
+      if (val > 0)
+         val = 0;
+   }
+   else if (AXIS_POS_GET(joyaxis) < EVDEV_MAX_AXES)
+   {
+      val = pad->axes[AXIS_POS_GET(joyaxis)];
+      if (val < 0)
+         val = 0;
+   }
+
+   return val;
+}
+
+static bool evdev_is_pressed(evdev_input_t *evdev, unsigned port_num, const struct retro_keybind *key)
+{
+   if (evdev_key_pressed(evdev, key->key))
+      return true;
+   if (evdev_joykey_pressed(evdev, port_num, key->joykey))
+      return true;
+
+   float scaled = (float)abs(evdev_axis_analog(evdev, port_num, key->joyaxis)) / 0x8000;
+   return scaled > g_settings.input.axis_threshold;
+}
+
+static bool evdev_bind_button_pressed(void *data, int key)
+{
+   if (key >= 0 && key < RARCH_BIND_LIST_END)
+      return evdev_is_pressed((evdev_input_t*)data, 0, &g_settings.input.binds[0][key]);
+   else
+      return false;
+}
+
+static int16_t evdev_analog_device_state(evdev_input_t *evdev, const struct retro_keybind *binds,
+      unsigned port_num, unsigned index, unsigned id)
+{
+   unsigned id_minus, id_plus;
+   switch ((index << 1) | id)
+   {
+      case (RETRO_DEVICE_INDEX_ANALOG_LEFT << 1) | RETRO_DEVICE_ID_ANALOG_X:
+         id_minus = RARCH_ANALOG_LEFT_X_MINUS;
+         id_plus  = RARCH_ANALOG_LEFT_X_PLUS;
+         break;
+      case (RETRO_DEVICE_INDEX_ANALOG_LEFT << 1) | RETRO_DEVICE_ID_ANALOG_Y:
+         id_minus = RARCH_ANALOG_LEFT_Y_MINUS;
+         id_plus  = RARCH_ANALOG_LEFT_Y_PLUS;
+         break;
+      case (RETRO_DEVICE_INDEX_ANALOG_RIGHT << 1) | RETRO_DEVICE_ID_ANALOG_X:
+         id_minus = RARCH_ANALOG_RIGHT_X_MINUS;
+         id_plus  = RARCH_ANALOG_RIGHT_X_PLUS;
+         break;
+      case (RETRO_DEVICE_INDEX_ANALOG_RIGHT << 1) | RETRO_DEVICE_ID_ANALOG_Y:
+         id_minus = RARCH_ANALOG_RIGHT_Y_MINUS;
+         id_plus  = RARCH_ANALOG_RIGHT_Y_PLUS;
+         break;
+      default:
+         return 0;
+   }
+
+   const struct retro_keybind *bind_minus = &binds[id_minus];
+   const struct retro_keybind *bind_plus  = &binds[id_plus];
+   if (!bind_minus->valid || !bind_plus->valid)
+      return 0;
+
+   int16_t res = abs(evdev_axis_analog(evdev, port_num, bind_plus->joyaxis)) -
+      abs(evdev_axis_analog(evdev, port_num, bind_minus->joyaxis));
+   if (res != 0)
+      return res;
+
+   int16_t digital_left  = evdev_is_pressed(evdev, port_num, bind_minus) ? -0x7fff : 0;
+   int16_t digital_right = evdev_is_pressed(evdev, port_num, bind_plus)  ?  0x7fff : 0;
+   return digital_right + digital_left;
+}
+
+static int16_t evdev_input_state(void *data, const struct retro_keybind **binds, unsigned port, unsigned device, unsigned index, unsigned id)
+{
+   evdev_input_t *evdev = (evdev_input_t*)data;
+   const uint8_t *keys = evdev->frame_keys;
+
+   switch (device)
+   {
+      case RETRO_DEVICE_JOYPAD:
+         if (id < RARCH_BIND_LIST_END && binds[port][id].valid)
+            return evdev_is_pressed(evdev, port, &binds[port][id]);
+         return 0;
+
+      case RETRO_DEVICE_ANALOG:
+         if (id < RARCH_BIND_LIST_END)
+            return evdev_analog_device_state(evdev, binds[port], port, index, id);
+         return 0;
+
+      case RETRO_DEVICE_KEYBOARD:
+         return evdev_key_pressed(evdev, id);
+
+      case RETRO_DEVICE_MOUSE:
+         switch (id)
+         {
+            case RETRO_DEVICE_ID_MOUSE_X:
+               return evdev->mouse_dx;
+            case RETRO_DEVICE_ID_MOUSE_Y:
+               return evdev->mouse_dy;
+            case RETRO_DEVICE_ID_MOUSE_LEFT:
+               return EVDEV_KEY_HELD(keys, BTN_LEFT);
+            case RETRO_DEVICE_ID_MOUSE_RIGHT:
+               return EVDEV_KEY_HELD(keys, BTN_RIGHT);
+            default:
+               return 0;
+         }
+
+      case RETRO_DEVICE_LIGHTGUN:
+         switch (id)
+         {
+            case RETRO_DEVICE_ID_LIGHTGUN_X:
+               return evdev->mouse_dx;
+            case RETRO_DEVICE_ID_LIGHTGUN_Y:
+               return evdev->mouse_dy;
+            case RETRO_DEVICE_ID_LIGHTGUN_TRIGGER:
+               return EVDEV_KEY_HELD(keys, BTN_LEFT);
+            case RETRO_DEVICE_ID_LIGHTGUN_CURSOR:
+               return EVDEV_KEY_HELD(keys, BTN_MIDDLE);
+            case RETRO_DEVICE_ID_LIGHTGUN_TURBO:
+               return EVDEV_KEY_HELD(keys, BTN_RIGHT);
+            case RETRO_DEVICE_ID_LIGHTGUN_START:
+               return EVDEV_KEY_HELD(keys, BTN_MIDDLE) && EVDEV_KEY_HELD(keys, BTN_RIGHT);
+            case RETRO_DEVICE_ID_LIGHTGUN_PAUSE:
+               return EVDEV_KEY_HELD(keys, BTN_MIDDLE) && EVDEV_KEY_HELD(keys, BTN_LEFT);
+            default:
+               return 0;
+         }
+
+      default:
+         return 0;
+   }
+}
+
+static void evdev_input_free(void *data)
+{
+   evdev_input_t *evdev = (evdev_input_t*)data;
+   if (!evdev)
+      return;
+
+   if (evdev->thread)
+   {
+      char quit = 0;
+      write(evdev->quit_pipe[1], &quit, 1);
+      sthread_join(evdev->thread);
+      rarch_perf_unregister(&evdev_perf_input_age);
+   }
+
+   for (unsigned slot = 0; slot < EVDEV_MAX_DEVICES; slot++)
+   {
+      if (evdev->devices[slot])
+      {
+         close(evdev->devices[slot]->fd);
+         free(evdev->devices[slot]);
+      }
+   }
+
+   if (evdev->inotify_fd >= 0)
+      close(evdev->inotify_fd);
+   if (evdev->quit_pipe[0] >= 0)
+      close(evdev->quit_pipe[0]);
+   if (evdev->quit_pipe[1] >= 0)
+      close(evdev->quit_pipe[1]);
+   if (evdev->epoll_fd >= 0)
+      close(evdev->epoll_fd);
+
+   free(evdev);
+}
+
+const input_driver_t input_evdev = {
+   evdev_input_init,
+   evdev_input_poll,
+   evdev_input_state,
+   evdev_bind_button_pressed,
+   evdev_input_free,
+   "evdev"
+};
+
@@ -357,6 +357,21 @@ enum retro_key
                                            // The default pixel format is RETRO_PIXEL_FORMAT_0RGB1555.
                                            // If the call returns false, the frontend does not support this pixel format.
                                            // This function should be called inside retro_load_game() or retro_get_system_av_info().
+                                           //
+#define RETRO_ENVIRONMENT_GET_PERF_INTERFACE 11
+                                           // struct retro_perf_callback * --
+                                           // Gets an interface for timing and profiling the implementation.
+                                           // Counters registered here are reported by the frontend
+                                           // together with its own main loop counters.
+                                           // The interface can be obtained at any time, and stays valid until retro_deinit().
+                                           //
+#define RETRO_ENVIRONMENT_GET_VIDEO_SKIP 12
+                                           // bool * --
+                                           // Returns true if the frame about to be run inside retro_run() will not be presented,
+                                           // e.g. while fast-forwarding. Only valid during retro_run().
+                                           // If GET_CAN_DUPE returns true, the implementation may skip rendering the frame
+                                           // and pass NULL to video_refresh as with a dupe.
+                                           // Audio of a skipped frame may be dropped by the frontend.
 
 enum retro_pixel_format
 {
@@ -364,6 +379,52 @@ enum retro_pixel_format
    RETRO_PIXEL_FORMAT_XRGB8888      // XRGB8888, native endian. X bits are ignored.
 };
 
+// CPU features reported by retro_perf_callback::get_cpu_features.
+#define RETRO_SIMD_SSE    (1 << 0)
+#define RETRO_SIMD_SSE2   (1 << 1)
+#define RETRO_SIMD_VMX    (1 << 2)
+#define RETRO_SIMD_VMX128 (1 << 3)
+#define RETRO_SIMD_AVX    (1 << 4)
+#define RETRO_SIMD_NEON   (1 << 5)
+#define RETRO_SIMD_SSE3   (1 << 6)
+#define RETRO_SIMD_SSSE3  (1 << 7)
+#define RETRO_SIMD_SSE4   (1 << 8)
+#define RETRO_SIMD_SSE42  (1 << 9)
+#define RETRO_SIMD_AVX2   (1 << 10)
+
+typedef int64_t retro_time_t;
+
+// Should be statically allocated, zero-initialized except for ident, and registered once.
+struct retro_perf_counter
+{
+   const char *ident;      // Name of counter in reports.
+   retro_time_t start;     // Maintained by the frontend.
+   retro_time_t total;     // Accumulated time in microseconds, maintained by the frontend.
+   uint64_t call_cnt;      // Number of start/stop pairs, maintained by the frontend.
+   bool registered;        // Set by the frontend when registered.
+   void *frontend_data;    // Private to the frontend.
+};
+
+typedef retro_time_t (*retro_perf_get_time_usec_t)(void); // Monotonic time in microseconds.
+typedef uint64_t (*retro_get_cpu_features_t)(void);       // Bitmask of RETRO_SIMD_*.
+typedef void (*retro_perf_register_t)(struct retro_perf_counter *counter);
+typedef void (*retro_perf_start_t)(struct retro_perf_counter *counter);
+typedef void (*retro_perf_stop_t)(struct retro_perf_counter *counter);
+typedef void (*retro_perf_log_t)(void);                   // Asks the frontend to log all counters.
+
+// Counters only accumulate time while the user has enabled profiling in the frontend,
+// so start/stop can be left in place in release builds.
+struct retro_perf_callback
+{
+   retro_perf_get_time_usec_t get_time_usec;
+   retro_get_cpu_features_t   get_cpu_features;
+
+   retro_perf_register_t      perf_register;
+   retro_perf_start_t         perf_start;
+   retro_perf_stop_t          perf_stop;
+   retro_perf_log_t           perf_log;
+};
+
 struct retro_message
 {
    const char *msg;        // Message to be displayed.
@@ -32,6 +32,10 @@ struct msg_queue
    size_t ptr;
    size_t size;
    char *tmp_msg;
+
+   // Last pulled message text and its ID.
+   char *id_msg;
+   unsigned id;
 };
 
 msg_queue_t *msg_queue_new(size_t size)
@@ -55,6 +59,7 @@ msg_queue_t *msg_queue_new(size_t size)
 void msg_queue_free(msg_queue_t *queue)
 {
    msg_queue_clear(queue);
+   free(queue->id_msg);
    free(queue->elems);
    free(queue);
 }
@@ -155,3 +160,24 @@ const char *msg_queue_pull(msg_queue_t *queue)
       return queue->tmp_msg;
    }
 }
+
+const char *msg_queue_pull_id(msg_queue_t *queue, unsigned *id)
+{
+   const char *msg = msg_queue_pull(queue);
+   if (!msg)
+   {
+      *id = 0;
+      return NULL;
+   }
+
+   if (!queue->id_msg || strcmp(queue->id_msg, msg) != 0)
+   {
+      free(queue->id_msg);
+      queue->id_msg = strdup(msg);
+      if (++queue->id == 0)
+         queue->id = 1;
+   }
+
+   *id = queue->id;
+   return msg;
+}
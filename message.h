@@ -30,6 +30,11 @@ void msg_queue_push(msg_queue_t *queue, const char *msg, unsigned prio, unsigned
 // Pulls highest prio message in queue. Returns NULL if no message in queue.
 const char *msg_queue_pull(msg_queue_t *queue);
 
+// Same as msg_queue_pull(), but also returns an ID for the message text.
+// The ID only changes when the text changes, even across pushes, so it can be used to cache rendered messages.
+// ID is 0 if no message is returned.
+const char *msg_queue_pull_id(msg_queue_t *queue, unsigned *id);
+
 // Clear out everything in queue.
 void msg_queue_clear(msg_queue_t *queue);
 
@@ -19,8 +19,25 @@
 #include "autosave.h"
 #include "dynamic.h"
 #include "message.h"
+#include "performance.h"
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#if defined(__linux__) && !defined(HAVE_SOCKET_LEGACY)
+#define HAVE_NETPLAY_EPOLL
+#include <sys/epoll.h>
+#endif
+
+// Spectators are served from their own thread where we can wake it up with a pipe.
+#if defined(HAVE_THREADS) && !defined(_WIN32) && !defined(HAVE_SOCKET_LEGACY)
+#define HAVE_SPECTATE_THREAD
+#include "thread.h"
+#ifdef HAVE_NETPLAY_EPOLL
+#define HAVE_SPECTATE_EPOLL
+#endif
+#endif
 
 // Checks if input port/index is controlled by netplay or not.
 static bool netplay_is_alive(netplay_t *handle);
@@ -34,14 +51,17 @@ static bool netplay_can_poll(netplay_t *handle);
 static void netplay_set_spectate_input(netplay_t *handle, int16_t input);
 
 static bool netplay_send_cmd(netplay_t *handle, uint32_t cmd, const void *data, size_t size);
-static bool netplay_get_cmd(netplay_t *handle);
+static bool netplay_get_cmds(netplay_t *handle);
 
 #define PREV_PTR(x) ((x) == 0 ? handle->buffer_size - 1 : (x) - 1)
 #define NEXT_PTR(x) ((x + 1) % handle->buffer_size)
 
 struct delta_frame
 {
-   void *state;
+   bool has_state; // Frame is a rollback checkpoint.
+   void *state; // Full state. Not used with delta states.
+   size_t delta_pos; // Delta against the previous frame, in delta_buf.
+   size_t delta_len;
 
    uint16_t real_input_state;
    uint16_t simulated_input_state;
@@ -50,13 +70,75 @@ struct delta_frame
    bool used_real;
 };
 
+// Part of the implementation magic value. Bump whenever packets or commands change,
+// so builds which cannot talk to each other fail the handshake.
+#define NETPLAY_PROTOCOL_VERSION 1
+
 #define UDP_FRAME_PACKETS 16
-#define MAX_SPECTATORS 16
+// Every UDP packet starts with our send time and the other side's last send time,
+// advanced by how long we held on to it. The difference on arrival is the round-trip time.
+#define UDP_PACKET_HEADER 2
+#define UDP_PACKET_WORDS (UDP_PACKET_HEADER + UDP_FRAME_PACKETS * 2)
+
+// Input for frames we cannot accept yet is kept until we get there.
+#define NETPLAY_EARLY_FRAMES (2 * UDP_FRAME_PACKETS)
+
+#define NETPLAY_MAX_INPUT_DELAY 8
+// Frames the measured target must differ before the input delay follows it.
+#define NETPLAY_DELAY_RAISE_FRAMES 30
+#define NETPLAY_DELAY_LOWER_FRAMES 180
+
+// Hold durations of the other side's buttons, in frames. The last bucket is "this long or longer".
+#define NETPLAY_HOLD_BUCKETS 32
+#define NETPLAY_HOLD_MIN_SAMPLES 8
+#define NETPLAY_HOLD_MAX_SAMPLES 256
 
 #define NETPLAY_CMD_ACK 0
 #define NETPLAY_CMD_NAK 1
 #define NETPLAY_CMD_FLIP_PLAYERS 2
 
+// Largest command (header + payload) that fits in the command buffers.
+#define NETPLAY_CMD_BUFFER_SIZE 256
+
+// Spectators which do not send their nickname in time are dropped.
+#define SPECTATE_HANDSHAKE_USEC 5000000
+#define SPECTATE_POLL_MS 100
+
+// Host nickname followed by BSV header and save state.
+// Shared by every spectator which joins on the same frame.
+struct spectate_header
+{
+   unsigned refs;
+   size_t size;
+   uint8_t *data; // Allocated along with the struct.
+};
+
+enum spectator_state
+{
+   SPECTATOR_FREE = 0,
+   SPECTATOR_NICK, // Waiting for nickname.
+   SPECTATOR_JOINING, // Waiting for a keyframe.
+   SPECTATOR_STREAMING,
+   SPECTATOR_DEAD // Closed, waiting for the main thread to announce it.
+};
+
+struct spectator
+{
+   int fd;
+   enum spectator_state state;
+   struct sockaddr_storage addr;
+   rarch_time_t connect_time;
+   uint8_t nick_buf[32]; // Size byte followed by nick.
+   size_t nick_pos;
+   char nick[32];
+
+   struct spectate_header *header;
+   size_t header_pos;
+   uint64_t pos; // Next byte of input history to send.
+   bool announced; // Main thread has logged the connection.
+   bool lagged;
+};
+
 struct netplay
 {
    char nick[32];
@@ -78,11 +160,34 @@ struct netplay
    size_t tmp_ptr; // A temporary pointer used on replay.
 
    size_t state_size;
+   void *state_arena; // Backing storage of every buffer[i].state.
+
+   // States are only saved for some frames (checkpoints). Rollback restores the newest
+   // checkpoint at or before other_ptr (base) and replays from there.
+   size_t base_ptr;
+   uint32_t base_frame;
+   uint32_t head_frame; // Newest checkpoint.
+   unsigned checkpoint_interval;
+   float serialize_cost; // Microseconds, averaged.
+   float run_cost; // Microseconds per replayed frame, averaged.
+   float rollback_rate; // Rollbacks per frame, averaged.
+
+   // With delta states, only the base and head checkpoints are kept in full.
+   // Every checkpoint in between is a delta against the one before it.
+   bool delta_states;
+   size_t state_words;
+   uint32_t *base_state;
+   uint32_t *head_state;
+   uint32_t *scratch_state;
+   uint64_t *delta_buf;
+   size_t delta_cap;
+   size_t delta_start; // Deltas before this belong to frames which are already in base_state.
+   size_t delta_end;
 
    bool is_replay; // Are we replaying old frames?
    bool can_poll; // We don't want to poll several times on a frame.
 
-   uint32_t packet_buffer[UDP_FRAME_PACKETS * 2]; // To compat UDP packet loss we also send old data along with the packets.
+   uint32_t packet_buffer[UDP_PACKET_WORDS]; // To compat UDP packet loss we also send old data along with the packets.
    uint32_t frame_count;
    uint32_t read_frame_count;
    uint32_t other_frame_count;
@@ -91,16 +196,83 @@ struct netplay
    struct sockaddr_storage their_addr;
    bool has_client_addr;
 
-   unsigned timeout_cnt;
+   // Set while the rollback window is full and we are waiting for the other side.
+   rarch_time_t stall_start;
+   rarch_time_t stall_resend;
+
+   struct
+   {
+      uint32_t frame;
+      uint16_t state;
+   } early_input[NETPLAY_EARLY_FRAMES];
+
+   // Our input is sampled input_delay frames before it is used, so it reaches the other side in time.
+   // self_frame is the next frame we have not sampled input for yet.
+   unsigned input_delay;
+   unsigned input_delay_min;
+   unsigned input_delay_max;
+   int delay_votes; // Frames the target delay has been above (positive) or below (negative) input_delay.
+   uint32_t self_frame;
+   uint32_t self_delay_states[NETPLAY_MAX_INPUT_DELAY + 1];
+
+   // Round-trip time in microseconds, smoothed as TCP does.
+   uint32_t remote_time; // Other side's last send time.
+   rarch_time_t remote_time_received;
+   bool has_remote_time;
+   float rtt;
+   float rtt_var;
+   bool has_rtt;
+
+   // Per-button hold durations of the other side, used for prediction.
+   uint16_t last_real_state;
+   uint32_t hold_start[RARCH_FIRST_ANALOG_BIND];
+   uint16_t hold_hist[RARCH_FIRST_ANALOG_BIND][NETPLAY_HOLD_BUCKETS];
+   unsigned hold_samples[RARCH_FIRST_ANALOG_BIND];
+
+   // Command connection is nonblocking once the handshake is done.
+   // Partial commands are buffered until complete.
+   uint8_t cmd_recv_buf[NETPLAY_CMD_BUFFER_SIZE];
+   size_t cmd_recv_size;
+   uint8_t cmd_send_buf[NETPLAY_CMD_BUFFER_SIZE];
+   size_t cmd_send_size;
+
+#ifdef HAVE_NETPLAY_EPOLL
+   int epoll_fd;
+   bool epoll_out; // TCP socket is also watched for writability.
+#endif
 
    // Spectating.
    bool spectate;
    bool spectate_client;
-   int spectate_fds[MAX_SPECTATORS];
    uint16_t *spectate_input;
    size_t spectate_input_ptr;
    size_t spectate_input_size;
 
+   // Spectator server, run by the host and by relays. Every frame of input is appended
+   // once to a shared history ring, and each spectator streams it from its own position
+   // with nonblocking writes. New spectators start from the latest keyframe and catch up
+   // on the input recorded since.
+   int listen_fd;
+   struct spectator *spectators;
+   unsigned max_spectators;
+   uint8_t *history;
+   size_t history_cap;
+   uint64_t history_head; // Total bytes ever appended.
+   uint64_t history_tail; // Oldest byte still kept.
+   uint64_t *history_frames; // End of each of the last history_lag + 1 frames.
+   uint64_t history_frame_count;
+   unsigned history_lag; // Spectators further behind than this many frames are dropped.
+   struct spectate_header *keyframe;
+   uint64_t keyframe_pos; // History position the keyframe state corresponds to.
+   uint64_t keyframe_frame;
+   bool spectator_joining; // Some spectator is waiting for a fresh keyframe.
+#ifdef HAVE_SPECTATE_THREAD
+   sthread_t *spectate_thread;
+   slock_t *spectate_lock;
+   int spectate_wake[2];
+   bool spectate_quit;
+#endif
+
    // Player flipping
    // Flipping state. If ptr >= flip_frame, we apply the flip.
    // If not, we apply the opposite, effectively creating a trigger point.
@@ -108,6 +280,10 @@ struct netplay
    // before allowing another flip.
    bool flip;
    uint32_t flip_frame;
+   bool flip_pending; // Waiting for other side to acknowledge a flip.
+   uint32_t flip_pending_frame;
+   rarch_time_t flip_wait_start; // When we started holding flip_pending_frame back for the acknowledgement.
+   bool flip_replay; // Flip arrived after flip_frame ran. Frames from flip_frame on are replayed.
 };
 
 static bool send_all(int fd, const void *data_, size_t size)
@@ -142,6 +318,29 @@ static bool recv_all(int fd, void *data_, size_t size)
    return true;
 }
 
+static bool socket_nonblock(int fd)
+{
+#if defined(_WIN32)
+   u_long mode = 1;
+   return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#elif defined(__CELLOS_LV2__)
+   int i = 1;
+   return setsockopt(fd, SOL_SOCKET, SO_NBIO, &i, sizeof(int)) == 0;
+#else
+   return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0;
+#endif
+}
+
+// Last socket call failed only because it would have blocked.
+static bool socket_would_block(void)
+{
+#if defined(_WIN32)
+   return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+   return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
 static void warn_hangup(void)
 {
    RARCH_WARN("Netplay has disconnected. Will continue without connection ...\n");
@@ -258,7 +457,7 @@ static int init_tcp_connection(const struct addrinfo *res, bool server, bool spe
       setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, CONST_CAST &yes, sizeof(int));
 
       if (bind(fd, res->ai_addr, res->ai_addrlen) < 0 ||
-            listen(fd, MAX_SPECTATORS) < 0)
+            listen(fd, g_settings.netplay_max_spectators) < 0)
       {
          ret = false;
          goto end;
@@ -297,7 +496,8 @@ end:
    return fd;
 }
 
-static bool init_tcp_socket(netplay_t *handle, const char *server, uint16_t port, bool spectate)
+// Connects to server, or listens on port if server is NULL. Returns the socket or -1.
+static int init_tcp_socket(netplay_t *handle, const char *server, uint16_t port, bool spectate)
 {
    struct addrinfo hints, *res = NULL;
    memset(&hints, 0, sizeof(hints));
@@ -312,27 +512,22 @@ static bool init_tcp_socket(netplay_t *handle, const char *server, uint16_t port
    if (!server)
       hints.ai_flags = AI_PASSIVE;
 
-   bool ret = false;
+   int fd = -1;
    char port_buf[16];
    snprintf(port_buf, sizeof(port_buf), "%hu", (unsigned short)port);
    if (getaddrinfo(server, port_buf, &hints, &res) < 0)
-      return false;
+      return -1;
 
    if (!res)
-      return false;
+      return -1;
 
    // If "localhost" is used, it is important to check every possible address for ipv4/ipv6.
    const struct addrinfo *tmp_info = res;
    while (tmp_info)
    {
-      int fd;
-      if ((fd = init_tcp_connection(tmp_info, server, handle->spectate,
+      if ((fd = init_tcp_connection(tmp_info, server, spectate,
                (struct sockaddr*)&handle->other_addr, sizeof(handle->other_addr))) >= 0)
-      {
-         ret = true;
-         handle->fd = fd;
          break;
-      }
 
       tmp_info = tmp_info->ai_next;
    }
@@ -340,10 +535,10 @@ static bool init_tcp_socket(netplay_t *handle, const char *server, uint16_t port
    if (res)
       freeaddrinfo(res);
 
-   if (!ret)
+   if (fd < 0)
       RARCH_ERR("Failed to set up netplay sockets.\n");
 
-   return ret;
+   return fd;
 }
 
 static bool init_udp_socket(netplay_t *handle, const char *server, uint16_t port)
@@ -424,7 +619,7 @@ static bool init_socket(netplay_t *handle, const char *server, uint16_t port)
    if (!netplay_init_network())
       return false;
 
-   if (!init_tcp_socket(handle, server, port, handle->spectate))
+   if ((handle->fd = init_tcp_socket(handle, server, port, handle->spectate)) < 0)
       return false;
    if (!handle->spectate && !init_udp_socket(handle, server, port))
       return false;
@@ -462,6 +657,8 @@ static uint32_t implementation_magic_value(void)
    for (size_t i = 0; i < len; i++)
       res ^= ver[i] << ((i & 0xf) + 16);
 
+   res ^= NETPLAY_PROTOCOL_VERSION << 24;
+
    return res;
 }
 
@@ -568,7 +765,8 @@ static bool get_info(netplay_t *handle)
 
    if (implementation_magic_value() != ntohl(header[1]))
    {
-      RARCH_ERR("Implementations differ, make sure you're using exact same libretro implementations and RetroArch version.\n");
+      RARCH_ERR("Implementations differ, make sure you're using exact same libretro implementations and RetroArch version (netplay protocol %u).\n",
+            NETPLAY_PROTOCOL_VERSION);
       return false;
    }
 
@@ -722,302 +920,1253 @@ static bool get_info_spectate(netplay_t *handle)
    return ret;
 }
 
-static void init_buffers(netplay_t *handle)
+static void spectate_lock(netplay_t *handle)
 {
-   handle->buffer = (struct delta_frame*)calloc(handle->buffer_size, sizeof(*handle->buffer));
-   handle->state_size = pretro_serialize_size();
-   for (unsigned i = 0; i < handle->buffer_size; i++)
-   {
-      handle->buffer[i].state = malloc(handle->state_size);
-      handle->buffer[i].is_simulated = true;
-   }
+#ifdef HAVE_SPECTATE_THREAD
+   slock_lock(handle->spectate_lock);
+#else
+   (void)handle;
+#endif
 }
 
-netplay_t *netplay_new(const char *server, uint16_t port,
-      unsigned frames, const struct retro_callbacks *cb,
-      bool spectate,
-      const char *nick)
+static void spectate_unlock(netplay_t *handle)
 {
-   if (frames > UDP_FRAME_PACKETS)
-      frames = UDP_FRAME_PACKETS;
+#ifdef HAVE_SPECTATE_THREAD
+   slock_unlock(handle->spectate_lock);
+#else
+   (void)handle;
+#endif
+}
 
-   netplay_t *handle = (netplay_t*)calloc(1, sizeof(*handle));
-   if (!handle)
+static void spectate_wake(netplay_t *handle)
+{
+#ifdef HAVE_SPECTATE_THREAD
+   char c = 0;
+   ssize_t ret = write(handle->spectate_wake[1], &c, 1);
+   (void)ret; // A full pipe is already a pending wakeup.
+#else
+   (void)handle;
+#endif
+}
+
+static struct spectate_header *spectate_header_new(netplay_t *handle)
+{
+   size_t bsv_size;
+   uint32_t *bsv = bsv_header_generate(&bsv_size, implementation_magic_value());
+   if (!bsv)
       return NULL;
 
-   handle->fd = -1;
-   handle->udp_fd = -1;
-   handle->cbs = *cb;
-   handle->port = server ? 0 : 1;
-   handle->spectate = spectate;
-   handle->spectate_client = server != NULL;
-   strlcpy(handle->nick, nick, sizeof(handle->nick));
+   uint8_t nick_size = strlen(handle->nick);
+   size_t size = sizeof(nick_size) + nick_size + bsv_size;
 
-   if (!init_socket(handle, server, port))
+   struct spectate_header *header = (struct spectate_header*)malloc(sizeof(*header) + size);
+   if (header)
    {
-      free(handle);
-      return NULL;
+      header->refs = 0;
+      header->size = size;
+      header->data = (uint8_t*)(header + 1);
+      header->data[0] = nick_size;
+      memcpy(header->data + 1, handle->nick, nick_size);
+      memcpy(header->data + 1 + nick_size, bsv, bsv_size);
    }
 
-   if (spectate)
-   {
-      if (server)
-      {
-         if (!get_info_spectate(handle))
-            goto error;
-      }
+   free(bsv);
+   return header;
+}
 
-      for (unsigned i = 0; i < MAX_SPECTATORS; i++)
-         handle->spectate_fds[i] = -1;
-   }
-   else
+static void spectate_header_unref(struct spectate_header *header)
+{
+   if (header && --header->refs == 0)
+      free(header);
+}
+
+// Closes the connection. The slot is freed once the main thread has announced it.
+// Must hold the spectate lock.
+static void spectator_drop(struct spectator *spec, bool lagged)
+{
+   close(spec->fd);
+   spec->fd = -1;
+   spectate_header_unref(spec->header);
+   spec->header = NULL;
+   spec->lagged = lagged;
+   spec->state = SPECTATOR_DEAD;
+}
+
+static void ring_write(uint8_t *ring, size_t cap, uint64_t pos, const uint8_t *data, size_t size)
+{
+   size_t offset = pos % cap;
+   size_t first = size < cap - offset ? size : cap - offset;
+   memcpy(ring + offset, data, first);
+   memcpy(ring, data + first, size - first);
+}
+
+// Appends one frame of input to the history, and drops spectators which fell
+// more than history_lag frames behind.
+static bool spectate_history_append(netplay_t *handle, const void *data, size_t size)
+{
+   unsigned slots = handle->history_lag + 1;
+   uint64_t frame = handle->history_frame_count;
+   uint64_t tail = handle->history_tail;
+   if (frame >= handle->history_lag && handle->history_frames[(frame - handle->history_lag) % slots] > tail)
+      tail = handle->history_frames[(frame - handle->history_lag) % slots];
+
+   size_t used = handle->history_head - tail;
+   if (used + size > handle->history_cap)
    {
-      if (server)
-      {
-         if (!send_info(handle))
-            goto error;
-      }
-      else
+      size_t cap = handle->history_cap ? handle->history_cap * 2 : 4096;
+      while (cap < used + size)
+         cap *= 2;
+
+      uint8_t *history = (uint8_t*)malloc(cap);
+      if (!history)
+         return false;
+
+      if (used)
       {
-         if (!get_info(handle))
-            goto error;
+         size_t offset = tail % handle->history_cap;
+         size_t first = used < handle->history_cap - offset ? used : handle->history_cap - offset;
+         ring_write(history, cap, tail, handle->history + offset, first);
+         ring_write(history, cap, tail + first, handle->history, used - first);
       }
 
-      handle->buffer_size = frames + 1;
-
-      init_buffers(handle);
-      handle->has_connection = true;
+      free(handle->history);
+      handle->history = history;
+      handle->history_cap = cap;
    }
 
-   return handle;
-
-error:
-   if (handle->fd >= 0)
-      close(handle->fd);
-   if (handle->udp_fd >= 0)
-      close(handle->udp_fd);
-
-   free(handle);
-   return NULL;
-}
+   ring_write(handle->history, handle->history_cap, handle->history_head, (const uint8_t*)data, size);
+   handle->history_head += size;
+   handle->history_frames[frame % slots] = handle->history_head;
+   handle->history_frame_count++;
+   handle->history_tail = tail;
 
+   for (unsigned i = 0; i < handle->max_spectators; i++)
+   {
+      struct spectator *spec = &handle->spectators[i];
+      if (spec->state == SPECTATOR_STREAMING && spec->pos < tail)
+         spectator_drop(spec, true);
+   }
 
-static bool netplay_is_alive(netplay_t *handle)
-{
-   return handle->has_connection;
+   return true;
 }
 
-static bool send_chunk(netplay_t *handle)
+static bool spectator_read_nick(struct spectator *spec)
 {
-   const struct sockaddr *addr = NULL;
-   if (handle->addr)
-      addr = handle->addr->ai_addr;
-   else if (handle->has_client_addr)
-      addr = (const struct sockaddr*)&handle->their_addr;
-
-   if (addr)
+   size_t want = spec->nick_pos ? 1 + spec->nick_buf[0] : 1;
+   while (spec->nick_pos < want)
    {
-      if (sendto(handle->udp_fd, CONST_CAST handle->packet_buffer,
-               sizeof(handle->packet_buffer), 0, addr,
-               sizeof(struct sockaddr)) != sizeof(handle->packet_buffer))
+      ssize_t ret = recv(spec->fd, NONCONST_CAST spec->nick_buf + spec->nick_pos,
+            want - spec->nick_pos, 0);
+      if (ret <= 0)
+         return ret < 0 && socket_would_block();
+
+      spec->nick_pos += ret;
+      if (spec->nick_pos == 1)
       {
-         warn_hangup();
-         handle->has_connection = false;
-         return false;
+         if (spec->nick_buf[0] >= sizeof(spec->nick_buf))
+         {
+            RARCH_ERR("Invalid nick size from spectator.\n");
+            return false;
+         }
+         want = 1 + spec->nick_buf[0];
       }
    }
+
+   memcpy(spec->nick, spec->nick_buf + 1, spec->nick_buf[0]);
+   spec->nick[spec->nick_buf[0]] = '\0';
+   spec->state = SPECTATOR_JOINING;
    return true;
 }
 
-#define MAX_RETRIES 16
-#define RETRY_MS 500
-
-static int poll_input(netplay_t *handle, bool block)
+static bool spectator_send(netplay_t *handle, struct spectator *spec)
 {
-   int max_fd = (handle->fd > handle->udp_fd ? handle->fd : handle->udp_fd) + 1;
+   while (spec->header)
+   {
+      ssize_t ret = send(spec->fd, CONST_CAST spec->header->data + spec->header_pos,
+            spec->header->size - spec->header_pos, 0);
+      if (ret <= 0)
+         return ret < 0 && socket_would_block();
 
-   struct timeval tv = {0};
-   tv.tv_sec = 0;
-   tv.tv_usec = block ? (RETRY_MS * 1000) : 0;
+      spec->header_pos += ret;
+      if (spec->header_pos == spec->header->size)
+      {
+         spectate_header_unref(spec->header);
+         spec->header = NULL;
+      }
+   }
 
-   do
-   { 
-      handle->timeout_cnt++;
+   while (spec->pos < handle->history_head)
+   {
+      size_t offset = spec->pos % handle->history_cap;
+      size_t size = handle->history_head - spec->pos;
+      if (size > handle->history_cap - offset)
+         size = handle->history_cap - offset;
+
+      ssize_t ret = send(spec->fd, CONST_CAST handle->history + offset, size, 0);
+      if (ret <= 0)
+         return ret < 0 && socket_would_block();
 
-      // select() does not take pointer to const struct timeval.
-      // Technically possible for select() to modify tmp_tv, so we go paranoia mode.
-      struct timeval tmp_tv = tv;
+      spec->pos += ret;
+   }
 
-      fd_set fds;
-      FD_ZERO(&fds);
-      FD_SET(handle->udp_fd, &fds);
-      FD_SET(handle->fd, &fds);
+   return true;
+}
 
-      if (select(max_fd, &fds, NULL, NULL, &tmp_tv) < 0)
-         return -1;
+static void spectate_accept(netplay_t *handle)
+{
+   for (;;)
+   {
+      struct sockaddr_storage their_addr;
+      socklen_t addr_size = sizeof(their_addr);
+      int new_fd = accept(handle->listen_fd, (struct sockaddr*)&their_addr, &addr_size);
+      if (new_fd < 0)
+      {
+         if (!socket_would_block())
+            RARCH_ERR("Failed to accept incoming spectator.\n");
+         return;
+      }
 
-      // Somewhat hacky,
-      // but we aren't using the TCP connection for anything useful atm.
-      if (FD_ISSET(handle->fd, &fds) && !netplay_get_cmd(handle))
-         return -1; 
+      struct spectator *spec = NULL;
+      for (unsigned i = 0; i < handle->max_spectators; i++)
+      {
+         if (handle->spectators[i].state == SPECTATOR_FREE)
+         {
+            spec = &handle->spectators[i];
+            break;
+         }
+      }
 
-      if (FD_ISSET(handle->udp_fd, &fds))
-         return 1;
+      if (!spec)
+      {
+         RARCH_WARN("Spectator limit (%u) reached, refusing connection.\n", handle->max_spectators);
+         close(new_fd);
+         continue;
+      }
 
-      if (block && !send_chunk(handle))
+#if defined(HAVE_SPECTATE_THREAD) && !defined(HAVE_SPECTATE_EPOLL)
+      if (new_fd >= FD_SETSIZE)
       {
-         warn_hangup();
-         handle->has_connection = false;
-         return -1;
+         RARCH_WARN("Too many open files, refusing spectator.\n");
+         close(new_fd);
+         continue;
       }
+#endif
 
-      if (block)
+      if (!socket_nonblock(new_fd))
       {
-         RARCH_LOG("Network is stalling, resending packet... Count %u of %d ...\n",
-               handle->timeout_cnt, MAX_RETRIES);
+         close(new_fd);
+         continue;
       }
-   } while ((handle->timeout_cnt < MAX_RETRIES) && block);
 
-   if (block)
-      return -1;
-   return 0;
+#ifdef HAVE_SPECTATE_EPOLL
+      // Edge triggered. Every wakeup services all spectators anyways.
+      struct epoll_event event = {0};
+      event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+      event.data.fd = new_fd;
+      if (epoll_ctl(handle->epoll_fd, EPOLL_CTL_ADD, new_fd, &event) < 0)
+      {
+         close(new_fd);
+         continue;
+      }
+#endif
+
+      memset(spec, 0, sizeof(*spec));
+      spec->fd = new_fd;
+      spec->addr = their_addr;
+      spec->connect_time = rarch_get_time_usec();
+      spec->state = SPECTATOR_NICK;
+   }
 }
 
-// Grab our own input state and send this over the network.
-static bool get_self_input_state(netplay_t *handle)
+// Keyframes are recent enough that new spectators have plenty of room before they count as lagging behind.
+// Must hold the spectate lock.
+static bool spectate_keyframe_stale(netplay_t *handle)
 {
-   struct delta_frame *ptr = &handle->buffer[handle->self_ptr];
+   unsigned interval = (handle->history_lag + 3) / 4;
+   return !handle->keyframe || handle->keyframe_pos < handle->history_tail ||
+      handle->history_frame_count - handle->keyframe_frame >= interval;
+}
 
-   uint32_t state = 0;
-   if (handle->frame_count > 0) // First frame we always give zero input since relying on input from first frame screws up when we use -F 0.
+// Accepts new spectators and moves every stream along as far as it goes without blocking.
+// Must hold the spectate lock.
+static void spectate_server_pump(netplay_t *handle)
+{
+   spectate_accept(handle);
+   handle->spectator_joining = false;
+
+   rarch_time_t now = rarch_get_time_usec();
+   for (unsigned i = 0; i < handle->max_spectators; i++)
    {
-      retro_input_state_t cb = handle->cbs.state_cb;
-      for (unsigned i = 0; i < RARCH_FIRST_META_KEY; i++)
+      struct spectator *spec = &handle->spectators[i];
+      switch (spec->state)
       {
-         int16_t tmp = cb(g_settings.input.netplay_client_swap_input ? 0 : !handle->port,
-               RETRO_DEVICE_JOYPAD, 0, i);
-         state |= tmp ? 1 << i : 0;
+         case SPECTATOR_NICK:
+            if (!spectator_read_nick(spec))
+               spectator_drop(spec, false);
+            else if (spec->state == SPECTATOR_NICK && now - spec->connect_time > SPECTATE_HANDSHAKE_USEC)
+            {
+               RARCH_WARN("Spectator did not send a nickname in time.\n");
+               spectator_drop(spec, false);
+            }
+            if (spec->state != SPECTATOR_JOINING)
+               break;
+            // Fall-through
+
+         case SPECTATOR_JOINING:
+            if (spectate_keyframe_stale(handle))
+            {
+               handle->spectator_joining = true;
+               break;
+            }
+
+            handle->keyframe->refs++;
+            spec->header = handle->keyframe;
+            spec->header_pos = 0;
+            spec->pos = handle->keyframe_pos;
+            spec->state = SPECTATOR_STREAMING;
+            // Fall-through
+
+         case SPECTATOR_STREAMING:
+            if (!spectator_send(handle, spec))
+               spectator_drop(spec, false);
+            break;
+
+         default:
+            break;
       }
    }
+}
 
-   memmove(handle->packet_buffer, handle->packet_buffer + 2,
-         sizeof (handle->packet_buffer) - 2 * sizeof(uint32_t));
-   handle->packet_buffer[(UDP_FRAME_PACKETS - 1) * 2] = htonl(handle->frame_count); 
-   handle->packet_buffer[(UDP_FRAME_PACKETS - 1) * 2 + 1] = htonl(state);
+#ifdef HAVE_SPECTATE_THREAD
+static void spectate_wait(netplay_t *handle, unsigned timeout_ms)
+{
+#ifdef HAVE_SPECTATE_EPOLL
+   struct epoll_event events[16];
+   epoll_wait(handle->epoll_fd, events, sizeof(events) / sizeof(events[0]), timeout_ms);
+#else
+   fd_set read_fds, write_fds;
+   FD_ZERO(&read_fds);
+   FD_ZERO(&write_fds);
+   FD_SET(handle->listen_fd, &read_fds);
+   FD_SET(handle->spectate_wake[0], &read_fds);
+   int max_fd = handle->listen_fd > handle->spectate_wake[0] ? handle->listen_fd : handle->spectate_wake[0];
+
+   slock_lock(handle->spectate_lock);
+   for (unsigned i = 0; i < handle->max_spectators; i++)
+   {
+      const struct spectator *spec = &handle->spectators[i];
+      if (spec->state == SPECTATOR_NICK)
+         FD_SET(spec->fd, &read_fds);
+      else if (spec->state == SPECTATOR_STREAMING && (spec->header || spec->pos < handle->history_head))
+         FD_SET(spec->fd, &write_fds);
+      else
+         continue;
 
-   if (!send_chunk(handle))
-   {
-      warn_hangup();
-      handle->has_connection = false;
-      return false;
+      if (spec->fd > max_fd)
+         max_fd = spec->fd;
    }
+   slock_unlock(handle->spectate_lock);
 
-   ptr->self_state = state;
-   handle->self_ptr = NEXT_PTR(handle->self_ptr);
-   return true;
-}
-
-// TODO: Somewhat better prediction. :P
-static void simulate_input(netplay_t *handle)
-{
-   size_t ptr = PREV_PTR(handle->self_ptr);
-   size_t prev = PREV_PTR(handle->read_ptr);
+   struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+   select(max_fd + 1, &read_fds, &write_fds, NULL, &tv);
+#endif
 
-   handle->buffer[ptr].simulated_input_state = handle->buffer[prev].real_input_state;
-   handle->buffer[ptr].is_simulated = true;
-   handle->buffer[ptr].used_real = false;
+   char buf[64];
+   while (read(handle->spectate_wake[0], buf, sizeof(buf)) > 0);
 }
 
-static void parse_packet(netplay_t *handle, uint32_t *buffer, unsigned size)
+static void spectate_thread(void *data)
 {
-   for (unsigned i = 0; i < size * 2; i++)
-      buffer[i] = ntohl(buffer[i]);
+   netplay_t *handle = (netplay_t*)data;
 
-   for (unsigned i = 0; i < size && handle->read_frame_count <= handle->frame_count; i++)
+   for (;;)
    {
-      uint32_t frame = buffer[2 * i + 0];
-      uint32_t state = buffer[2 * i + 1];
+      slock_lock(handle->spectate_lock);
+      bool quit = handle->spectate_quit;
+      if (!quit)
+         spectate_server_pump(handle);
+      slock_unlock(handle->spectate_lock);
 
-      if (frame == handle->read_frame_count)
-      {
-         handle->buffer[handle->read_ptr].is_simulated = false;
-         handle->buffer[handle->read_ptr].real_input_state = state;
-         handle->read_ptr = NEXT_PTR(handle->read_ptr);
-         handle->read_frame_count++;
-         handle->timeout_cnt = 0;
-      }
+      if (quit)
+         break;
+
+      spectate_wait(handle, SPECTATE_POLL_MS);
    }
 }
+#endif
 
-static bool receive_data(netplay_t *handle, uint32_t *buffer, size_t size)
+static bool init_spectate_server(netplay_t *handle)
 {
-   socklen_t addrlen = sizeof(handle->their_addr);
-   if (recvfrom(handle->udp_fd, NONCONST_CAST buffer, size, 0, (struct sockaddr*)&handle->their_addr, &addrlen) != (ssize_t)size)
-      return false;
-   handle->has_client_addr = true;
-   return true;
-}
+   handle->max_spectators = g_settings.netplay_max_spectators ? g_settings.netplay_max_spectators : 1;
+   handle->history_lag = g_settings.netplay_spectator_lag ? g_settings.netplay_spectator_lag : 1;
 
-// Poll network to see if we have anything new. If our network buffer is full, we simply have to block for new input data.
-static bool netplay_poll(netplay_t *handle)
-{
-   if (!handle->has_connection)
+   handle->spectators = (struct spectator*)calloc(handle->max_spectators, sizeof(*handle->spectators));
+   handle->history_frames = (uint64_t*)calloc(handle->history_lag + 1, sizeof(uint64_t));
+   if (!handle->spectators || !handle->history_frames)
       return false;
 
-   handle->can_poll = false;
+   for (unsigned i = 0; i < handle->max_spectators; i++)
+      handle->spectators[i].fd = -1;
 
-   if (!get_self_input_state(handle))
+   if (!socket_nonblock(handle->listen_fd))
       return false;
 
-   // We skip reading the first frame so the host has a chance to grab our host info so we don't block forever :')
-   if (handle->frame_count == 0)
+#ifdef HAVE_SPECTATE_THREAD
+   if (pipe(handle->spectate_wake) < 0)
    {
-      handle->buffer[0].used_real = true;
-      handle->buffer[0].is_simulated = false;
-      handle->buffer[0].real_input_state = 0;
-      handle->read_ptr = NEXT_PTR(handle->read_ptr);
-      handle->read_frame_count++;
-      return true;
+      handle->spectate_wake[0] = handle->spectate_wake[1] = -1;
+      return false;
    }
 
-   // We might have reached the end of the buffer, where we simply have to block.
-   int res = poll_input(handle, handle->other_ptr == handle->self_ptr);
-   if (res == -1)
-   {
-      handle->has_connection = false;
+   if (!socket_nonblock(handle->spectate_wake[0]) || !socket_nonblock(handle->spectate_wake[1]))
+      return false;
+
+#ifdef HAVE_SPECTATE_EPOLL
+   handle->epoll_fd = epoll_create(1);
+   if (handle->epoll_fd < 0)
+      return false;
+
+   struct epoll_event event = {0};
+   event.events = EPOLLIN;
+   event.data.fd = handle->listen_fd;
+   if (epoll_ctl(handle->epoll_fd, EPOLL_CTL_ADD, handle->listen_fd, &event) < 0)
+      return false;
+
+   event.data.fd = handle->spectate_wake[0];
+   if (epoll_ctl(handle->epoll_fd, EPOLL_CTL_ADD, handle->spectate_wake[0], &event) < 0)
+      return false;
+#endif
+
+   handle->spectate_lock = slock_new();
+   if (!handle->spectate_lock)
+      return false;
+
+   handle->spectate_thread = sthread_create(spectate_thread, handle);
+   if (!handle->spectate_thread)
+      return false;
+#endif
+
+   return true;
+}
+
+// Also used when a relay loses its upstream, so leaves the handle as if never started.
+static void deinit_spectate_server(netplay_t *handle)
+{
+#ifdef HAVE_SPECTATE_THREAD
+   if (handle->spectate_thread)
+   {
+      slock_lock(handle->spectate_lock);
+      handle->spectate_quit = true;
+      slock_unlock(handle->spectate_lock);
+      spectate_wake(handle);
+      sthread_join(handle->spectate_thread);
+      handle->spectate_thread = NULL;
+   }
+
+   if (handle->spectate_lock)
+      slock_free(handle->spectate_lock);
+   handle->spectate_lock = NULL;
+   if (handle->spectate_wake[0] >= 0)
+      close(handle->spectate_wake[0]);
+   if (handle->spectate_wake[1] >= 0)
+      close(handle->spectate_wake[1]);
+   handle->spectate_wake[0] = handle->spectate_wake[1] = -1;
+#endif
+
+#ifdef HAVE_SPECTATE_EPOLL
+   if (handle->epoll_fd >= 0)
+      close(handle->epoll_fd);
+   handle->epoll_fd = -1;
+#endif
+
+   // The host listens on its main socket, which is closed along with the handle.
+   if (handle->listen_fd >= 0 && handle->listen_fd != handle->fd)
+      close(handle->listen_fd);
+   handle->listen_fd = -1;
+
+   if (handle->spectators)
+   {
+      for (unsigned i = 0; i < handle->max_spectators; i++)
+      {
+         if (handle->spectators[i].fd >= 0)
+            close(handle->spectators[i].fd);
+         spectate_header_unref(handle->spectators[i].header);
+      }
+   }
+
+   spectate_header_unref(handle->keyframe);
+   handle->keyframe = NULL;
+   handle->spectator_joining = false;
+
+   free(handle->spectators);
+   free(handle->history);
+   free(handle->history_frames);
+   handle->spectators = NULL;
+   handle->history = NULL;
+   handle->history_frames = NULL;
+}
+
+static bool init_buffers(netplay_t *handle)
+{
+   handle->buffer = (struct delta_frame*)calloc(handle->buffer_size, sizeof(*handle->buffer));
+   if (!handle->buffer)
+      return false;
+
+   handle->state_size = pretro_serialize_size();
+   for (unsigned i = 0; i < handle->buffer_size; i++)
+      handle->buffer[i].is_simulated = true;
+   handle->checkpoint_interval = 1;
+
+   handle->delta_states = g_settings.netplay_delta_states;
+   if (handle->delta_states)
+   {
+      // Padding words are always 0, so they never show up in deltas.
+      handle->state_words = (handle->state_size + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+      handle->delta_cap = 2 * handle->state_words;
+
+      handle->state_arena = calloc(3 * handle->state_words, sizeof(uint32_t));
+      handle->delta_buf = (uint64_t*)malloc(handle->delta_cap * sizeof(uint64_t));
+      if (!handle->state_arena || !handle->delta_buf)
+         return false;
+
+      handle->base_state = (uint32_t*)handle->state_arena;
+      handle->head_state = handle->base_state + handle->state_words;
+      handle->scratch_state = handle->head_state + handle->state_words;
+
+      RARCH_LOG("Netplay uses delta states.\n");
+   }
+   else
+   {
+      // All states in one allocation, each slot aligned to a cache line.
+      size_t stride = (handle->state_size + 63) & ~(size_t)63;
+      handle->state_arena = malloc(handle->buffer_size * stride);
+      if (!handle->state_arena)
+         return false;
+
+      for (unsigned i = 0; i < handle->buffer_size; i++)
+         handle->buffer[i].state = (uint8_t*)handle->state_arena + i * stride;
+   }
+
+   return true;
+}
+
+// Makes room for one more delta of worst case size.
+static bool reserve_delta(netplay_t *handle)
+{
+   if (handle->delta_cap - handle->delta_end >= handle->state_words)
+      return true;
+
+   // Drop deltas already merged into base_state.
+   size_t start = handle->delta_start;
+   memmove(handle->delta_buf, handle->delta_buf + start,
+         (handle->delta_end - start) * sizeof(uint64_t));
+   handle->delta_end -= start;
+   handle->delta_start = 0;
+
+   size_t ptr = handle->base_ptr;
+   for (uint32_t frame = handle->base_frame; frame < handle->head_frame; frame++)
+   {
+      ptr = NEXT_PTR(ptr);
+      if (handle->buffer[ptr].has_state)
+         handle->buffer[ptr].delta_pos -= start;
+   }
+
+   if (handle->delta_cap - handle->delta_end >= handle->state_words)
+      return true;
+
+   size_t cap = 2 * handle->delta_cap;
+   uint64_t *buf = (uint64_t*)realloc(handle->delta_buf, cap * sizeof(uint64_t));
+   if (!buf)
+      return false;
+
+   handle->delta_buf = buf;
+   handle->delta_cap = cap;
+   return true;
+}
+
+// Saves current state of the core as a checkpoint for frame, which is stored at ptr.
+// Frames must be stored in increasing order, starting over after netplay_load_base_state().
+static bool netplay_store_state(netplay_t *handle, size_t ptr, uint32_t frame)
+{
+   struct delta_frame *delta = &handle->buffer[ptr];
+
+   rarch_time_t start = rarch_get_time_usec();
+   if (!pretro_serialize(handle->delta_states ? handle->scratch_state : delta->state, handle->state_size))
+      return false;
+   handle->serialize_cost += ((float)(rarch_get_time_usec() - start) - handle->serialize_cost) / 16.0f;
+
+   delta->has_state = true;
+
+   // Nothing can roll back past the other side's last confirmed frame.
+   bool is_base = frame <= handle->other_frame_count;
+   if (is_base)
+   {
+      handle->base_ptr = ptr;
+      handle->base_frame = frame;
+   }
+
+   if (handle->delta_states)
+   {
+      if (is_base)
+      {
+         memcpy(handle->base_state, handle->scratch_state, handle->state_words * sizeof(uint32_t));
+         handle->delta_start = handle->delta_end = 0;
+      }
+      else
+      {
+         if (!reserve_delta(handle))
+            return false;
+
+         delta->delta_pos = handle->delta_end;
+         delta->delta_len = state_delta_encode(handle->delta_buf + handle->delta_end,
+               handle->head_state, handle->scratch_state, 0, handle->state_words);
+         handle->delta_end += delta->delta_len;
+      }
+
+      uint32_t *tmp = handle->head_state;
+      handle->head_state = handle->scratch_state;
+      handle->scratch_state = tmp;
+   }
+
+   handle->head_frame = frame;
+   return true;
+}
+
+// Loads the base checkpoint, and forgets every checkpoint after it.
+static void netplay_load_base_state(netplay_t *handle)
+{
+   if (handle->delta_states)
+   {
+      pretro_unserialize(handle->base_state, handle->state_size);
+      memcpy(handle->head_state, handle->base_state, handle->state_words * sizeof(uint32_t));
+      handle->delta_start = handle->delta_end = 0;
+   }
+   else
+      pretro_unserialize(handle->buffer[handle->base_ptr].state, handle->state_size);
+
+   handle->head_frame = handle->base_frame;
+}
+
+// other_ptr has moved forward. Moves the base to the newest checkpoint at or before it.
+static void netplay_advance_base_state(netplay_t *handle)
+{
+   size_t ptr = handle->base_ptr;
+   for (uint32_t frame = handle->base_frame + 1;
+         frame <= handle->other_frame_count && frame <= handle->head_frame; frame++)
+   {
+      ptr = NEXT_PTR(ptr);
+
+      const struct delta_frame *delta = &handle->buffer[ptr];
+      if (!delta->has_state)
+         continue;
+
+      if (handle->delta_states)
+      {
+         state_delta_apply(handle->base_state, handle->delta_buf + delta->delta_pos, delta->delta_len);
+         handle->delta_start = delta->delta_pos + delta->delta_len;
+      }
+
+      handle->base_ptr = ptr;
+      handle->base_frame = frame;
+   }
+}
+
+// Picks how often to checkpoint. Checkpointing every K frames costs serialize / K per frame,
+// while every rollback has to replay K / 2 extra frames on average.
+static void netplay_tune_checkpoints(netplay_t *handle, bool rolled_back)
+{
+   handle->rollback_rate += ((rolled_back ? 1.0f : 0.0f) - handle->rollback_rate) / 64.0f;
+
+   unsigned max_interval = handle->buffer_size / 2;
+   if (max_interval < 1)
+      max_interval = 1;
+
+   unsigned interval = g_settings.netplay_checkpoint_interval;
+   if (!interval)
+   {
+      float replay_cost = handle->rollback_rate * handle->run_cost;
+      interval = replay_cost > 0.0f ?
+         (unsigned)(sqrtf(2.0f * handle->serialize_cost / replay_cost) + 0.5f) : max_interval;
+   }
+
+   if (interval < 1)
+      interval = 1;
+   else if (interval > max_interval)
+      interval = max_interval;
+
+   handle->checkpoint_interval = interval;
+}
+
+// After the handshake, nothing on the regular netplay sockets may block the frame loop.
+static bool init_nonblocking(netplay_t *handle)
+{
+   if (!socket_nonblock(handle->fd) || !socket_nonblock(handle->udp_fd))
+   {
+      RARCH_ERR("Failed to make netplay sockets nonblocking.\n");
+      return false;
+   }
+
+#ifdef HAVE_NETPLAY_EPOLL
+   handle->epoll_fd = epoll_create(2);
+   if (handle->epoll_fd < 0)
+   {
+      RARCH_ERR("Failed to create epoll instance for netplay.\n");
+      return false;
+   }
+
+   struct epoll_event event = {0};
+   event.events = EPOLLIN;
+   event.data.fd = handle->fd;
+   if (epoll_ctl(handle->epoll_fd, EPOLL_CTL_ADD, handle->fd, &event) < 0)
+      return false;
+
+   event.data.fd = handle->udp_fd;
+   if (epoll_ctl(handle->epoll_fd, EPOLL_CTL_ADD, handle->udp_fd, &event) < 0)
+      return false;
+#endif
+
+   return true;
+}
+
+netplay_t *netplay_new(const char *server, uint16_t port,
+      unsigned frames, const struct retro_callbacks *cb,
+      bool spectate, uint16_t relay_port,
+      const char *nick)
+{
+   if (frames > UDP_FRAME_PACKETS)
+      frames = UDP_FRAME_PACKETS;
+
+   netplay_t *handle = (netplay_t*)calloc(1, sizeof(*handle));
+   if (!handle)
+      return NULL;
+
+   handle->fd = -1;
+   handle->udp_fd = -1;
+   handle->listen_fd = -1;
+#ifdef HAVE_NETPLAY_EPOLL
+   handle->epoll_fd = -1;
+#endif
+#ifdef HAVE_SPECTATE_THREAD
+   handle->spectate_wake[0] = handle->spectate_wake[1] = -1;
+#endif
+   handle->cbs = *cb;
+   handle->port = server ? 0 : 1;
+   handle->spectate = spectate;
+   handle->spectate_client = server != NULL;
+   strlcpy(handle->nick, nick, sizeof(handle->nick));
+
+   if (!init_socket(handle, server, port))
+   {
+      free(handle);
+      return NULL;
+   }
+
+   if (spectate)
+   {
+      if (server)
+      {
+         if (!get_info_spectate(handle))
+            goto error;
+
+         if (relay_port)
+         {
+            RARCH_LOG("Relaying to spectators on port %hu.\n", (unsigned short)relay_port);
+            if ((handle->listen_fd = init_tcp_socket(handle, NULL, relay_port, true)) < 0)
+               goto error;
+         }
+      }
+      else
+      {
+         if (relay_port)
+            RARCH_WARN("Relaying needs a host to spectate, ignoring relay port.\n");
+         handle->listen_fd = handle->fd;
+      }
+
+      if (handle->listen_fd >= 0 && !init_spectate_server(handle))
+      {
+         RARCH_ERR("Failed to start spectator server.\n");
+         goto error;
+      }
+   }
+   else
+   {
+      if (server)
+      {
+         // The host hangs up on implementations it cannot play with.
+         if (!send_info(handle))
+         {
+            RARCH_ERR("Handshake with host failed, make sure you're using exact same libretro implementations and RetroArch version (netplay protocol %u).\n",
+                  NETPLAY_PROTOCOL_VERSION);
+            goto error;
+         }
+      }
+      else
+      {
+         if (!get_info(handle))
+            goto error;
+      }
+
+      if (!init_nonblocking(handle))
+         goto error;
+
+      handle->buffer_size = frames + 1;
+
+      handle->input_delay_min = g_settings.netplay_input_delay_min;
+      handle->input_delay_max = g_settings.netplay_input_delay_max;
+      if (handle->input_delay_max > NETPLAY_MAX_INPUT_DELAY)
+         handle->input_delay_max = NETPLAY_MAX_INPUT_DELAY;
+      if (handle->input_delay_min > handle->input_delay_max)
+         handle->input_delay_min = handle->input_delay_max;
+      handle->input_delay = handle->input_delay_min;
+
+      if (!init_buffers(handle))
+      {
+         RARCH_ERR("Failed to allocate netplay buffers.\n");
+         goto error;
+      }
+      handle->has_connection = true;
+   }
+
+   return handle;
+
+error:
+   if (spectate)
+      deinit_spectate_server(handle);
+   if (handle->fd >= 0)
+      close(handle->fd);
+   if (handle->udp_fd >= 0)
+      close(handle->udp_fd);
+#ifdef HAVE_NETPLAY_EPOLL
+   if (handle->epoll_fd >= 0)
+      close(handle->epoll_fd);
+#endif
+
+   if (handle->addr)
+      freeaddrinfo(handle->addr);
+
+   free(handle->buffer);
+   free(handle->state_arena);
+   free(handle->delta_buf);
+   free(handle);
+   return NULL;
+}
+
+
+static bool netplay_is_alive(netplay_t *handle)
+{
+   return handle->has_connection;
+}
+
+static bool send_chunk(netplay_t *handle)
+{
+   const struct sockaddr *addr = NULL;
+   if (handle->addr)
+      addr = handle->addr->ai_addr;
+   else if (handle->has_client_addr)
+      addr = (const struct sockaddr*)&handle->their_addr;
+
+   if (addr)
+   {
+      rarch_time_t now = rarch_get_time_usec();
+      handle->packet_buffer[0] = htonl((uint32_t)now);
+      handle->packet_buffer[1] = htonl(handle->has_remote_time ?
+            handle->remote_time + (uint32_t)(now - handle->remote_time_received) : 0);
+
+      ssize_t ret = sendto(handle->udp_fd, CONST_CAST handle->packet_buffer,
+            sizeof(handle->packet_buffer), 0, addr,
+            sizeof(struct sockaddr));
+
+      // A dropped packet is fine. Every packet carries the last UDP_FRAME_PACKETS frames.
+      if (ret != sizeof(handle->packet_buffer) && !(ret < 0 && socket_would_block()))
+      {
+         warn_hangup();
+         handle->has_connection = false;
+         return false;
+      }
+   }
+   return true;
+}
+
+#define MAX_RETRIES 16
+#define RETRY_MS 500
+
+// Sends as much of the queued command data as the socket will take right now.
+static bool flush_cmds(netplay_t *handle)
+{
+   while (handle->cmd_send_size)
+   {
+      ssize_t ret = send(handle->fd, CONST_CAST handle->cmd_send_buf, handle->cmd_send_size, 0);
+      if (ret < 0 && socket_would_block())
+         break;
+      if (ret <= 0)
+         return false;
+
+      memmove(handle->cmd_send_buf, handle->cmd_send_buf + ret, handle->cmd_send_size - ret);
+      handle->cmd_send_size -= ret;
+   }
+
+#ifdef HAVE_NETPLAY_EPOLL
+   bool want_out = handle->cmd_send_size > 0;
+   if (want_out != handle->epoll_out)
+   {
+      struct epoll_event event = {0};
+      event.events = EPOLLIN | (want_out ? EPOLLOUT : 0);
+      event.data.fd = handle->fd;
+      if (epoll_ctl(handle->epoll_fd, EPOLL_CTL_MOD, handle->fd, &event) < 0)
+         return false;
+      handle->epoll_out = want_out;
+   }
+#endif
+
+   return true;
+}
+
+static bool queue_cmd_data(netplay_t *handle, const void *data, size_t size)
+{
+   if (size > sizeof(handle->cmd_send_buf) - handle->cmd_send_size)
+   {
+      RARCH_ERR("Netplay command queue overflowed.\n");
+      return false;
+   }
+
+   memcpy(handle->cmd_send_buf + handle->cmd_send_size, data, size);
+   handle->cmd_send_size += size;
+   return flush_cmds(handle);
+}
+
+// Waits up to timeout_ms for either socket to have data, and services the command connection.
+// Returns -1 on error, 1 if UDP data is available and 0 otherwise.
+static int poll_input(netplay_t *handle, unsigned timeout_ms)
+{
+   bool tcp_in = false, tcp_out = false, udp_in = false;
+
+#ifdef HAVE_NETPLAY_EPOLL
+   struct epoll_event events[2];
+   int num = epoll_wait(handle->epoll_fd, events, 2, timeout_ms);
+   if (num < 0)
+      return errno == EINTR ? 0 : -1;
+
+   for (int i = 0; i < num; i++)
+   {
+      if (events[i].data.fd == handle->udp_fd)
+         udp_in = true;
+      else
+      {
+         tcp_in = events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP);
+         tcp_out = events[i].events & EPOLLOUT;
+      }
+   }
+#else
+   int max_fd = (handle->fd > handle->udp_fd ? handle->fd : handle->udp_fd) + 1;
+
+   struct timeval tv = {0};
+   tv.tv_sec = timeout_ms / 1000;
+   tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+   fd_set fds, write_fds;
+   FD_ZERO(&fds);
+   FD_ZERO(&write_fds);
+   FD_SET(handle->udp_fd, &fds);
+   FD_SET(handle->fd, &fds);
+   if (handle->cmd_send_size)
+      FD_SET(handle->fd, &write_fds);
+
+   int ret = select(max_fd, &fds, &write_fds, NULL, &tv);
+   if (ret < 0)
+      return socket_would_block() ? 0 : -1;
+
+   tcp_in = FD_ISSET(handle->fd, &fds);
+   tcp_out = FD_ISSET(handle->fd, &write_fds);
+   udp_in = FD_ISSET(handle->udp_fd, &fds);
+#endif
+
+   if (tcp_in && !netplay_get_cmds(handle))
+      return -1;
+
+   if (tcp_out && !flush_cmds(handle))
+      return -1;
+
+   return udp_in ? 1 : 0;
+}
+
+// Moves the input delay towards what the measured round-trip time calls for.
+// Raised quickly when input starts arriving late, lowered slowly so it does not flap.
+static void netplay_update_input_delay(netplay_t *handle)
+{
+   // A pending flip holds back the first frame whose input we would send, which depends on the delay.
+   if (handle->input_delay_max <= handle->input_delay_min || !handle->has_rtt || handle->flip_pending)
+      return;
+
+   float fps = g_extern.system.av_info.timing.fps > 0.0 ? g_extern.system.av_info.timing.fps : 60.0f;
+   float one_way = handle->rtt / 2.0f + 2.0f * handle->rtt_var;
+   unsigned target = (unsigned)(one_way * fps / 1000000.0f + 0.5f);
+   if (target < handle->input_delay_min)
+      target = handle->input_delay_min;
+   if (target > handle->input_delay_max)
+      target = handle->input_delay_max;
+
+   if (target > handle->input_delay)
+      handle->delay_votes = handle->delay_votes > 0 ? handle->delay_votes + 1 : 1;
+   else if (target < handle->input_delay)
+      handle->delay_votes = handle->delay_votes < 0 ? handle->delay_votes - 1 : -1;
+   else
+      handle->delay_votes = 0;
+
+   if (handle->delay_votes >= NETPLAY_DELAY_RAISE_FRAMES)
+      handle->input_delay++;
+   else if (handle->delay_votes <= -NETPLAY_DELAY_LOWER_FRAMES)
+      handle->input_delay--;
+   else
+      return;
+
+   handle->delay_votes = 0;
+   RARCH_LOG("Netplay input delay is now %u frames (RTT %.1f ms, jitter %.1f ms).\n",
+         handle->input_delay, handle->rtt / 1000.0f, handle->rtt_var / 1000.0f);
+}
+
+// Grab our own input state and send this over the network.
+static bool get_self_input_state(netplay_t *handle)
+{
+   struct delta_frame *ptr = &handle->buffer[handle->self_ptr];
+
+   uint32_t state = 0;
+   if (handle->frame_count > 0) // First frame we always give zero input since relying on input from first frame screws up when we use -F 0.
+   {
+      retro_input_state_t cb = handle->cbs.state_cb;
+      for (unsigned i = 0; i < RARCH_FIRST_META_KEY; i++)
+      {
+         int16_t tmp = cb(g_settings.input.netplay_client_swap_input ? 0 : !handle->port,
+               RETRO_DEVICE_JOYPAD, 0, i);
+         state |= tmp ? 1 << i : 0;
+      }
+   }
+
+   netplay_update_input_delay(handle);
+
+   // This input is used input_delay frames from now. When the delay was just raised,
+   // it also covers the frame in between. When it was lowered, the frame already has input and we drop it.
+   while (handle->self_frame <= handle->frame_count + handle->input_delay)
+   {
+      handle->self_delay_states[handle->self_frame % (NETPLAY_MAX_INPUT_DELAY + 1)] = state;
+
+      memmove(handle->packet_buffer + UDP_PACKET_HEADER, handle->packet_buffer + UDP_PACKET_HEADER + 2,
+            (UDP_FRAME_PACKETS - 1) * 2 * sizeof(uint32_t));
+      handle->packet_buffer[UDP_PACKET_WORDS - 2] = htonl(handle->self_frame);
+      handle->packet_buffer[UDP_PACKET_WORDS - 1] = htonl(state);
+      handle->self_frame++;
+   }
+
+   if (!send_chunk(handle))
+   {
       warn_hangup();
+      handle->has_connection = false;
       return false;
    }
 
-   if (res == 1)
-   {
-      uint32_t first_read = handle->read_frame_count;
-      do 
-      {
-         uint32_t buffer[UDP_FRAME_PACKETS * 2];
-         if (!receive_data(handle, buffer, sizeof(buffer)))
-         {
-            warn_hangup();
-            handle->has_connection = false;
-            return false;
-         }
-         parse_packet(handle, buffer, UDP_FRAME_PACKETS);
+   ptr->self_state = handle->self_delay_states[handle->frame_count % (NETPLAY_MAX_INPUT_DELAY + 1)];
+   handle->self_ptr = NEXT_PTR(handle->self_ptr);
+   return true;
+}
+
+// Predicts the other side's input for a frame which has not arrived yet, from the last one which has.
+// Released buttons stay released. A held button stays held unless most holds of that button
+// we have seen ended before reaching the frame.
+static uint16_t netplay_predict_input(netplay_t *handle, uint32_t frame)
+{
+   uint32_t last = handle->read_frame_count - 1;
+   uint16_t state = handle->last_real_state;
+
+   for (unsigned i = 0; i < RARCH_FIRST_ANALOG_BIND; i++)
+   {
+      if (!(state & (1 << i)) || handle->hold_samples[i] < NETPLAY_HOLD_MIN_SAMPLES)
+         continue;
+
+      unsigned held = last - handle->hold_start[i] + 1;
+      unsigned needed = held + (frame - last);
+
+      // Holds which lasted as long as this one has so far, and which lasted until frame.
+      // The last bucket has no upper bound.
+      unsigned as_long = 0, longer = 0;
+      for (unsigned d = 1; d < NETPLAY_HOLD_BUCKETS; d++)
+      {
+         bool unbounded = d == NETPLAY_HOLD_BUCKETS - 1;
+         if (d >= held || unbounded)
+            as_long += handle->hold_hist[i][d];
+         if (d >= needed || unbounded)
+            longer += handle->hold_hist[i][d];
+      }
+
+      if (as_long && 2 * longer < as_long)
+         state &= ~(1 << i);
+   }
+
+   return state;
+}
+
+static void simulate_input(netplay_t *handle)
+{
+   size_t ptr = PREV_PTR(handle->self_ptr);
+
+   handle->buffer[ptr].simulated_input_state = netplay_predict_input(handle, handle->frame_count);
+   handle->buffer[ptr].is_simulated = true;
+   handle->buffer[ptr].used_real = false;
+}
+
+// Records how long the other side holds each button.
+static void netplay_track_input(netplay_t *handle, uint32_t frame, uint16_t state)
+{
+   uint16_t changed = state ^ handle->last_real_state;
+   handle->last_real_state = state;
+
+   for (unsigned i = 0; i < RARCH_FIRST_ANALOG_BIND; i++)
+   {
+      if (!(changed & (1 << i)))
+         continue;
+
+      if (state & (1 << i))
+      {
+         handle->hold_start[i] = frame;
+         continue;
+      }
+
+      unsigned duration = frame - handle->hold_start[i];
+      if (duration >= NETPLAY_HOLD_BUCKETS)
+         duration = NETPLAY_HOLD_BUCKETS - 1;
+      handle->hold_hist[i][duration]++;
+
+      // Forget old habits gradually.
+      if (++handle->hold_samples[i] >= NETPLAY_HOLD_MAX_SAMPLES)
+      {
+         handle->hold_samples[i] = 0;
+         for (unsigned d = 0; d < NETPLAY_HOLD_BUCKETS; d++)
+         {
+            handle->hold_hist[i][d] /= 2;
+            handle->hold_samples[i] += handle->hold_hist[i][d];
+         }
+      }
+   }
+}
+
+static void netplay_update_rtt(netplay_t *handle, uint32_t remote_time, uint32_t echo)
+{
+   rarch_time_t now = rarch_get_time_usec();
+
+   // Ignore reordered packets.
+   if (!handle->has_remote_time || (int32_t)(remote_time - handle->remote_time) > 0)
+   {
+      handle->remote_time = remote_time;
+      handle->remote_time_received = now;
+      handle->has_remote_time = true;
+   }
+
+   // Other side has not heard from us yet.
+   if (!echo)
+      return;
+
+   float rtt = (float)(uint32_t)((uint32_t)now - echo);
+   if (rtt > (float)(MAX_RETRIES * RETRY_MS * 1000))
+      return;
+
+   if (!handle->has_rtt)
+   {
+      handle->rtt = rtt;
+      handle->rtt_var = rtt / 2.0f;
+      handle->has_rtt = true;
+   }
+   else
+   {
+      handle->rtt_var += (fabsf(rtt - handle->rtt) - handle->rtt_var) / 4.0f;
+      handle->rtt += (rtt - handle->rtt) / 8.0f;
+   }
+}
+
+// Only input up to and including last_frame is accepted. Later input is kept for when we get there.
+static void parse_packet(netplay_t *handle, uint32_t *buffer, unsigned size, uint32_t last_frame)
+{
+   for (unsigned i = 0; i < size * 2; i++)
+      buffer[i] = ntohl(buffer[i]);
+
+   for (unsigned i = 0; i < size; i++)
+   {
+      uint32_t frame = buffer[2 * i + 0];
+      if (frame < handle->read_frame_count || frame - handle->read_frame_count >= NETPLAY_EARLY_FRAMES)
+         continue;
+
+      handle->early_input[frame % NETPLAY_EARLY_FRAMES].frame = frame;
+      handle->early_input[frame % NETPLAY_EARLY_FRAMES].state = buffer[2 * i + 1];
+   }
+
+   while (handle->read_frame_count <= last_frame &&
+         handle->early_input[handle->read_frame_count % NETPLAY_EARLY_FRAMES].frame == handle->read_frame_count)
+   {
+      uint16_t state = handle->early_input[handle->read_frame_count % NETPLAY_EARLY_FRAMES].state;
+      netplay_track_input(handle, handle->read_frame_count, state);
+
+      handle->buffer[handle->read_ptr].is_simulated = false;
+      handle->buffer[handle->read_ptr].real_input_state = state;
+      handle->read_ptr = NEXT_PTR(handle->read_ptr);
+      handle->read_frame_count++;
+   }
+}
+
+// Drains every datagram which has already arrived. Never blocks.
+static void receive_data(netplay_t *handle, uint32_t last_frame)
+{
+   for (;;)
+   {
+      uint32_t buffer[UDP_PACKET_WORDS];
+      socklen_t addrlen = sizeof(handle->their_addr);
+      ssize_t ret = recvfrom(handle->udp_fd, NONCONST_CAST buffer, sizeof(buffer), 0,
+            (struct sockaddr*)&handle->their_addr, &addrlen);
+
+      // Errors on UDP are transient. A peer which is really gone is caught by the stall timeout.
+      if (ret < 0)
+         break;
+
+      if (ret != sizeof(buffer))
+         continue;
+
+      handle->has_client_addr = true;
+      netplay_update_rtt(handle, ntohl(buffer[0]), ntohl(buffer[1]));
+      parse_packet(handle, buffer + UDP_PACKET_HEADER, UDP_FRAME_PACKETS, last_frame);
+   }
+}
+
+// Poll network to see if we have anything new. Never blocks. Running out of rollback buffer is dealt with in netplay_pre_frame().
+static bool netplay_poll(netplay_t *handle)
+{
+   if (!handle->has_connection)
+      return false;
 
-      } while ((handle->read_frame_count <= handle->frame_count) && 
-            poll_input(handle, (handle->other_ptr == handle->self_ptr) && 
-               (first_read == handle->read_frame_count)) == 1);
+   handle->can_poll = false;
+
+   if (!get_self_input_state(handle))
+      return false;
+
+   // We skip reading the first frame so the host has a chance to grab our host info so we don't block forever :')
+   if (handle->frame_count == 0)
+   {
+      handle->buffer[0].used_real = true;
+      handle->buffer[0].is_simulated = false;
+      handle->buffer[0].real_input_state = 0;
+      handle->read_ptr = NEXT_PTR(handle->read_ptr);
+      handle->read_frame_count++;
+      return true;
    }
-   else
+
+   int res = poll_input(handle, 0);
+   if (res == -1)
    {
-      // Cannot allow this. Should not happen though.
-      if (handle->self_ptr == handle->other_ptr)
-      {
-         warn_hangup();
-         return false;
-      }
+      handle->has_connection = false;
+      warn_hangup();
+      return false;
    }
 
-   if (handle->read_ptr != handle->self_ptr)
+   if (res == 1)
+      receive_data(handle, handle->frame_count);
+
+   // Compare frames, not pointers. With a full rollback buffer read_ptr wraps around onto self_ptr.
+   if (handle->read_frame_count <= handle->frame_count)
       simulate_input(handle);
    else
       handle->buffer[PREV_PTR(handle->self_ptr)].used_real = true;
@@ -1030,47 +2179,54 @@ static bool netplay_send_cmd(netplay_t *handle, uint32_t cmd, const void *data,
    cmd = (cmd << 16) | (size & 0xffff);
    cmd = htonl(cmd);
 
-   if (!send_all(handle->fd, &cmd, sizeof(cmd)))
-      return false;
-
-   if (!send_all(handle->fd, data, size))
+   if (sizeof(cmd) + size > sizeof(handle->cmd_send_buf) - handle->cmd_send_size)
+   {
+      RARCH_ERR("Netplay command queue overflowed.\n");
       return false;
+   }
 
-   return true;
+   return queue_cmd_data(handle, &cmd, sizeof(cmd)) && queue_cmd_data(handle, data, size);
 }
 
 static bool netplay_cmd_ack(netplay_t *handle)
 {
    uint32_t cmd = htonl(NETPLAY_CMD_ACK);
-   return send_all(handle->fd, &cmd, sizeof(cmd));
+   return queue_cmd_data(handle, &cmd, sizeof(cmd));
 }
 
 static bool netplay_cmd_nak(netplay_t *handle)
 {
    uint32_t cmd = htonl(NETPLAY_CMD_NAK);
-   return send_all(handle->fd, &cmd, sizeof(cmd));
+   return queue_cmd_data(handle, &cmd, sizeof(cmd));
 }
 
-static bool netplay_get_response(netplay_t *handle)
+// ACK or NAK for a flip we asked for.
+static void netplay_handle_response(netplay_t *handle, bool ack)
 {
-   uint32_t response;
-   if (!recv_all(handle->fd, &response, sizeof(response)))
-      return false;
+   if (!handle->flip_pending)
+   {
+      RARCH_WARN("Got unexpected netplay command response.\n");
+      return;
+   }
 
-   return ntohl(response) == NETPLAY_CMD_ACK;
-}
+   handle->flip_pending = false;
 
-static bool netplay_get_cmd(netplay_t *handle)
-{
-   uint32_t cmd;
-   if (!recv_all(handle->fd, &cmd, sizeof(cmd)))
-      return false;
+   if (!ack)
+   {
+      RARCH_WARN("Failed to flip players.\n");
+      msg_queue_push(g_extern.msg_queue, "Failed to flip players.", 1, 180);
+      return;
+   }
 
-   cmd = ntohl(cmd);
+   RARCH_LOG("Netplay players are flipped.\n");
+   msg_queue_push(g_extern.msg_queue, "Netplay players are flipped.", 1, 180);
 
-   size_t cmd_size = cmd & 0xffff;
-   cmd = cmd >> 16;
+   handle->flip ^= true;
+   handle->flip_frame = handle->flip_pending_frame;
+}
 
+static bool netplay_handle_cmd(netplay_t *handle, uint32_t cmd, const uint8_t *payload, size_t cmd_size)
+{
    switch (cmd)
    {
       case NETPLAY_CMD_FLIP_PLAYERS:
@@ -1082,14 +2238,9 @@ static bool netplay_get_cmd(netplay_t *handle)
          }
 
          uint32_t flip_frame;
-         if (!recv_all(handle->fd, &flip_frame, sizeof(flip_frame)))
-         {
-            RARCH_ERR("Failed to receive CMD_FLIP_PLAYERS argument.\n");
-            return netplay_cmd_nak(handle);
-         }
-
+         memcpy(&flip_frame, payload, sizeof(flip_frame));
          flip_frame = ntohl(flip_frame);
-         if (flip_frame < handle->flip_frame)
+         if (flip_frame < handle->flip_frame || flip_frame < handle->other_frame_count)
          {
             RARCH_ERR("Host asked us to flip players in the past. Not possible ...\n");
             return netplay_cmd_nak(handle);
@@ -1098,6 +2249,10 @@ static bool netplay_get_cmd(netplay_t *handle)
          handle->flip ^= true;
          handle->flip_frame = flip_frame;
 
+         // We ran ahead of the host past flip_frame. None of those frames are confirmed yet, so they can be replayed.
+         if (flip_frame < handle->frame_count)
+            handle->flip_replay = true;
+
          RARCH_LOG("Netplay players are flipped.\n");
          msg_queue_push(g_extern.msg_queue, "Netplay players are flipped.", 1, 180);
 
@@ -1110,6 +2265,60 @@ static bool netplay_get_cmd(netplay_t *handle)
    }
 }
 
+// Reads what is available on the command connection and handles every complete command.
+static bool netplay_get_cmds(netplay_t *handle)
+{
+   for (;;)
+   {
+      size_t space = sizeof(handle->cmd_recv_buf) - handle->cmd_recv_size;
+      if (!space)
+         break;
+
+      ssize_t ret = recv(handle->fd, NONCONST_CAST (handle->cmd_recv_buf + handle->cmd_recv_size), space, 0);
+      if (ret < 0 && socket_would_block())
+         break;
+      if (ret <= 0)
+         return false;
+
+      handle->cmd_recv_size += ret;
+   }
+
+   size_t pos = 0;
+   while (handle->cmd_recv_size - pos >= sizeof(uint32_t))
+   {
+      uint32_t cmd;
+      memcpy(&cmd, handle->cmd_recv_buf + pos, sizeof(cmd));
+      cmd = ntohl(cmd);
+
+      // ACK and NAK are sent as bare words without size.
+      if ((cmd >> 16) == 0)
+      {
+         netplay_handle_response(handle, cmd == NETPLAY_CMD_ACK);
+         pos += sizeof(cmd);
+         continue;
+      }
+
+      size_t cmd_size = cmd & 0xffff;
+      if (sizeof(cmd) + cmd_size > sizeof(handle->cmd_recv_buf))
+      {
+         RARCH_ERR("Netplay command is too large.\n");
+         return false;
+      }
+
+      if (handle->cmd_recv_size - pos < sizeof(cmd) + cmd_size)
+         break;
+
+      if (!netplay_handle_cmd(handle, cmd >> 16, handle->cmd_recv_buf + pos + sizeof(cmd), cmd_size))
+         return false;
+
+      pos += sizeof(cmd) + cmd_size;
+   }
+
+   memmove(handle->cmd_recv_buf, handle->cmd_recv_buf + pos, handle->cmd_recv_size - pos);
+   handle->cmd_recv_size -= pos;
+   return true;
+}
+
 void netplay_flip_players(netplay_t *handle)
 {
    uint32_t flip_frame = handle->frame_count + 2 * UDP_FRAME_PACKETS;
@@ -1129,21 +2338,17 @@ void netplay_flip_players(netplay_t *handle)
    }
 
    // Make sure both clients are definitely synced up.
-   if (handle->frame_count < (handle->flip_frame + 2 * UDP_FRAME_PACKETS))
+   if (handle->flip_pending || handle->frame_count < (handle->flip_frame + 2 * UDP_FRAME_PACKETS))
    {
       msg = "Cannot flip players yet. Wait a second or two before attempting flip.";
       goto error;
    }
 
-   if (netplay_send_cmd(handle, NETPLAY_CMD_FLIP_PLAYERS, &flip_frame_net, sizeof(flip_frame_net))
-         && netplay_get_response(handle))
+   // The flip is applied once the client acknowledges it. netplay_pre_frame() holds flip_frame back until then.
+   if (netplay_send_cmd(handle, NETPLAY_CMD_FLIP_PLAYERS, &flip_frame_net, sizeof(flip_frame_net)))
    {
-      RARCH_LOG("Netplay players are flipped.\n");
-      msg_queue_push(g_extern.msg_queue, "Netplay players are flipped.", 1, 180);
-
-      // Queue up a flip well enough in the future.
-      handle->flip ^= true;
-      handle->flip_frame = flip_frame;
+      handle->flip_pending = true;
+      handle->flip_pending_frame = flip_frame;
    }
    else
    {
@@ -1190,26 +2395,26 @@ int16_t netplay_input_state(netplay_t *handle, bool port, unsigned device, unsig
 
 void netplay_free(netplay_t *handle)
 {
-   close(handle->fd);
-
    if (handle->spectate)
    {
-      for (unsigned i = 0; i < MAX_SPECTATORS; i++)
-         if (handle->spectate_fds[i] >= 0)
-            close(handle->spectate_fds[i]);
+      deinit_spectate_server(handle);
 
       free(handle->spectate_input);
    }
    else
    {
       close(handle->udp_fd);
+#ifdef HAVE_NETPLAY_EPOLL
+      close(handle->epoll_fd);
+#endif
 
-      for (unsigned i = 0; i < handle->buffer_size; i++)
-         free(handle->buffer[i].state);
-
+      free(handle->state_arena);
+      free(handle->delta_buf);
       free(handle->buffer);
    }
 
+   close(handle->fd);
+
    if (handle->addr)
       freeaddrinfo(handle->addr);
 
@@ -1221,12 +2426,138 @@ static bool netplay_should_skip(netplay_t *handle)
    return handle->is_replay && handle->has_connection;
 }
 
-static void netplay_pre_frame_net(netplay_t *handle)
+static bool netplay_rollback(netplay_t *handle);
+
+// We are as far ahead of the base checkpoint as the rollback buffer allows.
+// If everything up to this frame is confirmed, this frame becomes the new base instead.
+static bool netplay_is_stalled(netplay_t *handle)
+{
+   return handle->has_connection &&
+      handle->frame_count > handle->other_frame_count &&
+      handle->frame_count - handle->base_frame >= handle->buffer_size;
+}
+
+// Waits at most a frame for input from the other side.
+// Returns false if the frame still cannot be run.
+static bool netplay_resolve_stall(netplay_t *handle)
+{
+   rarch_time_t now = rarch_get_time_usec();
+   if (!handle->stall_start)
+   {
+      handle->stall_start = now;
+      handle->stall_resend = now;
+   }
+
+   unsigned timeout_ms = g_settings.video.refresh_rate > 0.0f ?
+      (unsigned)(1000.0f / g_settings.video.refresh_rate) : 16;
+
+   int res = poll_input(handle, timeout_ms ? timeout_ms : 1);
+   if (res == -1)
+   {
+      handle->has_connection = false;
+      warn_hangup();
+      return true;
+   }
+
+   // Input for the frame we are about to run has not been simulated yet, so it cannot be accepted here.
+   if (res == 1)
+      receive_data(handle, handle->frame_count - 1);
+
+   netplay_rollback(handle);
+   if (!netplay_is_stalled(handle))
+   {
+      handle->stall_start = 0;
+      return true;
+   }
+
+   now = rarch_get_time_usec();
+   if (now - handle->stall_resend >= RETRY_MS * 1000)
+   {
+      handle->stall_resend = now;
+      RARCH_LOG("Network is stalling, resending packet... Count %u of %d ...\n",
+            (unsigned)((now - handle->stall_start) / (RETRY_MS * 1000)), MAX_RETRIES);
+
+      if (!send_chunk(handle))
+         return true;
+   }
+
+   if (now - handle->stall_start >= (rarch_time_t)MAX_RETRIES * RETRY_MS * 1000)
+   {
+      handle->has_connection = false;
+      warn_hangup();
+      return true;
+   }
+
+   return false;
+}
+
+// The flip must be known on both sides before input for flip_frame is sent, as confirmed frames are never replayed.
+// Holds back the frame which would send it until the client answers, waiting at most a frame per call.
+// Returns false if the frame still cannot be run.
+static bool netplay_resolve_flip(netplay_t *handle)
+{
+   rarch_time_t now = rarch_get_time_usec();
+   if (!handle->flip_wait_start)
+      handle->flip_wait_start = now;
+
+   unsigned timeout_ms = g_settings.video.refresh_rate > 0.0f ?
+      (unsigned)(1000.0f / g_settings.video.refresh_rate) : 16;
+
+   int res = poll_input(handle, timeout_ms ? timeout_ms : 1);
+   if (res == -1)
+   {
+      handle->has_connection = false;
+      warn_hangup();
+      return true;
+   }
+
+   // Keeps the socket buffer drained. Input for the frame we are about to run cannot be accepted yet.
+   if (res == 1)
+      receive_data(handle, handle->frame_count - 1);
+
+   if (!handle->flip_pending)
+   {
+      handle->flip_wait_start = 0;
+      return true;
+   }
+
+   if (now - handle->flip_wait_start >= (rarch_time_t)MAX_RETRIES * RETRY_MS * 1000)
+   {
+      RARCH_ERR("Flip of players was never acknowledged.\n");
+      handle->has_connection = false;
+      warn_hangup();
+      return true;
+   }
+
+   return false;
+}
+
+static bool netplay_pre_frame_net(netplay_t *handle)
 {
-   pretro_serialize(handle->buffer[handle->self_ptr].state, handle->state_size);
+   if (netplay_is_stalled(handle) && !netplay_resolve_stall(handle))
+      return false;
+
+   if (handle->has_connection && handle->flip_pending &&
+         handle->frame_count + handle->input_delay >= handle->flip_pending_frame &&
+         !netplay_resolve_flip(handle))
+      return false;
+
+   struct delta_frame *ptr = &handle->buffer[handle->self_ptr];
+   ptr->has_state = false;
+
+   if ((handle->frame_count <= handle->other_frame_count ||
+            handle->frame_count - handle->head_frame >= handle->checkpoint_interval) &&
+         !netplay_store_state(handle, handle->self_ptr, handle->frame_count))
+   {
+      RARCH_ERR("Failed to save netplay state.\n");
+      handle->has_connection = false;
+      warn_hangup();
+   }
+
    handle->can_poll = true;
 
    input_poll_net();
+   return true;
 }
 
 static void netplay_set_spectate_input(netplay_t *handle, int16_t input)
@@ -1253,13 +2584,25 @@ static int16_t netplay_get_spectate_input(netplay_t *handle, bool port, unsigned
 {
    int16_t inp;
    if (recv_all(handle->fd, NONCONST_CAST &inp, sizeof(inp)))
+   {
+      // Relays pass on exactly what they received.
+      if (handle->spectators)
+         netplay_set_spectate_input(handle, swap_if_big16(inp));
       return swap_if_big16(inp);
+   }
    else
    {
       RARCH_ERR("Connection with host was cut.\n");
       msg_queue_clear(g_extern.msg_queue);
       msg_queue_push(g_extern.msg_queue, "Connection with host was cut.", 1, 180);
 
+      // Our spectators would otherwise wait for input forever.
+      if (handle->spectators)
+      {
+         RARCH_LOG("Closing relay.\n");
+         deinit_spectate_server(handle);
+      }
+
       pretro_set_input_state(g_extern.netplay->cbs.state_cb);
       return g_extern.netplay->cbs.state_cb(port, device, index, id);
    }
@@ -1270,108 +2613,91 @@ int16_t input_state_spectate_client(unsigned port, unsigned device, unsigned ind
    return netplay_get_spectate_input(g_extern.netplay, port, device, index, id);
 }
 
+// Announces spectators which joined or left, and refreshes the keyframe new ones start from.
 static void netplay_pre_frame_spectate(netplay_t *handle)
 {
-   if (handle->spectate_client)
+   if (!handle->spectators)
       return;
 
-   fd_set fds;
-   FD_ZERO(&fds);
-   FD_SET(handle->fd, &fds);
-
-   struct timeval tmp_tv = {0};
-   if (select(handle->fd + 1, &fds, NULL, NULL, &tmp_tv) <= 0)
-      return;
-
-   if (!FD_ISSET(handle->fd, &fds))
-      return;
-
-   struct sockaddr_storage their_addr;
-   socklen_t addr_size = sizeof(their_addr);
-   int new_fd = accept(handle->fd, (struct sockaddr*)&their_addr, &addr_size);
-   if (new_fd < 0)
-   {
-      RARCH_ERR("Failed to accept incoming spectator.\n");
-      return;
-   }
+   spectate_lock(handle);
+#ifndef HAVE_SPECTATE_THREAD
+   spectate_server_pump(handle);
+#endif
 
-   int index = -1;
-   for (unsigned i = 0; i < MAX_SPECTATORS; i++)
+   for (unsigned i = 0; i < handle->max_spectators; i++)
    {
-      if (handle->spectate_fds[i] == -1)
+      struct spectator *spec = &handle->spectators[i];
+      if (spec->state == SPECTATOR_STREAMING && !spec->announced)
       {
-         index = i;
-         break;
+#ifndef HAVE_SOCKET_LEGACY
+         log_connection(&spec->addr, i, spec->nick);
+#endif
+         spec->announced = true;
       }
-   }
+      else if (spec->state == SPECTATOR_DEAD)
+      {
+         if (spec->announced)
+         {
+            char msg[512];
+            if (spec->lagged)
+               snprintf(msg, sizeof(msg), "Client (#%u) fell too far behind and was dropped.", i);
+            else
+               snprintf(msg, sizeof(msg), "Client (#%u) disconnected.", i);
+            msg_queue_push(g_extern.msg_queue, msg, 1, 180);
+            RARCH_LOG("%s\n", msg);
+         }
 
-   // No vacant client streams :(
-   if (index == -1)
-   {
-      close(new_fd);
-      return;
+         spec->state = SPECTATOR_FREE;
+      }
    }
 
-   if (!get_nickname(handle, new_fd))
-   {
-      RARCH_ERR("Failed to get nickname from client.\n");
-      close(new_fd);
-      return;
-   }
+   // Only serialize when a new spectator is waiting for it.
+   bool stale = handle->spectator_joining && spectate_keyframe_stale(handle);
+   spectate_unlock(handle);
 
-   if (!send_nickname(handle, new_fd))
-   {
-      RARCH_ERR("Failed to send nickname to client.\n");
-      close(new_fd);
+   if (!stale)
       return;
-   }
 
-   size_t header_size;
-   uint32_t *header = bsv_header_generate(&header_size, implementation_magic_value());
-   if (!header)
+   struct spectate_header *keyframe = spectate_header_new(handle);
+   if (!keyframe)
    {
       RARCH_ERR("Failed to generate BSV header.\n");
-      close(new_fd);
-      return;
-   }
-
-   int bufsize = header_size;
-   setsockopt(new_fd, SOL_SOCKET, SO_SNDBUF, CONST_CAST &bufsize, sizeof(int));
-
-   if (!send_all(new_fd, header, header_size))
-   {
-      RARCH_ERR("Failed to send header to client.\n");
-      close(new_fd);
-      free(header);
       return;
    }
 
-   free(header);
-   handle->spectate_fds[index] = new_fd;
-
-#ifndef HAVE_SOCKET_LEGACY
-   log_connection(&their_addr, index, handle->other_nick);
-#endif
+   spectate_lock(handle);
+   spectate_header_unref(handle->keyframe);
+   keyframe->refs++;
+   handle->keyframe = keyframe;
+   handle->keyframe_pos = handle->history_head;
+   handle->keyframe_frame = handle->history_frame_count;
+   spectate_unlock(handle);
+   spectate_wake(handle);
 }
 
-void netplay_pre_frame(netplay_t *handle)
+bool netplay_pre_frame(netplay_t *handle)
 {
    if (handle->spectate)
+   {
       netplay_pre_frame_spectate(handle);
+      return true;
+   }
    else
-      netplay_pre_frame_net(handle);
+      return netplay_pre_frame_net(handle);
 }
 
-static void netplay_post_frame_net(netplay_t *handle)
+// Replays frames from the base checkpoint if we mispredicted the other side's input.
+// Returns true if frames were replayed.
+static bool netplay_rollback(netplay_t *handle)
 {
-   handle->frame_count++;
-
    // Nothing to do...
-   if (handle->other_frame_count == handle->read_frame_count)
-      return;
+   if (handle->other_frame_count == handle->read_frame_count && !handle->flip_replay)
+      return false;
 
    // Skip ahead if we predicted correctly. Skip until our simulation failed.
-   while (handle->other_frame_count < handle->read_frame_count)
+   // Frames run before a late flip arrived are replayed regardless.
+   while (handle->other_frame_count < handle->read_frame_count &&
+         !(handle->flip_replay && handle->other_frame_count >= handle->flip_frame))
    {
       const struct delta_frame *ptr = &handle->buffer[handle->other_ptr];
       if ((ptr->simulated_input_state != ptr->real_input_state) && !ptr->used_real)
@@ -1380,60 +2706,99 @@ static void netplay_post_frame_net(netplay_t *handle)
       handle->other_frame_count++;
    }
 
-   if (handle->other_frame_count < handle->read_frame_count)
+   netplay_advance_base_state(handle);
+
+   if (handle->other_frame_count == handle->read_frame_count && !handle->flip_replay)
+      return false;
+
+   // Replay frames. Frames between the base checkpoint and other_ptr are replayed with confirmed input.
+   handle->is_replay = true;
+   handle->tmp_ptr = handle->base_ptr;
+   handle->tmp_frame_count = handle->base_frame;
+
+   netplay_load_base_state(handle);
+   rarch_time_t start = rarch_get_time_usec();
+   unsigned replayed = 0;
+
+   bool first = true;
+   while (first || (handle->tmp_ptr != handle->self_ptr))
    {
-      // Replay frames
-      handle->is_replay = true;
-      handle->tmp_ptr = handle->other_ptr;
-      handle->tmp_frame_count = handle->other_frame_count;
+      struct delta_frame *ptr = &handle->buffer[handle->tmp_ptr];
 
-      pretro_unserialize(handle->buffer[handle->other_ptr].state, handle->state_size);
-      bool first = true;
-      while (first || (handle->tmp_ptr != handle->self_ptr))
+      // Frames still without real input were predicted from older input than we have now.
+      if (handle->tmp_frame_count >= handle->read_frame_count)
+         ptr->simulated_input_state = netplay_predict_input(handle, handle->tmp_frame_count);
+
+      // The base was just loaded, so it is still valid.
+      if (!first)
       {
-         pretro_serialize(handle->buffer[handle->tmp_ptr].state, handle->state_size);
+         ptr->has_state = false;
+
+         // Next rollback can start at the frame which is about to be confirmed.
+         // Earlier frames are never needed again, later ones only every checkpoint_interval.
+         uint32_t frame = handle->tmp_frame_count;
+         bool checkpoint = frame == handle->read_frame_count ||
+            (frame > handle->read_frame_count && frame - handle->head_frame >= handle->checkpoint_interval);
+
+         if (checkpoint && !netplay_store_state(handle, handle->tmp_ptr, frame))
+         {
+            RARCH_ERR("Failed to save netplay state.\n");
+            handle->has_connection = false;
+            warn_hangup();
+         }
+      }
+
 #ifdef HAVE_THREADS
-         lock_autosave();
+      lock_autosave();
 #endif
-         pretro_run();
+      pretro_run();
 #ifdef HAVE_THREADS
-         unlock_autosave();
+      unlock_autosave();
 #endif
-         handle->tmp_ptr = NEXT_PTR(handle->tmp_ptr);
-         handle->tmp_frame_count++;
-         first = false;
-      }
-
-      handle->other_ptr = handle->read_ptr;
-      handle->other_frame_count = handle->read_frame_count;
-      handle->is_replay = false;
+      handle->tmp_ptr = NEXT_PTR(handle->tmp_ptr);
+      handle->tmp_frame_count++;
+      replayed++;
+      first = false;
    }
+
+   // Includes the checkpointing. Only used relative to serialize cost, so close enough.
+   float run_cost = (float)(rarch_get_time_usec() - start) / replayed;
+   handle->run_cost += (run_cost - handle->run_cost) / 16.0f;
+
+   handle->other_ptr = handle->read_ptr;
+   handle->other_frame_count = handle->read_frame_count;
+   handle->is_replay = false;
+   handle->flip_replay = false;
+
+   netplay_advance_base_state(handle);
+   return true;
+}
+
+static void netplay_post_frame_net(netplay_t *handle)
+{
+   handle->frame_count++;
+   netplay_tune_checkpoints(handle, netplay_rollback(handle));
 }
 
 static void netplay_post_frame_spectate(netplay_t *handle)
 {
-   if (handle->spectate_client)
+   if (!handle->spectators)
       return;
 
-   for (unsigned i = 0; i < MAX_SPECTATORS; i++)
+   spectate_lock(handle);
+   if (!spectate_history_append(handle, handle->spectate_input,
+            handle->spectate_input_ptr * sizeof(int16_t)))
    {
-      if (handle->spectate_fds[i] == -1)
-         continue;
-
-      if (!send_all(handle->spectate_fds[i],
-               handle->spectate_input, handle->spectate_input_ptr * sizeof(int16_t)))
-      {
-         RARCH_LOG("Client (#%u) disconnected ...\n", i);
-
-         char msg[512];
-         snprintf(msg, sizeof(msg), "Client (#%u) disconnected.", i);
-         msg_queue_push(g_extern.msg_queue, msg, 1, 180);
-
-         close(handle->spectate_fds[i]);
-         handle->spectate_fds[i] = -1;
-         break;
-      }
+      RARCH_ERR("Failed to grow spectator history, dropping all spectators.\n");
+      for (unsigned i = 0; i < handle->max_spectators; i++)
+         if (handle->spectators[i].state == SPECTATOR_STREAMING)
+            spectator_drop(&handle->spectators[i], false);
    }
+#ifndef HAVE_SPECTATE_THREAD
+   spectate_server_pump(handle);
+#endif
+   spectate_unlock(handle);
+   spectate_wake(handle);
 
    handle->spectate_input_ptr = 0;
 }
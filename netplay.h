@@ -44,17 +44,20 @@ struct retro_callbacks
 bool netplay_init_network(void);
 
 // Creates a new netplay handle. A NULL host means we're hosting (player 1). :)
+// A spectating client with a non-zero relay_port passes the stream on to its own spectators.
 netplay_t *netplay_new(const char *server,
       uint16_t port, unsigned frames,
       const struct retro_callbacks *cb, bool spectate,
-      const char *nick);
+      uint16_t relay_port, const char *nick);
 void netplay_free(netplay_t *handle);
 
 // On regular netplay, flip who controls player 1 and 2.
 void netplay_flip_players(netplay_t *handle);
 
-// Call this before running retro_run()
-void netplay_pre_frame(netplay_t *handle);
+// Call this before running retro_run().
+// Returns false if the frame cannot run yet because we are too far ahead of the other side.
+// retro_run() and netplay_post_frame() must then be skipped for this iteration.
+bool netplay_pre_frame(netplay_t *handle);
 // Call this after running retro_run()
 void netplay_post_frame(netplay_t *handle);
 
@@ -0,0 +1,327 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2012 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "performance.h"
+#include "general.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32) && !defined(_XBOX)
+#include <windows.h>
+#elif defined(_XBOX)
+#include <xtl.h>
+#elif defined(__CELLOS_LV2__) && !defined(__PSL1GHT__)
+#include <sys/sys_time.h>
+#elif defined(GEKKO)
+#include <ogc/lwp_watchdog.h>
+#elif defined(__MACH__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(__i486__) || defined(__i686__) || defined(_M_X64) || defined(_M_IX86)
+#define CPU_X86
+#endif
+
+#ifdef CPU_X86
+static void x86_cpuid(int func, int flags[4])
+{
+#if defined(_MSC_VER)
+   __cpuidex(flags, func, 0);
+#else
+   // Preserve EBX/RBX by hand. It holds the GOT pointer when building with PIC on 32-bit.
+#ifdef __x86_64__
+#define REG_b "rbx"
+#define REG_S "rsi"
+#else
+#define REG_b "ebx"
+#define REG_S "esi"
+#endif
+   __asm__ volatile (
+         "mov %%" REG_b ", %%" REG_S "\n"
+         "cpuid\n"
+         "xchg %%" REG_b ", %%" REG_S "\n"
+         : "=a"(flags[0]), "=S"(flags[1]), "=c"(flags[2]), "=d"(flags[3])
+         : "a"(func), "c"(0));
+#undef REG_b
+#undef REG_S
+#endif
+}
+
+// Only call if OSXSAVE is set, or xgetbv will fault.
+static unsigned long long x86_xgetbv(unsigned index)
+{
+#if defined(_MSC_VER)
+   return _xgetbv(index);
+#else
+   unsigned eax, edx;
+   // xgetbv, encoded by hand for old assemblers.
+   __asm__ volatile (".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(index));
+   return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+static unsigned x86_get_simd(void)
+{
+   unsigned simd = 0;
+   int flags[4];
+
+   x86_cpuid(0, flags);
+   int max_func = flags[0];
+   if (max_func < 1)
+      return 0;
+
+   x86_cpuid(1, flags);
+
+   if (flags[3] & (1 << 25))
+      simd |= RARCH_SIMD_SSE;
+   if (flags[3] & (1 << 26))
+      simd |= RARCH_SIMD_SSE2;
+   if (flags[2] & (1 << 0))
+      simd |= RARCH_SIMD_SSE3;
+   if (flags[2] & (1 << 9))
+      simd |= RARCH_SIMD_SSSE3;
+   if (flags[2] & (1 << 19))
+      simd |= RARCH_SIMD_SSE4;
+   if (flags[2] & (1 << 20))
+      simd |= RARCH_SIMD_SSE42;
+
+   // AVX needs both CPU support and the OS saving XMM and YMM state on context switches.
+   const int avx_flags = (1 << 27) | (1 << 28);
+   if ((flags[2] & avx_flags) == avx_flags && (x86_xgetbv(0) & 0x6) == 0x6)
+   {
+      simd |= RARCH_SIMD_AVX;
+
+      if (max_func >= 7)
+      {
+         x86_cpuid(7, flags);
+         if (flags[1] & (1 << 5))
+            simd |= RARCH_SIMD_AVX2;
+      }
+   }
+
+   return simd;
+}
+#endif
+
+void rarch_get_cpu_features(struct rarch_cpu_features *cpu)
+{
+   memset(cpu, 0, sizeof(*cpu));
+
+#if defined(CPU_X86)
+   cpu->simd = x86_get_simd();
+#elif defined(__ARM_NEON__)
+   cpu->simd |= RARCH_SIMD_NEON;
+#elif defined(_XBOX360)
+   cpu->simd |= RARCH_SIMD_VMX128;
+#elif defined(__ALTIVEC__) || defined(__CELLOS_LV2__)
+   cpu->simd |= RARCH_SIMD_VMX;
+#endif
+}
+
+
+rarch_time_t rarch_get_time_usec(void)
+{
+#if defined(_WIN32) || defined(_XBOX)
+   static LARGE_INTEGER freq;
+   LARGE_INTEGER count;
+   if (!freq.QuadPart)
+      QueryPerformanceFrequency(&freq);
+   QueryPerformanceCounter(&count);
+   return (rarch_time_t)(count.QuadPart / freq.QuadPart) * 1000000 +
+      (rarch_time_t)(count.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#elif defined(__CELLOS_LV2__) && !defined(__PSL1GHT__)
+   return sys_time_get_system_time();
+#elif defined(GEKKO)
+   return ticks_to_microsecs(gettime());
+#elif defined(__MACH__)
+   static mach_timebase_info_data_t info;
+   if (!info.denom)
+      mach_timebase_info(&info);
+   return (rarch_time_t)(mach_absolute_time() * info.numer / info.denom) / 1000;
+#elif defined(CLOCK_MONOTONIC)
+   struct timespec tv;
+   clock_gettime(CLOCK_MONOTONIC, &tv);
+   return (rarch_time_t)tv.tv_sec * 1000000 + tv.tv_nsec / 1000;
+#else
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return (rarch_time_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+#define RARCH_PERF_MAX_COUNTERS 64
+
+static struct rarch_perf_counter *perf_counters[RARCH_PERF_MAX_COUNTERS];
+static unsigned perf_num_counters;
+static bool perf_enable;
+
+void rarch_perf_register(struct rarch_perf_counter *counter)
+{
+   if (counter->registered)
+      return;
+
+   if (perf_num_counters >= RARCH_PERF_MAX_COUNTERS)
+   {
+      RARCH_WARN("Too many performance counters, ignoring \"%s\".\n", counter->ident);
+      return;
+   }
+
+   perf_counters[perf_num_counters++] = counter;
+   counter->registered = true;
+}
+
+void rarch_perf_unregister(struct rarch_perf_counter *counter)
+{
+   for (unsigned i = 0; i < perf_num_counters; i++)
+   {
+      if (perf_counters[i] == counter)
+      {
+         memmove(perf_counters + i, perf_counters + i + 1,
+               (perf_num_counters - i - 1) * sizeof(perf_counters[0]));
+         perf_num_counters--;
+         counter->registered = false;
+         return;
+      }
+   }
+}
+
+void rarch_perf_enable(bool enable)
+{
+   perf_enable = enable;
+}
+
+bool rarch_perf_enabled(void)
+{
+   return perf_enable;
+}
+
+void rarch_perf_start(struct rarch_perf_counter *counter)
+{
+   if (perf_enable)
+      counter->start = rarch_get_time_usec();
+}
+
+void rarch_perf_stop(struct rarch_perf_counter *counter)
+{
+   // Counter might have been enabled between start and stop.
+   if (!perf_enable || !counter->start)
+      return;
+
+   rarch_time_t elapsed = rarch_get_time_usec() - counter->start;
+   counter->start = 0;
+   rarch_perf_add_sample(counter, elapsed);
+}
+
+void rarch_perf_add_sample(struct rarch_perf_counter *counter, rarch_time_t elapsed)
+{
+   counter->total += elapsed;
+   if (elapsed > counter->max)
+      counter->max = elapsed;
+
+   counter->samples[counter->sample_ptr] = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+   counter->sample_ptr = (counter->sample_ptr + 1) & (RARCH_PERF_WINDOW - 1);
+   counter->call_cnt++;
+}
+
+void rarch_perf_reset(void)
+{
+   for (unsigned i = 0; i < perf_num_counters; i++)
+   {
+      struct rarch_perf_counter *counter = perf_counters[i];
+      counter->start = 0;
+      counter->total = 0;
+      counter->max = 0;
+      counter->call_cnt = 0;
+      counter->sample_ptr = 0;
+   }
+}
+
+static int perf_sample_cmp(const void *a_, const void *b_)
+{
+   uint32_t a = *(const uint32_t*)a_;
+   uint32_t b = *(const uint32_t*)b_;
+   return a < b ? -1 : a > b;
+}
+
+uint32_t rarch_perf_percentile(const struct rarch_perf_counter *counter, unsigned percent)
+{
+   static uint32_t sorted[RARCH_PERF_WINDOW];
+
+   if (!counter->call_cnt)
+      return 0;
+   if (percent > 100)
+      percent = 100;
+
+   unsigned samples = counter->call_cnt < RARCH_PERF_WINDOW ? (unsigned)counter->call_cnt : RARCH_PERF_WINDOW;
+   memcpy(sorted, counter->samples, samples * sizeof(uint32_t));
+   qsort(sorted, samples, sizeof(uint32_t), perf_sample_cmp);
+
+   unsigned index = (samples * percent) / 100;
+   return sorted[index < samples ? index : samples - 1];
+}
+
+size_t rarch_perf_report(char *buf, size_t size)
+{
+   static uint32_t sorted[RARCH_PERF_WINDOW];
+   size_t written = 0;
+
+   if (size)
+      *buf = '\0';
+
+   for (unsigned i = 0; i < perf_num_counters; i++)
+   {
+      const struct rarch_perf_counter *counter = perf_counters[i];
+      if (!counter->call_cnt)
+         continue;
+
+      unsigned samples = counter->call_cnt < RARCH_PERF_WINDOW ? (unsigned)counter->call_cnt : RARCH_PERF_WINDOW;
+      memcpy(sorted, counter->samples, samples * sizeof(uint32_t));
+      qsort(sorted, samples, sizeof(uint32_t), perf_sample_cmp);
+
+      // Keeps counting once the buffer is full, like snprintf(), without pointing past its end.
+      int ret = snprintf(written < size ? buf + written : NULL, written < size ? size - written : 0,
+            "%-20s calls: %8llu, avg: %8.1f us, p50: %6u us, p99: %6u us, max: %8lld us\n",
+            counter->ident, (unsigned long long)counter->call_cnt,
+            (double)counter->total / counter->call_cnt,
+            (unsigned)sorted[samples / 2], (unsigned)sorted[(samples * 99) / 100],
+            (long long)counter->max);
+
+      if (ret > 0)
+         written += ret;
+   }
+
+   return written;
+}
+
+void rarch_perf_log(void)
+{
+   char buf[RARCH_PERF_MAX_COUNTERS * 128];
+   if (!rarch_perf_report(buf, sizeof(buf)))
+      return;
+
+   // Counters are opt-in, so report regardless of verbosity.
+   fprintf(stderr, "=== Performance counters ========================\n");
+   fputs(buf, stderr);
+   fprintf(stderr, "=================================================\n");
+   fflush(stderr);
+}
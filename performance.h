@@ -0,0 +1,97 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2012 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_PERFORMANCE_H
+#define __RARCH_PERFORMANCE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "boolean.h"
+
+// Values match RETRO_SIMD_* in libretro.h.
+#define RARCH_SIMD_SSE    (1 << 0)
+#define RARCH_SIMD_SSE2   (1 << 1)
+#define RARCH_SIMD_VMX    (1 << 2)
+#define RARCH_SIMD_VMX128 (1 << 3)
+#define RARCH_SIMD_AVX    (1 << 4)
+#define RARCH_SIMD_NEON   (1 << 5)
+#define RARCH_SIMD_SSE3   (1 << 6)
+#define RARCH_SIMD_SSSE3  (1 << 7)
+#define RARCH_SIMD_SSE4   (1 << 8)
+#define RARCH_SIMD_SSE42  (1 << 9)
+#define RARCH_SIMD_AVX2   (1 << 10)
+
+struct rarch_cpu_features
+{
+   unsigned simd;
+};
+
+// Queries the CPU at runtime. Only reports instruction sets the OS
+// has enabled as well, e.g. AVX requires the OS to save YMM state.
+void rarch_get_cpu_features(struct rarch_cpu_features *cpu);
+
+typedef int64_t rarch_time_t;
+
+// Monotonic time in microseconds. Only differences between two values are meaningful.
+rarch_time_t rarch_get_time_usec(void);
+
+// Number of most recent samples percentiles are calculated over.
+#define RARCH_PERF_WINDOW 1024
+
+// Times a section of code. Counters are expected to be statically allocated,
+// and must be registered before they show up in reports.
+struct rarch_perf_counter
+{
+   const char *ident;
+   rarch_time_t start;
+   rarch_time_t total;
+   rarch_time_t max;
+   uint64_t call_cnt;
+
+   // Ring buffer of the most recent samples, in microseconds.
+   uint32_t samples[RARCH_PERF_WINDOW];
+   unsigned sample_ptr;
+   bool registered;
+};
+
+void rarch_perf_register(struct rarch_perf_counter *counter);
+void rarch_perf_unregister(struct rarch_perf_counter *counter);
+
+// Counters only measure anything while enabled, so they can be left in hot paths.
+void rarch_perf_enable(bool enable);
+bool rarch_perf_enabled(void);
+
+void rarch_perf_start(struct rarch_perf_counter *counter);
+void rarch_perf_stop(struct rarch_perf_counter *counter);
+
+// Adds a sample timed by the caller. Recorded even when counters are disabled,
+// for code which relies on the statistics for more than reporting.
+void rarch_perf_add_sample(struct rarch_perf_counter *counter, rarch_time_t elapsed);
+
+// Percentile (0 - 100) of the most recent samples in microseconds. 0 if there are no samples.
+uint32_t rarch_perf_percentile(const struct rarch_perf_counter *counter, unsigned percent);
+
+// Clears statistics of all registered counters.
+void rarch_perf_reset(void);
+
+// Writes one line per registered counter with calls, average, p50, p99 and max.
+// Returns the number of characters written, like strlcpy().
+size_t rarch_perf_report(char *buf, size_t size);
+
+// Prints the report to stderr.
+void rarch_perf_log(void);
+
+#endif
+
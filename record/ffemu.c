@@ -158,7 +158,9 @@ static bool ffemu_init_audio(struct ff_audio_info *audio, struct ffemu_params *p
 static bool ffemu_init_video(struct ff_video_info *video, const struct ffemu_params *param)
 {
    AVCodec *codec = NULL;
-   if (g_settings.video.h264_record)
+   if (g_settings.video.h264_record && g_settings.video.yuv_record)
+      codec = avcodec_find_encoder_by_name("libx264");
+   else if (g_settings.video.h264_record)
    {
       codec = avcodec_find_encoder_by_name("libx264rgb");
       // Older versions of FFmpeg have RGB encoding in libx264.
@@ -194,7 +196,19 @@ static bool ffemu_init_video(struct ff_video_info *video, const struct ffemu_par
          return false;
    }
 
-   if (g_settings.video.h264_record)
+#ifdef HAVE_THREADS
+   video->scaler.threads = g_settings.video.scaler_threads ? g_settings.video.scaler_threads : sthread_get_cpu_cores();
+#else
+   video->scaler.threads = 1;
+#endif
+
+   if (g_settings.video.yuv_record)
+   {
+      // Planes are laid out back to back by avpicture_fill(), which is what the scaler expects.
+      video->pix_fmt = PIX_FMT_YUV420P;
+      video->scaler.out_fmt = SCALER_FMT_YUV420;
+   }
+   else if (g_settings.video.h264_record)
    {
       video->pix_fmt = PIX_FMT_BGR24;
       video->scaler.out_fmt = SCALER_FMT_BGR24;
@@ -30,6 +30,9 @@
 #include "movie.h"
 #include "compat/strl.h"
 #include "screenshot.h"
+#include "gfx/scaler/pixconv.h"
+#include "performance.h"
+#include "hash.h"
 #include "cheats.h"
 #include "compat/getopt_rarch.h"
 
@@ -72,6 +75,8 @@ static void set_fast_forward_button(bool new_button_state, bool new_hold_button_
 
    if (update_sync)
    {
+      g_extern.is_fast_forward = syncing_state;
+
       // Only apply non-block-state for video if we're using vsync.
       if (g_extern.video_active && g_settings.video.vsync && !g_extern.system.force_nonblock)
          video_set_nonblock_state_func(syncing_state);
@@ -88,6 +93,288 @@ static void set_fast_forward_button(bool new_button_state, bool new_hold_button_
    old_hold_button_state = new_hold_button_state;
 }
 
+// Main loop profiling, enabled with perfcnt_enable.
+// Counters for sections which run inside pretro_run() are included in core_run.
+static struct rarch_perf_counter perf_main_iterate  = { "main_iterate" };
+static struct rarch_perf_counter perf_state_checks  = { "state_checks" };
+static struct rarch_perf_counter perf_rewind_push   = { "rewind_push" };
+static struct rarch_perf_counter perf_autosave_lock = { "autosave_lock" };
+static struct rarch_perf_counter perf_netplay_pre   = { "netplay_pre_frame" };
+static struct rarch_perf_counter perf_core_run      = { "core_run" };
+static struct rarch_perf_counter perf_run_ahead     = { "run_ahead" };
+static struct rarch_perf_counter perf_netplay_post  = { "netplay_post_frame" };
+static struct rarch_perf_counter perf_video_frame   = { "video_frame" };
+static struct rarch_perf_counter perf_audio_flush   = { "audio_flush" };
+
+// Time from the start of a delayed frame until the core submits video.
+// Always sampled when frame delay is active, as it drives the delay.
+static struct rarch_perf_counter perf_frame_work    = { "frame_delay_work" };
+
+static void init_perf_counters(void)
+{
+   static struct rarch_perf_counter *counters[] = {
+      &perf_main_iterate,
+      &perf_state_checks,
+      &perf_rewind_push,
+      &perf_autosave_lock,
+      &perf_netplay_pre,
+      &perf_core_run,
+      &perf_run_ahead,
+      &perf_netplay_post,
+      &perf_video_frame,
+      &perf_audio_flush,
+      &perf_frame_work,
+   };
+
+   for (unsigned i = 0; i < sizeof(counters) / sizeof(counters[0]); i++)
+      rarch_perf_register(counters[i]);
+
+   rarch_perf_reset();
+   rarch_perf_enable(g_settings.perfcnt_enable);
+}
+
+// Frame delay. Sleeps after the previous frame has been presented,
+// so input is polled as late as possible before the next one.
+#define FRAME_DELAY_MARGIN_USEC 2000
+#define FRAME_DELAY_TUNE_FRAMES 64
+
+static struct
+{
+   unsigned delay; // Current delay in ms.
+   unsigned hold;  // Frames left before the delay is allowed to grow again.
+   unsigned frames;
+   rarch_time_t frame_start;
+   bool submitted;
+} frame_delay;
+
+static bool frame_delay_active(void)
+{
+   return (g_settings.video.frame_delay || g_settings.video.frame_delay_auto) &&
+      g_settings.video.vsync && !g_extern.system.force_nonblock &&
+      !g_extern.is_fast_forward && !g_extern.is_slowmotion &&
+      !g_extern.is_paused && // Frame advance runs single frames while paused.
+      g_settings.video.refresh_rate > 0.0f;
+}
+
+// Delay the core run time allows for, in ms.
+static unsigned frame_delay_target(rarch_time_t budget)
+{
+   if (!g_settings.video.frame_delay_auto)
+      return g_settings.video.frame_delay;
+
+   rarch_time_t work = rarch_perf_percentile(&perf_frame_work, 95);
+   rarch_time_t slack = budget - work - FRAME_DELAY_MARGIN_USEC;
+   return slack > 0 ? (unsigned)(slack / 1000) : 0;
+}
+
+static void frame_delay_wait(void)
+{
+   if (!frame_delay_active())
+   {
+      frame_delay.frame_start = 0;
+      return;
+   }
+
+   if (frame_delay.delay)
+      rarch_sleep(frame_delay.delay);
+
+   rarch_time_t budget = (rarch_time_t)(1000000.0f / g_settings.video.refresh_rate);
+   rarch_time_t now = rarch_get_time_usec();
+
+   // Frames start a fixed time after VSync, so an interval notably longer than
+   // the refresh period means the previous frame was not ready in time.
+   if (frame_delay.frame_start && now - frame_delay.frame_start > budget + budget / 2 && frame_delay.delay)
+   {
+      frame_delay.delay = frame_delay.delay > 2 ? frame_delay.delay - 2 : 0;
+      frame_delay.hold = (unsigned)g_settings.video.refresh_rate;
+      RARCH_LOG("Frame budget missed, reducing frame delay to %u ms.\n", frame_delay.delay);
+   }
+   else if (frame_delay.hold)
+      frame_delay.hold--;
+   else if (++frame_delay.frames >= FRAME_DELAY_TUNE_FRAMES || !frame_delay.frame_start)
+   {
+      frame_delay.frames = 0;
+
+      unsigned target = frame_delay_target(budget);
+      if (target < frame_delay.delay)
+         frame_delay.delay = target;
+      else if (target > frame_delay.delay && frame_delay.frame_start) // Grow carefully, as misses are costly.
+         frame_delay.delay++;
+      else if (target > frame_delay.delay)
+         frame_delay.delay = g_settings.video.frame_delay_auto ? 1 : target;
+   }
+
+   frame_delay.frame_start = now;
+   frame_delay.submitted = false;
+}
+
+// Called when video is submitted, to measure how long the core needs to produce a frame.
+static void frame_delay_video_submitted(void)
+{
+   if (!frame_delay.frame_start || frame_delay.submitted)
+      return;
+
+   rarch_perf_add_sample(&perf_frame_work, rarch_get_time_usec() - frame_delay.frame_start);
+   frame_delay.submitted = true;
+}
+
+// Decides whether the coming frame is presented while fast-forwarding,
+// so that fast-forward speed is bound by the core rather than the video driver.
+static void fast_forward_frame_skip(void)
+{
+   static unsigned count;
+   static rarch_time_t last_present;
+
+   g_extern.is_frame_skipped = false;
+
+   bool skip_allowed = g_extern.is_fast_forward;
+#ifdef HAVE_FFMPEG
+   // Recording wants every frame.
+   skip_allowed &= !g_extern.recording;
+#endif
+
+   if (!skip_allowed)
+   {
+      count = 0;
+      last_present = 0;
+      return;
+   }
+
+   unsigned frameskip = g_settings.video.fastforward_frameskip;
+   if (frameskip)
+   {
+      g_extern.is_frame_skipped = count != 0;
+      count = (count + 1) % frameskip;
+   }
+   else if (g_settings.video.refresh_rate > 0.0f)
+   {
+      rarch_time_t now = rarch_get_time_usec();
+      if (now - last_present < (rarch_time_t)(1000000.0f / g_settings.video.refresh_rate))
+         g_extern.is_frame_skipped = true;
+      else
+         last_present = now;
+   }
+}
+
+// Benchmark mode (--benchmark). Runs the core for a fixed number of frames
+// as fast as possible and reports throughput on exit.
+static struct
+{
+   rarch_time_t *frame_times;
+   unsigned frame_count;
+   rarch_time_t start_time;
+   rarch_time_t last_time;
+} benchmark;
+
+// Overrides config so that nothing throttles the main loop.
+static void benchmark_apply_settings(void)
+{
+   if (!g_extern.benchmark_frames)
+      return;
+
+   // Presentation is skipped unless headless is explicitly configured,
+   // as it does not present to a display either.
+   if (strcmp(g_settings.video.driver, "headless") != 0)
+      strlcpy(g_settings.video.driver, "null", sizeof(g_settings.video.driver));
+   strlcpy(g_settings.audio.driver, "null", sizeof(g_settings.audio.driver));
+   strlcpy(g_settings.input.driver, "null", sizeof(g_settings.input.driver));
+
+   g_settings.video.vsync = false;
+   g_settings.audio.sync = false;
+   g_settings.audio.rate_control = false;
+
+   // Benchmarking should not have side effects on save data.
+   g_settings.savestate_auto_save = false;
+   g_extern.sram_save_disable = true;
+
+   RARCH_LOG("Benchmarking %u frames.\n", g_extern.benchmark_frames);
+}
+
+static void init_benchmark(void)
+{
+   if (!g_extern.benchmark_frames)
+      return;
+
+   benchmark.frame_times = (rarch_time_t*)calloc(g_extern.benchmark_frames, sizeof(rarch_time_t));
+   if (!benchmark.frame_times)
+   {
+      RARCH_ERR("Failed to allocate benchmark frame times.\n");
+      g_extern.benchmark_frames = 0;
+      return;
+   }
+
+   benchmark.frame_count = 0;
+   benchmark.start_time = benchmark.last_time = rarch_get_time_usec();
+}
+
+static int benchmark_time_cmp(const void *a_, const void *b_)
+{
+   rarch_time_t a = *(const rarch_time_t*)a_;
+   rarch_time_t b = *(const rarch_time_t*)b_;
+   return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static double benchmark_percentile(const rarch_time_t *times, unsigned count, unsigned percent)
+{
+   unsigned index = (unsigned)(((uint64_t)count * percent + 99) / 100);
+   if (index > 0)
+      index--;
+   return times[index] / 1000.0;
+}
+
+static void benchmark_report(void)
+{
+   rarch_time_t total = benchmark.last_time - benchmark.start_time;
+   unsigned count = benchmark.frame_count;
+
+   uint32_t state_crc = 0;
+   size_t state_size = pretro_serialize_size();
+   void *state = state_size ? malloc(state_size) : NULL;
+   bool has_state = state && pretro_serialize(state, state_size);
+   if (has_state)
+      state_crc = crc32_calculate((const uint8_t*)state, state_size);
+   free(state);
+
+   qsort(benchmark.frame_times, count, sizeof(rarch_time_t), benchmark_time_cmp);
+
+   printf("=== Benchmark ===\n");
+   printf("Frames:     %u\n", count);
+   printf("Time:       %.3f s\n", total / 1000000.0);
+   printf("FPS:        %.2f\n", total > 0 ? count * 1000000.0 / total : 0.0);
+   printf("Frame time: avg %.3f ms, p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+         total / (1000.0 * count),
+         benchmark_percentile(benchmark.frame_times, count, 50),
+         benchmark_percentile(benchmark.frame_times, count, 90),
+         benchmark_percentile(benchmark.frame_times, count, 99),
+         benchmark.frame_times[count - 1] / 1000.0);
+   if (has_state)
+      printf("State:      CRC32 0x%08x (%u bytes)\n", (unsigned)state_crc, (unsigned)state_size);
+   else
+      printf("State:      N/A (core does not support serialization)\n");
+   printf("=================\n");
+   fflush(stdout);
+}
+
+// Returns true when the requested number of frames has been run.
+static bool benchmark_frame(void)
+{
+   rarch_time_t now = rarch_get_time_usec();
+   benchmark.frame_times[benchmark.frame_count++] = now - benchmark.last_time;
+   benchmark.last_time = now;
+
+   if (benchmark.frame_count < g_extern.benchmark_frames)
+      return false;
+
+   benchmark_report();
+   return true;
+}
+
+static void deinit_benchmark(void)
+{
+   free(benchmark.frame_times);
+   memset(&benchmark, 0, sizeof(benchmark));
+}
+
 #if defined(HAVE_SCREENSHOTS) && !defined(_XBOX)
 static bool take_screenshot_viewport(void)
 {
@@ -110,7 +397,7 @@ static bool take_screenshot_viewport(void)
    // Data read from viewport is in bottom-up order, suitable for BMP.
    if (!screenshot_dump(g_settings.screenshot_directory,
          buffer,
-         width, height, width * 3, true))
+         width, height, width * 3, SCREENSHOT_FORMAT_BGR24))
    {
       free(buffer);
       return false;
@@ -122,16 +409,17 @@ static bool take_screenshot_viewport(void)
 
 static bool take_screenshot_raw(void)
 {
-   const uint16_t *data = (const uint16_t*)g_extern.frame_cache.data;
-   unsigned width       = g_extern.frame_cache.width;
-   unsigned height      = g_extern.frame_cache.height;
-   int pitch            = g_extern.frame_cache.pitch;
+   const uint8_t *data = (const uint8_t*)g_extern.frame_cache.data;
+   unsigned width      = g_extern.frame_cache.width;
+   unsigned height     = g_extern.frame_cache.height;
+   int pitch           = g_extern.frame_cache.pitch;
 
    // Negative pitch is needed as screenshot takes bottom-up,
    // but we use top-down.
    return screenshot_dump(g_settings.screenshot_directory,
-         data + (height - 1) * (pitch >> 1), 
-         width, height, -pitch, false);
+         data + (height - 1) * pitch, 
+         width, height, -pitch,
+         g_extern.system.rgb32 ? SCREENSHOT_FORMAT_XRGB8888 : SCREENSHOT_FORMAT_0RGB1555);
 }
 
 static void take_screenshot(void)
@@ -149,8 +437,8 @@ static void take_screenshot(void)
    const char *msg = NULL;
    if (ret)
    {
-      RARCH_LOG("Taking screenshot.\n");
-      msg = "Taking screenshot.";
+      RARCH_LOG("Screenshot queued.\n");
+      msg = "Screenshot queued.";
    }
    else
    {
@@ -246,6 +534,89 @@ static void recording_dump_frame(const void *data, unsigned width, unsigned heig
 }
 #endif
 
+#ifdef HAVE_DYLIB
+struct filter_slice_data
+{
+   const void *input;
+   size_t pitch;
+   unsigned width;
+   unsigned height;
+};
+
+// Renders the output belonging to one horizontal band of the frame.
+// Called from every thread in the filter pool.
+static void filter_render_slice(void *data, unsigned index, unsigned count)
+{
+   const struct filter_slice_data *slice = (const struct filter_slice_data*)data;
+
+   unsigned first_line = (slice->height * index) / count;
+   unsigned last_line  = (slice->height * (index + 1)) / count;
+   if (first_line == last_line)
+      return;
+
+   if (g_extern.filter.prender_xrgb8888)
+   {
+      g_extern.filter.prender_xrgb8888(g_extern.filter.buffer, g_extern.filter.pitch,
+            (const uint32_t*)slice->input, slice->pitch, slice->width, slice->height,
+            first_line, last_line);
+   }
+   else
+   {
+      g_extern.filter.prender_slice(g_extern.filter.colormap, g_extern.filter.buffer,
+            g_extern.filter.pitch, (const uint16_t*)slice->input, slice->pitch,
+            slice->width, slice->height, first_line, last_line);
+   }
+}
+
+// Converts one horizontal band of a 0RGB1555 frame to XRGB8888 for API version 2 filters.
+static void filter_convert_slice(void *data, unsigned index, unsigned count)
+{
+   const struct filter_slice_data *slice = (const struct filter_slice_data*)data;
+
+   unsigned first_line = (slice->height * index) / count;
+   unsigned last_line  = (slice->height * (index + 1)) / count;
+   if (first_line == last_line)
+      return;
+
+   conv_0rgb1555_argb8888(
+         (uint8_t*)g_extern.filter.conv_buffer + first_line * g_extern.filter.conv_pitch,
+         (const uint8_t*)slice->input + first_line * slice->pitch,
+         slice->width, last_line - first_line,
+         g_extern.filter.conv_pitch, slice->pitch);
+}
+
+static void filter_render(const void *data, unsigned width, unsigned height, size_t pitch)
+{
+   struct filter_slice_data slice = { data, pitch, width, height };
+
+   if (g_extern.filter.prender_xrgb8888 && !g_extern.system.rgb32)
+   {
+#ifdef HAVE_THREADS
+      if (g_extern.filter.pool)
+         sthread_pool_run(g_extern.filter.pool, filter_convert_slice, &slice);
+      else
+#endif
+         filter_convert_slice(&slice, 0, 1);
+
+      slice.input = g_extern.filter.conv_buffer;
+      slice.pitch = g_extern.filter.conv_pitch;
+   }
+
+#ifdef HAVE_THREADS
+   if (g_extern.filter.pool)
+      sthread_pool_run(g_extern.filter.pool, filter_render_slice, &slice);
+   else
+#endif
+   if (g_extern.filter.prender_xrgb8888)
+      filter_render_slice(&slice, 0, 1);
+   else
+   {
+      g_extern.filter.prender(g_extern.filter.colormap, g_extern.filter.buffer, 
+            g_extern.filter.pitch, (const uint16_t*)data, pitch, width, height);
+   }
+}
+#endif
+
 static void video_frame(const void *data, unsigned width, unsigned height, size_t pitch)
 {
 #ifndef RARCH_CONSOLE
@@ -253,6 +624,19 @@ static void video_frame(const void *data, unsigned width, unsigned height, size_
       return;
 #endif
 
+   if (g_extern.is_frame_skipped)
+   {
+      // Treated as a dupe, but keep the latest frame around in case it needs to be shown.
+      g_extern.frame_cache.data   = data;
+      g_extern.frame_cache.width  = width;
+      g_extern.frame_cache.height = height;
+      g_extern.frame_cache.pitch  = pitch;
+      return;
+   }
+
+   rarch_perf_start(&perf_video_frame);
+   frame_delay_video_submitted();
+
    // Slightly messy code,
    // but we really need to do processing before blocking on VSync for best possible scheduling.
 #ifdef HAVE_FFMPEG
@@ -260,7 +644,7 @@ static void video_frame(const void *data, unsigned width, unsigned height, size_
       recording_dump_frame(data, width, height, pitch);
 #endif
 
-   const char *msg = msg_queue_pull(g_extern.msg_queue);
+   const char *msg = msg_queue_pull_id(g_extern.msg_queue, &g_extern.msg_id);
 
 #ifdef HAVE_DYLIB
    if (g_extern.filter.active && data)
@@ -268,8 +652,7 @@ static void video_frame(const void *data, unsigned width, unsigned height, size_
       unsigned owidth = width;
       unsigned oheight = height;
       g_extern.filter.psize(&owidth, &oheight);
-      g_extern.filter.prender(g_extern.filter.colormap, g_extern.filter.buffer, 
-            g_extern.filter.pitch, (const uint16_t*)data, pitch, width, height);
+      filter_render(data, width, height, pitch);
 
 #ifdef HAVE_FFMPEG
       if (g_extern.recording && g_settings.video.post_filter_record)
@@ -290,6 +673,8 @@ static void video_frame(const void *data, unsigned width, unsigned height, size_
    g_extern.frame_cache.width  = width;
    g_extern.frame_cache.height = height;
    g_extern.frame_cache.pitch  = pitch;
+
+   rarch_perf_stop(&perf_video_frame);
 }
 
 void rarch_render_cached_frame(void)
@@ -449,30 +834,112 @@ size_t audio_sample_batch_rewind(const int16_t *data, size_t frames)
 
 static void audio_sample(int16_t left, int16_t right)
 {
+   if (g_extern.is_frame_skipped)
+      return;
+
    g_extern.audio_data.conv_outsamples[g_extern.audio_data.data_ptr++] = left;
    g_extern.audio_data.conv_outsamples[g_extern.audio_data.data_ptr++] = right;
 
    if (g_extern.audio_data.data_ptr < g_extern.audio_data.chunk_size)
       return;
 
+   rarch_perf_start(&perf_audio_flush);
    g_extern.audio_active = audio_flush(g_extern.audio_data.conv_outsamples,
          g_extern.audio_data.data_ptr) && g_extern.audio_active;
+   rarch_perf_stop(&perf_audio_flush);
 
    g_extern.audio_data.data_ptr = 0;
 }
 
 size_t audio_sample_batch(const int16_t *data, size_t frames)
 {
+   if (g_extern.is_frame_skipped)
+      return frames;
+
    if (frames > (AUDIO_CHUNK_SIZE_NONBLOCKING >> 1))
       frames = AUDIO_CHUNK_SIZE_NONBLOCKING >> 1;
 
+   rarch_perf_start(&perf_audio_flush);
    g_extern.audio_active = audio_flush(data, frames << 1) && g_extern.audio_active;
+   rarch_perf_stop(&perf_audio_flush);
    return frames;
 }
 
+// Input state of a port as seen by the core since the last poll.
+// Every input is fetched from the driver at most once per poll, so cores
+// that query input many times per frame do not pay for keybind resolution each time.
+#define INPUT_CACHE_ANALOG   0
+#define INPUT_CACHE_MOUSE    4
+#define INPUT_CACHE_LIGHTGUN 8
+#define INPUT_CACHE_SLOTS    15
+
+struct input_cache
+{
+   uint16_t joypad; // Button bitmask.
+   uint16_t joypad_valid;
+   uint16_t valid;
+   int16_t values[INPUT_CACHE_SLOTS];
+};
+
+static struct input_cache input_cache[MAX_PLAYERS];
+
 static void input_poll(void)
 {
    input_poll_func();
+   memset(input_cache, 0, sizeof(input_cache));
+}
+
+static int16_t input_state_cached(const struct retro_keybind **binds,
+      unsigned port, unsigned device, unsigned index, unsigned id)
+{
+   if (port >= MAX_PLAYERS)
+      return input_input_state_func(binds, port, device, index, id);
+
+   struct input_cache *cache = &input_cache[port];
+   unsigned slot;
+
+   switch (device)
+   {
+      case RETRO_DEVICE_JOYPAD:
+         if (id >= RARCH_FIRST_ANALOG_BIND)
+            return input_input_state_func(binds, port, device, index, id);
+
+         if (!(cache->joypad_valid & (1 << id)))
+         {
+            if (input_input_state_func(binds, port, device, index, id))
+               cache->joypad |= 1 << id;
+            cache->joypad_valid |= 1 << id;
+         }
+         return (cache->joypad >> id) & 1;
+
+      case RETRO_DEVICE_ANALOG:
+         if (index > RETRO_DEVICE_INDEX_ANALOG_RIGHT || id > RETRO_DEVICE_ID_ANALOG_Y)
+            return input_input_state_func(binds, port, device, index, id);
+         slot = INPUT_CACHE_ANALOG + (index << 1) + id;
+         break;
+
+      case RETRO_DEVICE_MOUSE:
+         if (id > RETRO_DEVICE_ID_MOUSE_RIGHT)
+            return input_input_state_func(binds, port, device, index, id);
+         slot = INPUT_CACHE_MOUSE + id;
+         break;
+
+      case RETRO_DEVICE_LIGHTGUN:
+         if (id > RETRO_DEVICE_ID_LIGHTGUN_START)
+            return input_input_state_func(binds, port, device, index, id);
+         slot = INPUT_CACHE_LIGHTGUN + id;
+         break;
+
+      default: // Keyboard is keyed on a large ID space, and is not worth caching.
+         return input_input_state_func(binds, port, device, index, id);
+   }
+
+   if (!(cache->valid & (1 << slot)))
+   {
+      cache->values[slot] = input_input_state_func(binds, port, device, index, id);
+      cache->valid |= 1 << slot;
+   }
+   return cache->values[slot];
 }
 
 static int16_t input_state(unsigned port, unsigned device, unsigned index, unsigned id)
@@ -503,7 +970,7 @@ static int16_t input_state(unsigned port, unsigned device, unsigned index, unsig
 
    int16_t res = 0;
    if (id < RARCH_FIRST_META_KEY || device == RETRO_DEVICE_KEYBOARD)
-      res = input_input_state_func(binds, port, device, index, id);
+      res = input_state_cached(binds, port, device, index, id);
 
 #ifdef HAVE_BSV_MOVIE
    if (g_extern.bsv.movie && !g_extern.bsv.movie_playback)
@@ -629,6 +1096,8 @@ static void print_help(void)
    puts("\t\tHost can live stream the game content to players that connect.");
    puts("\t\tHowever, the client will not be able to play. Multiple clients can connect to the host.");
    puts("\t--nick: Picks a nickname for use with netplay. Not mandatory.");
+   puts("\t--relay: Spectate the host given by --connect and pass the stream on");
+   puts("\t\tto spectators connecting on this port. Needs --connect and --spectate.");
 #endif
 #ifdef HAVE_NETWORK_CMD
    puts("\t--command: Sends a command over UDP to an already running RetroArch process.");
@@ -645,6 +1114,10 @@ static void print_help(void)
    puts("\t--ips: Specifies path for IPS patch that will be applied to ROM.");
    puts("\t--no-patch: Disables all forms of rom patching.");
    puts("\t-X/--xml: Specifies path to XML memory map.");
+   puts("\t--benchmark: Runs the game for the given number of frames as fast as possible, then exits.");
+   puts("\t\tVsync and audio sync are disabled, and video, audio and input use null drivers");
+   puts("\t\t(headless video is kept if configured). Combine with -P/--bsvplay for deterministic input.");
+   puts("\t\tReports frames per second, frame time percentiles and a hash of the final state.");
    puts("\t-D/--detach: Detach RetroArch from the running console. Not relevant for all platforms.\n");
 }
 
@@ -793,6 +1266,7 @@ static void parse_input(int argc, char *argv[])
       { "port", 1, &val, 'p' },
       { "spectate", 0, &val, 'S' },
       { "nick", 1, &val, 'N' },
+      { "relay", 1, &val, 'r' },
 #endif
 #ifdef HAVE_NETWORK_CMD
       { "command", 1, &val, 'c' },
@@ -804,6 +1278,7 @@ static void parse_input(int argc, char *argv[])
       { "xml", 1, NULL, 'X' },
       { "detach", 0, NULL, 'D' },
       { "features", 0, &val, 'f' },
+      { "benchmark", 1, &val, 'b' },
       { NULL, 0, NULL, 0 }
    };
 
@@ -1037,6 +1512,10 @@ static void parse_input(int argc, char *argv[])
                case 'N':
                   strlcpy(g_extern.netplay_nick, optarg, sizeof(g_extern.netplay_nick));
                   break;
+
+               case 'r':
+                  g_extern.netplay_relay_port = strtoul(optarg, NULL, 0);
+                  break;
 #endif
 
 #ifdef HAVE_NETWORK_CMD
@@ -1090,6 +1569,20 @@ static void parse_input(int argc, char *argv[])
                   print_features();
                   exit(0);
 
+               case 'b':
+               {
+                  char *ptr;
+                  long frames = strtol(optarg, &ptr, 0);
+                  if (*ptr != '\0' || frames <= 0)
+                  {
+                     RARCH_ERR("Invalid frame count for --benchmark.\n");
+                     print_help();
+                     rarch_fail(1, "parse_input()");
+                  }
+                  g_extern.benchmark_frames = frames;
+                  break;
+               }
+
                default:
                   break;
             }
@@ -1105,6 +1598,16 @@ static void parse_input(int argc, char *argv[])
       }
    }
 
+#ifdef HAVE_NETPLAY
+   // A relay is a spectator passing the stream on, so it makes no sense without both.
+   if (g_extern.netplay_relay_port && (!*g_extern.netplay_server || !g_extern.netplay_is_spectate))
+   {
+      RARCH_ERR("--relay needs both --connect and --spectate.\n");
+      print_help();
+      rarch_fail(1, "parse_input()");
+   }
+#endif
+
    if (optind < argc)
       set_paths(argv[optind]);
    else
@@ -1407,6 +1910,139 @@ static void deinit_rewind(void)
       free(g_extern.state_buf);
 }
 
+static void init_run_ahead(void)
+{
+   if (!g_settings.run_ahead_frames)
+      return;
+
+#ifdef HAVE_NETPLAY
+   if (g_extern.netplay)
+   {
+      RARCH_WARN("Run-ahead cannot be used with netplay. Run-ahead will be disabled.\n");
+      return;
+   }
+#endif
+
+   g_extern.runahead_size = pretro_serialize_size();
+   if (!g_extern.runahead_size)
+   {
+      RARCH_WARN("Core does not support save states. Run-ahead will be disabled.\n");
+      return;
+   }
+
+   g_extern.runahead_buf = malloc(g_extern.runahead_size);
+   if (!g_extern.runahead_buf)
+   {
+      RARCH_ERR("Failed to allocate memory for run-ahead.\n");
+      g_extern.runahead_size = 0;
+      return;
+   }
+
+   RARCH_LOG("Running %u frame(s) ahead.\n", g_settings.run_ahead_frames);
+}
+
+static void deinit_run_ahead(void)
+{
+   free(g_extern.runahead_buf);
+   g_extern.runahead_buf  = NULL;
+   g_extern.runahead_size = 0;
+}
+
+static void video_frame_null(const void *data, unsigned width, unsigned height, size_t pitch)
+{
+   (void)data;
+   (void)width;
+   (void)height;
+   (void)pitch;
+}
+
+static void audio_sample_null(int16_t left, int16_t right)
+{
+   (void)left;
+   (void)right;
+}
+
+static size_t audio_sample_batch_null(const int16_t *data, size_t frames)
+{
+   (void)data;
+   return frames;
+}
+
+static bool run_ahead_active(void)
+{
+   if (!g_extern.runahead_buf || g_extern.frame_is_reverse)
+      return false;
+
+#ifdef HAVE_BSV_MOVIE
+   // Frames run ahead would be recorded to or consume input from the movie.
+   if (g_extern.bsv.movie)
+      return false;
+#endif
+
+   return true;
+}
+
+// Runs the real frame with its audio but without presenting it,
+// then runs ahead of it and presents the last frame ahead.
+// The state of the real frame is restored afterwards.
+static void run_ahead_frame(void)
+{
+   pretro_set_video_refresh(video_frame_null);
+   pretro_run();
+
+   rarch_perf_start(&perf_run_ahead);
+
+   // Serialization size is allowed to change over time.
+   size_t size = pretro_serialize_size();
+   if (size > g_extern.runahead_size)
+   {
+      void *buf = realloc(g_extern.runahead_buf, size);
+      if (!buf)
+      {
+         RARCH_ERR("Failed to grow run-ahead buffer. Run-ahead will be disabled.\n");
+         pretro_set_video_refresh(video_frame);
+         deinit_run_ahead();
+         rarch_perf_stop(&perf_run_ahead);
+         return;
+      }
+      g_extern.runahead_buf  = buf;
+      g_extern.runahead_size = size;
+   }
+
+   if (!pretro_serialize(g_extern.runahead_buf, size))
+   {
+      RARCH_WARN("Failed to serialize state. Run-ahead will be disabled.\n");
+      pretro_set_video_refresh(video_frame);
+      deinit_run_ahead();
+      rarch_perf_stop(&perf_run_ahead);
+      return;
+   }
+
+   pretro_set_audio_sample(audio_sample_null);
+   pretro_set_audio_sample_batch(audio_sample_batch_null);
+
+   for (unsigned i = 1; i <= g_settings.run_ahead_frames; i++)
+   {
+      if (i == g_settings.run_ahead_frames)
+         pretro_set_video_refresh(video_frame);
+      pretro_run();
+   }
+
+   bool restored = pretro_unserialize(g_extern.runahead_buf, size);
+
+   pretro_set_audio_sample(audio_sample);
+   pretro_set_audio_sample_batch(audio_sample_batch);
+
+   // The core is left in the state of the last frame ahead, so keep running from there.
+   if (!restored)
+   {
+      RARCH_ERR("Failed to restore state after running ahead. Run-ahead will be disabled.\n");
+      deinit_run_ahead();
+   }
+
+   rarch_perf_stop(&perf_run_ahead);
+}
+
 #ifdef HAVE_BSV_MOVIE
 static void init_movie(void)
 {
@@ -1485,7 +2121,7 @@ static void init_netplay(void)
    g_extern.netplay = netplay_new(g_extern.netplay_is_client ? g_extern.netplay_server : NULL,
          g_extern.netplay_port ? g_extern.netplay_port : RARCH_DEFAULT_PORT,
          g_extern.netplay_sync_frames, &cbs, g_extern.netplay_is_spectate,
-         g_extern.netplay_nick);
+         g_extern.netplay_relay_port, g_extern.netplay_nick);
 
    if (!g_extern.netplay)
    {
@@ -2059,8 +2695,10 @@ static void check_rewind(void)
       if (cnt == 0)
 #endif
       {
+         rarch_perf_start(&perf_rewind_push);
          pretro_serialize(g_extern.state_buf, g_extern.state_size);
          state_manager_push(g_extern.state_manager, g_extern.state_buf);
+         rarch_perf_stop(&perf_rewind_push);
       }
    }
 
@@ -2390,6 +3028,9 @@ static void do_state_checks(void)
 #if defined(HAVE_SCREENSHOTS) && !defined(_XBOX)
    check_screenshot();
 #endif
+#ifdef HAVE_SCREENSHOTS
+   screenshot_poll();
+#endif
 #ifndef RARCH_CONSOLE
    check_mute();
 #endif
@@ -2533,6 +3174,8 @@ int rarch_main_init(int argc, char *argv[])
    }
 
    config_load();
+   benchmark_apply_settings();
+   init_perf_counters();
 
    init_libretro_sym();
    init_system_info();
@@ -2580,6 +3223,8 @@ int rarch_main_init(int argc, char *argv[])
    if (!g_extern.netplay)
 #endif
       init_rewind();
+
+   init_run_ahead();
       
    init_libretro_cbs();
    init_controllers();
@@ -2613,6 +3258,8 @@ int rarch_main_init(int argc, char *argv[])
       init_cheats();
 #endif
 
+   init_benchmark();
+
    g_extern.error_in_init = false;
    return 0;
 
@@ -2627,6 +3274,8 @@ error:
 
 bool rarch_main_iterate(void)
 {
+   rarch_perf_start(&perf_main_iterate);
+
 #ifdef HAVE_DYLIB
    // DSP plugin GUI events.
    if (g_extern.audio_data.dsp_handle && g_extern.audio_data.dsp_plugin->events)
@@ -2653,42 +3302,94 @@ bool rarch_main_iterate(void)
 #endif
 
    // Checks for stuff like fullscreen, save states, etc.
+   rarch_perf_start(&perf_state_checks);
    do_state_checks();
+   rarch_perf_stop(&perf_state_checks);
+
+   // An interval spanning a pause says nothing about the frame budget.
+   if (g_extern.is_paused)
+      frame_delay.frame_start = 0;
 
    // Run libretro for one frame.
 #ifndef RARCH_CONSOLE // On consoles pausing is handled better elsewhere.
    if (!g_extern.is_paused || g_extern.is_oneshot)
 #endif
    {
+      frame_delay_wait();
+      fast_forward_frame_skip();
+
 #ifdef HAVE_THREADS
+      rarch_perf_start(&perf_autosave_lock);
       lock_autosave();
+      rarch_perf_stop(&perf_autosave_lock);
 #endif
 
+      bool benchmark_done = false;
+
 #ifdef HAVE_NETPLAY
+      // Netplay might have to wait for the other side. The frame is then retried on the next iteration.
+      bool netplay_ready = true;
       if (g_extern.netplay)
-         netplay_pre_frame(g_extern.netplay);
-#endif
+      {
+         rarch_perf_start(&perf_netplay_pre);
+         netplay_ready = netplay_pre_frame(g_extern.netplay);
+         rarch_perf_stop(&perf_netplay_pre);
+      }
 
+      if (netplay_ready)
+#endif
+      {
 #ifdef HAVE_BSV_MOVIE
-      if (g_extern.bsv.movie)
-         bsv_movie_set_frame_start(g_extern.bsv.movie);
+         if (g_extern.bsv.movie)
+            bsv_movie_set_frame_start(g_extern.bsv.movie);
 #endif
 
-      pretro_run();
+         rarch_perf_start(&perf_core_run);
+         // A frame that is not presented gains nothing from running ahead.
+         if (run_ahead_active() && !g_extern.is_frame_skipped)
+            run_ahead_frame();
+         else
+            pretro_run();
+         rarch_perf_stop(&perf_core_run);
 
 #ifdef HAVE_BSV_MOVIE
-      if (g_extern.bsv.movie)
-         bsv_movie_set_frame_end(g_extern.bsv.movie);
+         if (g_extern.bsv.movie)
+            bsv_movie_set_frame_end(g_extern.bsv.movie);
 #endif
 
 #ifdef HAVE_NETPLAY
-      if (g_extern.netplay)
-         netplay_post_frame(g_extern.netplay);
+         if (g_extern.netplay)
+         {
+            rarch_perf_start(&perf_netplay_post);
+            netplay_post_frame(g_extern.netplay);
+            rarch_perf_stop(&perf_netplay_post);
+         }
+#endif
+
+         benchmark_done = g_extern.benchmark_frames && benchmark_frame();
+      }
+
+      // Frames rendered outside pretro_run(), e.g. while paused, are always shown.
+      g_extern.is_frame_skipped = false;
+
+#ifdef HAVE_NETPLAY
+      // Keeps presenting while netplay waits for the other side, instead of freezing the screen.
+      if (!netplay_ready)
+      {
+         msg_queue_push(g_extern.msg_queue, "Waiting for other player ...", 1, 1);
+         rarch_render_cached_frame();
+      }
 #endif
 
 #ifdef HAVE_THREADS
       unlock_autosave();
 #endif
+
+      if (benchmark_done)
+      {
+         rarch_perf_stop(&perf_main_iterate);
+         return false;
+      }
    }
 #ifndef RARCH_CONSOLE
    else
@@ -2698,11 +3399,17 @@ bool rarch_main_iterate(void)
    }
 #endif
 
+   rarch_perf_stop(&perf_main_iterate);
    return true;
 }
 
 void rarch_main_deinit(void)
 {
+   if (rarch_perf_enabled())
+      rarch_perf_log();
+
+   deinit_benchmark();
+
 #ifdef HAVE_NETPLAY
    deinit_netplay();
 #endif
@@ -2726,6 +3433,7 @@ void rarch_main_deinit(void)
    if (!g_extern.netplay)
 #endif
       deinit_rewind();
+   deinit_run_ahead();
 
 #ifdef HAVE_XML
    deinit_cheats();
@@ -2735,6 +3443,10 @@ void rarch_main_deinit(void)
    deinit_movie();
 #endif
 
+#ifdef HAVE_SCREENSHOTS
+   screenshot_deinit();
+#endif
+
    save_auto_state();
 
    pretro_unload_game();
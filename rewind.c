@@ -121,14 +121,21 @@ bool state_manager_pop(state_manager_t *state, void **data)
       return false;
    }
 
+   // Walk back to the sentinel in front of this delta.
+   size_t newest = state->top_ptr;
    while (state->buffer[state->top_ptr])
-   {
-      // Apply the xor patch.
-      uint32_t addr = state->buffer[state->top_ptr] >> 32;
-      uint32_t xor_ = state->buffer[state->top_ptr] & 0xFFFFFFFFU;
-      state->tmp_state[addr] ^= xor_;
-
       state->top_ptr = (state->top_ptr - 1) & state->buf_size_mask;
+
+   // Apply the xor patch. It might wrap around the end of the buffer.
+   size_t start = (state->top_ptr + 1) & state->buf_size_mask;
+   size_t entries = (newest - state->top_ptr) & state->buf_size_mask;
+   size_t first = state->buf_size - start;
+   if (entries <= first)
+      state_delta_apply(state->tmp_state, state->buffer + start, entries);
+   else
+   {
+      state_delta_apply(state->tmp_state, state->buffer + start, first);
+      state_delta_apply(state->tmp_state, state->buffer, entries - first);
    }
 
    if (state->top_ptr == state->bottom_ptr) // Our stack is completely empty... :v
@@ -160,22 +167,26 @@ static void generate_delta(state_manager_t *state, const void *data)
    if (state->top_ptr == state->bottom_ptr)
       crossed = true;
 
-   for (uint64_t i = 0; i < state->state_size; i++)
+   // If the data differs (xor != 0), we push that xor on the stack with index and xor.
+   // This can be reversed by reapplying the xor.
+   // This, if states don't really differ much, we'll save lots of space :)
+   // Hopefully this will work really well with save states.
+   // Words are encoded in chunks which cannot produce more entries than fit before the end of the buffer.
+   for (size_t i = 0; i < state->state_size; )
    {
-      uint64_t xor_ = old_state[i] ^ new_state[i];
+      size_t words = state->buf_size - state->top_ptr;
+      if (words > state->state_size - i)
+         words = state->state_size - i;
 
-      // If the data differs (xor != 0), we push that xor on the stack with index and xor.
-      // This can be reversed by reapplying the xor.
-      // This, if states don't really differ much, we'll save lots of space :)
-      // Hopefully this will work really well with save states.
-      if (xor_)
-      {
-         state->buffer[state->top_ptr] = (i << 32) | xor_;
-         state->top_ptr = (state->top_ptr + 1) & state->buf_size_mask;
+      size_t entries = state_delta_encode(state->buffer + state->top_ptr, old_state, new_state, i, i + words);
 
-         if (state->top_ptr == state->bottom_ptr)
-            crossed = true;
-      }
+      // Bottom is overwritten if it lies within the entries just written.
+      size_t to_bottom = (state->bottom_ptr - state->top_ptr) & state->buf_size_mask;
+      if (to_bottom && to_bottom <= entries)
+         crossed = true;
+
+      state->top_ptr = (state->top_ptr + entries) & state->buf_size_mask;
+      i += words;
    }
 
    if (crossed)
@@ -191,3 +202,21 @@ bool state_manager_push(state_manager_t *state, const void *data)
    return true;
 }
 
+size_t state_delta_encode(uint64_t *delta, const uint32_t *old_state, const uint32_t *new_state, size_t begin, size_t end)
+{
+   size_t entries = 0;
+   for (uint64_t i = begin; i < end; i++)
+   {
+      uint64_t xor_ = old_state[i] ^ new_state[i];
+      if (xor_)
+         delta[entries++] = (i << 32) | xor_;
+   }
+
+   return entries;
+}
+
+void state_delta_apply(uint32_t *state, const uint64_t *delta, size_t entries)
+{
+   for (size_t i = 0; i < entries; i++)
+      state[delta[i] >> 32] ^= delta[i] & 0xFFFFFFFFU;
+}
@@ -17,6 +17,7 @@
 #define __RARCH_REWIND_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include "boolean.h"
 
 typedef struct state_manager state_manager_t;
@@ -28,4 +29,11 @@ void state_manager_free(state_manager_t *state);
 bool state_manager_pop(state_manager_t *state, void **data);
 bool state_manager_push(state_manager_t *state, const void *data);
 
+// The XOR delta format used by the rewind buffer.
+// A delta is a list of (word index << 32) | xor pairs. Applying it to the old state gives the new one.
+// Encodes the words in [begin, end). delta must have room for end - begin entries.
+// Returns the number of entries written.
+size_t state_delta_encode(uint64_t *delta, const uint32_t *old_state, const uint32_t *new_state, size_t begin, size_t end);
+void state_delta_apply(uint32_t *state, const uint64_t *delta, size_t entries);
+
 #endif
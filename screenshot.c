@@ -16,33 +16,99 @@
 #include "screenshot.h"
 #include "compat/strl.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 #include "boolean.h"
 #include <stdint.h>
 #include <string.h>
 #include "general.h"
+#include "gfx/scaler/pixconv.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
+#ifdef HAVE_THREADS
+#include "thread.h"
+#endif
+
 #ifdef HAVE_LIBPNG
 #include <png.h>
 #endif
 
+// Screenshots are converted to packed BGR24 on the calling thread
+// into a pooled buffer, and encoded/written out on a worker thread
+// so that taking a screenshot never stalls the frame loop on zlib or disk I/O.
+#define SCREENSHOT_POOL_SIZE 2
+
+struct screenshot_job
+{
+   FILE *file;
+   char filename[PATH_MAX];
+
+   uint8_t *buffer;
+   size_t buffer_size;
+   size_t line_size;
+   unsigned width;
+   unsigned height;
+
 #ifdef HAVE_LIBPNG
-static png_structp png_ptr;
-static png_infop png_info_ptr;
+   int compression;
+   int filter;
+#endif
 
-static void destroy_png(void)
+   // Whether the outcome should be shown on screen once the job completes.
+   bool notify;
+   bool busy;
+};
+
+static struct screenshot_job screenshot_jobs[SCREENSHOT_POOL_SIZE];
+
+#ifdef HAVE_THREADS
+static sthread_t *screenshot_thread;
+static slock_t *screenshot_lock;
+static scond_t *screenshot_cond_job;
+static scond_t *screenshot_cond_done;
+static struct screenshot_job *screenshot_queue[SCREENSHOT_POOL_SIZE];
+static unsigned screenshot_queue_ptr;
+static unsigned screenshot_queue_count;
+static bool screenshot_quit;
+#endif
+
+// Outcome of the last finished job, shown by screenshot_poll() on the main thread
+// as the message queue is not thread-safe.
+static const char *screenshot_result_msg;
+
+#ifdef HAVE_LIBPNG
+static int png_filter_from_string(const char *str)
 {
-   if (png_ptr)
-      png_destroy_write_struct(&png_ptr, &png_info_ptr);
+   static const struct
+   {
+      const char *ident;
+      int filter;
+   } filters[] = {
+      { "none",  PNG_FILTER_NONE },
+      { "sub",   PNG_FILTER_SUB },
+      { "up",    PNG_FILTER_UP },
+      { "avg",   PNG_FILTER_AVG },
+      { "paeth", PNG_FILTER_PAETH },
+      { "all",   PNG_ALL_FILTERS },
+   };
+
+   for (unsigned i = 0; i < sizeof(filters) / sizeof(filters[0]); i++)
+      if (strcmp(str, filters[i].ident) == 0)
+         return filters[i].filter;
+
+   // Let libpng pick adaptively.
+   return -1;
 }
 
-static bool write_header_png(FILE *file, unsigned width, unsigned height)
+static bool dump_png(const struct screenshot_job *job)
 {
-   png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+   // Assigned after setjmp() and read after longjmp().
+   png_infop volatile png_info_ptr = NULL;
+   png_infop info_ptr;
+   png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
    if (!png_ptr)
       return false;
 
@@ -53,51 +119,41 @@ static bool write_header_png(FILE *file, unsigned width, unsigned height)
    if (!png_info_ptr)
       goto error;
 
-   png_init_io(png_ptr, file);
+   png_init_io(png_ptr, job->file);
+
+   png_set_compression_level(png_ptr, job->compression);
+   if (job->filter >= 0)
+      png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, job->filter);
 
-   png_set_IHDR(png_ptr, png_info_ptr, width, height, 8,
+   png_set_IHDR(png_ptr, png_info_ptr, job->width, job->height, 8,
          PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
          PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
    png_write_info(png_ptr, png_info_ptr);
-   png_set_compression_level(png_ptr, 9);
+   png_set_bgr(png_ptr);
 
+   // Buffer is already laid out top-down, as PNG expects.
+   for (unsigned i = 0; i < job->height; i++)
+      png_write_row(png_ptr, job->buffer + i * job->line_size);
+
+   png_write_end(png_ptr, NULL);
+   info_ptr = png_info_ptr;
+   png_destroy_write_struct(&png_ptr, &info_ptr);
    return true;
 
 error:
-   destroy_png();
+   info_ptr = png_info_ptr;
+   png_destroy_write_struct(&png_ptr, &info_ptr);
    return false;
 }
 
-static void dump_lines_png(uint8_t **lines, int height)
-{
-   if (setjmp(png_jmpbuf(png_ptr)))
-   {
-      RARCH_ERR("PNG: dump_lines_png() failed!\n");
-      goto end;
-   }
-
-   // PNG is top-down, BMP is bottom-up.
-   for (int i = 0, j = height - 1; i < j; i++, j--)
-   {
-      uint8_t *tmp = lines[i];
-      lines[i] = lines[j];
-      lines[j] = tmp;
-   }
-
-   png_set_rows(png_ptr, png_info_ptr, lines);
-   png_write_png(png_ptr, png_info_ptr, PNG_TRANSFORM_BGR, NULL);
-   png_write_end(png_ptr, NULL);
-
-end:
-   destroy_png();
-}
-
 #else
 
-static bool write_header_bmp(FILE *file, unsigned width, unsigned height)
+static bool dump_bmp(const struct screenshot_job *job)
 {
-   unsigned line_size = (width * 3 + 3) & ~3;
+   unsigned width = job->width;
+   unsigned height = job->height;
+   unsigned line_size = job->line_size;
    unsigned size = line_size * height + 54;
    unsigned size_array = line_size * height;
 
@@ -120,79 +176,200 @@ static bool write_header_bmp(FILE *file, unsigned width, unsigned height)
       0, 0, 0, 0
    };
 
-   return fwrite(header, 1, sizeof(header), file) == sizeof(header);
-}
+   if (fwrite(header, 1, sizeof(header), job->file) != sizeof(header))
+      return false;
 
-static void dump_lines_file(FILE *file, uint8_t **lines, size_t line_size, unsigned height)
-{
-   for (unsigned i = 0; i < height; i++)
-      fwrite(lines[i], 1, line_size, file);
+   // Buffer is laid out bottom-up with padded lines, as BMP expects.
+   return fwrite(job->buffer, 1, size_array, job->file) == size_array;
 }
-
 #endif
 
-static void dump_line_bgr(uint8_t *line, const uint8_t *src, unsigned width)
+static bool encode_job(struct screenshot_job *job)
 {
-   memcpy(line, src, width * 3);
+#ifdef HAVE_LIBPNG
+   bool ret = dump_png(job);
+#else
+   bool ret = dump_bmp(job);
+#endif
+
+   if (fclose(job->file) != 0)
+      ret = false;
+   job->file = NULL;
+
+   if (!ret)
+      RARCH_ERR("Failed to write screenshot \"%s\".\n", job->filename);
+
+   return ret;
 }
 
-static void dump_line_16(uint8_t *line, const uint16_t *src, unsigned width)
+// Converts the frame to packed BGR24 lines in the order the image format stores them.
+// Frame is passed bottom-up (the first line in memory is the bottom line of the image).
+static bool capture_frame(struct screenshot_job *job, const void *frame,
+      unsigned width, unsigned height, int pitch, enum screenshot_format fmt)
 {
-   for (unsigned i = 0; i < width; i++)
+   const uint8_t *input = (const uint8_t*)frame;
+
+#ifdef HAVE_LIBPNG
+   size_t line_size = width * 3;
+   // PNG is top-down, so start at the last line and walk backwards.
+   input += (int)(height - 1) * pitch;
+   pitch = -pitch;
+#else
+   size_t line_size = (width * 3 + 3) & ~3;
+#endif
+
+   size_t size = line_size * height;
+   if (size > job->buffer_size)
+   {
+      uint8_t *buffer = (uint8_t*)realloc(job->buffer, size);
+      if (!buffer)
+         return false;
+      job->buffer = buffer;
+      job->buffer_size = size;
+   }
+
+   job->width = width;
+   job->height = height;
+   job->line_size = line_size;
+
+   switch (fmt)
    {
-      uint16_t pixel = *src++;
-      uint8_t b = (pixel >>  0) & 0x1f;
-      uint8_t g = (pixel >>  5) & 0x1f;
-      uint8_t r = (pixel >> 10) & 0x1f;
-      *line++   = (b << 3) | (b >> 2);
-      *line++   = (g << 3) | (g >> 2);
-      *line++   = (r << 3) | (r >> 2);
+      case SCREENSHOT_FORMAT_0RGB1555:
+         conv_0rgb1555_bgr24(job->buffer, input, width, height, line_size, pitch);
+         break;
+
+      case SCREENSHOT_FORMAT_XRGB8888:
+         conv_argb8888_bgr24(job->buffer, input, width, height, line_size, pitch);
+         break;
+
+      default: // BGR24 byte order. Can directly copy.
+         for (unsigned i = 0; i < height; i++, input += pitch)
+            memcpy(job->buffer + i * line_size, input, width * 3);
+         break;
    }
+
+#ifndef HAVE_LIBPNG
+   // Clear line padding.
+   if (line_size > width * 3)
+   {
+      for (unsigned i = 0; i < height; i++)
+         memset(job->buffer + i * line_size + width * 3, 0, line_size - width * 3);
+   }
+#endif
+
+   return true;
 }
 
-static void dump_content(FILE *file, const void *frame,
-      int width, int height, int pitch, bool bgr24)
+#ifdef HAVE_THREADS
+static void screenshot_thread_loop(void *data)
 {
-   const uint8_t  *frame_bgr = (const uint8_t*)frame;
-   const uint16_t *frame16   = (const uint16_t*)frame;
+   (void)data;
 
-   if (!bgr24)
-      pitch /= sizeof(uint16_t);
+   slock_lock(screenshot_lock);
+   for (;;)
+   {
+      while (!screenshot_queue_count && !screenshot_quit)
+         scond_wait(screenshot_cond_job, screenshot_lock);
 
-   uint8_t **lines = (uint8_t**)calloc(height, sizeof(uint8_t*));
-   if (!lines)
-      return;
+      if (!screenshot_queue_count)
+         break;
 
-   size_t line_size = (width * 3 + 3) & ~3;
+      struct screenshot_job *job = screenshot_queue[screenshot_queue_ptr];
+      screenshot_queue_ptr = (screenshot_queue_ptr + 1) % SCREENSHOT_POOL_SIZE;
+      screenshot_queue_count--;
 
-   for (int i = 0; i < height; i++)
-   {
-      lines[i] = (uint8_t*)calloc(1, line_size);
-      if (!lines[i])
-         goto end;
+      slock_unlock(screenshot_lock);
+      bool ret = encode_job(job);
+      slock_lock(screenshot_lock);
+
+      if (job->notify)
+         screenshot_result_msg = ret ? "Screenshot saved." : "Failed to write screenshot.";
+      job->busy = false;
+      scond_signal(screenshot_cond_done);
    }
+   slock_unlock(screenshot_lock);
+}
+
+static bool init_screenshot_thread(void)
+{
+   if (screenshot_thread)
+      return true;
+
+   screenshot_lock = slock_new();
+   screenshot_cond_job = scond_new();
+   screenshot_cond_done = scond_new();
+   screenshot_quit = false;
+   screenshot_queue_ptr = 0;
+   screenshot_queue_count = 0;
 
-   if (bgr24) // BGR24 byte order. Can directly copy.
+   if (screenshot_lock && screenshot_cond_job && screenshot_cond_done)
+      screenshot_thread = sthread_create(screenshot_thread_loop, NULL);
+
+   if (!screenshot_thread)
    {
-      for (int j = 0; j < height; j++, frame_bgr += pitch)
-         dump_line_bgr(lines[j], frame_bgr, width);
+      RARCH_WARN("Failed to start screenshot thread, encoding synchronously.\n");
+      if (screenshot_lock)
+         slock_free(screenshot_lock);
+      if (screenshot_cond_job)
+         scond_free(screenshot_cond_job);
+      if (screenshot_cond_done)
+         scond_free(screenshot_cond_done);
+      screenshot_lock = NULL;
+      screenshot_cond_job = NULL;
+      screenshot_cond_done = NULL;
+      return false;
    }
-   else // ARGB1555
+
+   return true;
+}
+
+// Blocks until a pooled job is available. Only happens if screenshots
+// are requested faster than they can be encoded.
+static struct screenshot_job *acquire_job(void)
+{
+   slock_lock(screenshot_lock);
+   for (;;)
    {
-      for (int j = 0; j < height; j++, frame16 += pitch)
-         dump_line_16(lines[j], frame16, width);
+      for (unsigned i = 0; i < SCREENSHOT_POOL_SIZE; i++)
+      {
+         if (!screenshot_jobs[i].busy)
+         {
+            screenshot_jobs[i].busy = true;
+            slock_unlock(screenshot_lock);
+            return &screenshot_jobs[i];
+         }
+      }
+
+      scond_wait(screenshot_cond_done, screenshot_lock);
    }
+}
+
+static void release_job(struct screenshot_job *job)
+{
+   slock_lock(screenshot_lock);
+   job->busy = false;
+   slock_unlock(screenshot_lock);
+}
+
+static void submit_job(struct screenshot_job *job)
+{
+   slock_lock(screenshot_lock);
+   screenshot_queue[(screenshot_queue_ptr + screenshot_queue_count) % SCREENSHOT_POOL_SIZE] = job;
+   screenshot_queue_count++;
+   scond_signal(screenshot_cond_job);
+   slock_unlock(screenshot_lock);
+}
+#endif
 
 #ifdef HAVE_LIBPNG
-   dump_lines_png(lines, height);
+#define IMG_EXT "png"
 #else
-   dump_lines_file(file, lines, line_size, height);
+#define IMG_EXT "bmp"
 #endif
 
-end:
-   for (int i = 0; i < height; i++)
-      free(lines[i]);
-   free(lines);
+const char *screenshot_extension(void)
+{
+   return IMG_EXT;
 }
 
 void screenshot_generate_filename(char *filename, size_t size)
@@ -200,17 +377,65 @@ void screenshot_generate_filename(char *filename, size_t size)
    time_t cur_time;
    time(&cur_time);
 
-#ifdef HAVE_LIBPNG
-#define IMG_EXT "png"
+   strftime(filename, size, "RetroArch-%m%d-%H%M%S." IMG_EXT, localtime(&cur_time));
+}
+
+static bool dump_job(const char *path, const void *frame,
+      unsigned width, unsigned height, int pitch, enum screenshot_format fmt, bool notify)
+{
+   struct screenshot_job *job;
+
+#ifdef HAVE_THREADS
+   bool threaded = init_screenshot_thread();
+   job = threaded ? acquire_job() : &screenshot_jobs[0];
 #else
-#define IMG_EXT "bmp"
+   job = &screenshot_jobs[0];
 #endif
 
-   strftime(filename, size, "RetroArch-%m%d-%H%M%S." IMG_EXT, localtime(&cur_time));
+   strlcpy(job->filename, path, sizeof(job->filename));
+   job->notify = notify;
+
+   if (!capture_frame(job, frame, width, height, pitch, fmt))
+   {
+      RARCH_ERR("Failed to allocate screenshot buffer.\n");
+      goto error;
+   }
+
+   job->file = fopen(job->filename, "wb");
+   if (!job->file)
+   {
+      RARCH_ERR("Failed to open file \"%s\" for screenshot.\n", job->filename);
+      goto error;
+   }
+
+#ifdef HAVE_LIBPNG
+   job->compression = g_settings.screenshot_png_compression > 9 ? 9 : g_settings.screenshot_png_compression;
+   job->filter = png_filter_from_string(g_settings.screenshot_png_filter);
+#endif
+
+#ifdef HAVE_THREADS
+   if (threaded)
+   {
+      submit_job(job);
+      return true;
+   }
+#endif
+
+   bool ret = encode_job(job);
+   if (notify)
+      screenshot_result_msg = ret ? "Screenshot saved." : "Failed to write screenshot.";
+   return true;
+
+error:
+#ifdef HAVE_THREADS
+   if (threaded)
+      release_job(job);
+#endif
+   return false;
 }
 
 bool screenshot_dump(const char *folder, const void *frame,
-      unsigned width, unsigned height, int pitch, bool bgr24)
+      unsigned width, unsigned height, int pitch, enum screenshot_format fmt)
 {
    char filename[PATH_MAX];
    char shotname[PATH_MAX];
@@ -218,25 +443,59 @@ bool screenshot_dump(const char *folder, const void *frame,
    screenshot_generate_filename(shotname, sizeof(shotname));
    snprintf(filename, sizeof(filename), "%s/%s", folder, shotname);
 
-   FILE *file = fopen(filename, "wb");
-   if (!file)
-   {
-      RARCH_ERR("Failed to open file \"%s\" for screenshot.\n", filename);
-      return false;
-   }
+   return dump_job(filename, frame, width, height, pitch, fmt, true);
+}
 
-#ifdef HAVE_LIBPNG
-   bool ret = write_header_png(file, width, height);
-#else
-   bool ret = write_header_bmp(file, width, height);
-#endif
+bool screenshot_dump_path(const char *path, const void *frame,
+      unsigned width, unsigned height, int pitch, enum screenshot_format fmt)
+{
+   return dump_job(path, frame, width, height, pitch, fmt, false);
+}
 
-   if (ret)
-      dump_content(file, frame, width, height, pitch, bgr24);
-   else
-      RARCH_ERR("Failed to write image header.\n");
+void screenshot_poll(void)
+{
+   const char *msg;
 
-   fclose(file);
-   return ret;
+#ifdef HAVE_THREADS
+   if (screenshot_lock)
+      slock_lock(screenshot_lock);
+#endif
+   msg = screenshot_result_msg;
+   screenshot_result_msg = NULL;
+#ifdef HAVE_THREADS
+   if (screenshot_lock)
+      slock_unlock(screenshot_lock);
+#endif
+
+   if (msg)
+      msg_queue_push(g_extern.msg_queue, msg, 1, 180);
 }
 
+void screenshot_deinit(void)
+{
+#ifdef HAVE_THREADS
+   if (screenshot_thread)
+   {
+      // Finish any screenshots still in flight before tearing down.
+      slock_lock(screenshot_lock);
+      screenshot_quit = true;
+      scond_signal(screenshot_cond_job);
+      slock_unlock(screenshot_lock);
+
+      sthread_join(screenshot_thread);
+      slock_free(screenshot_lock);
+      scond_free(screenshot_cond_job);
+      scond_free(screenshot_cond_done);
+      screenshot_thread = NULL;
+      screenshot_lock = NULL;
+      screenshot_cond_job = NULL;
+      screenshot_cond_done = NULL;
+   }
+#endif
+
+   for (unsigned i = 0; i < SCREENSHOT_POOL_SIZE; i++)
+   {
+      free(screenshot_jobs[i].buffer);
+      memset(&screenshot_jobs[i], 0, sizeof(screenshot_jobs[i]));
+   }
+}
@@ -20,8 +20,35 @@
 #include <stddef.h>
 #include "boolean.h"
 
+enum screenshot_format
+{
+   SCREENSHOT_FORMAT_BGR24 = 0,
+   SCREENSHOT_FORMAT_0RGB1555,
+   SCREENSHOT_FORMAT_XRGB8888
+};
+
+// Frame is passed bottom-up. The frame is converted before returning,
+// but encoding and writing to disk may complete asynchronously,
+// so returning true only means the screenshot was queued.
+// The final outcome is shown on screen by screenshot_poll().
 bool screenshot_dump(const char *folder, const void *frame, 
-      unsigned width, unsigned height, int pitch, bool bgr24);
+      unsigned width, unsigned height, int pitch, enum screenshot_format fmt);
+
+// As screenshot_dump(), but writes to path rather than a generated name.
+// The outcome is only logged, not shown on screen.
+// path should end with screenshot_extension().
+bool screenshot_dump_path(const char *path, const void *frame,
+      unsigned width, unsigned height, int pitch, enum screenshot_format fmt);
+
+// File extension of the image format screenshots are written in, without the dot.
+const char *screenshot_extension(void);
+
+// Pushes the outcome of screenshots finished since the last call to the message queue.
+// Must be called from the main thread.
+void screenshot_poll(void);
+
+// Waits for pending screenshots to be written, and frees buffers.
+void screenshot_deinit(void);
 
 void screenshot_generate_filename(char *filename, size_t size);
 
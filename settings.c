@@ -119,6 +119,8 @@ const char *config_get_default_input(void)
          return "gx";
       case INPUT_LINUXRAW:
          return "linuxraw";
+      case INPUT_EVDEV:
+         return "evdev";
       case INPUT_NULL:
          return "null";
       default:
@@ -147,6 +149,9 @@ void config_set_defaults(void)
    g_settings.video.force_16bit = force_16bit;
    g_settings.video.disable_composition = disable_composition;
    g_settings.video.vsync = vsync;
+   g_settings.video.frame_delay = frame_delay;
+   g_settings.video.frame_delay_auto = frame_delay_auto;
+   g_settings.video.fastforward_frameskip = fastforward_frameskip;
    g_settings.video.smooth = video_smooth;
    g_settings.video.force_aspect = force_aspect;
    g_settings.video.crop_overscan = crop_overscan;
@@ -154,6 +159,8 @@ void config_set_defaults(void)
    g_settings.video.aspect_ratio_auto = aspect_ratio_auto; // Let implementation decide if automatic, or 1:1 PAR.
    g_settings.video.shader_type = RARCH_SHADER_AUTO;
    g_settings.video.allow_rotate = allow_rotate;
+   g_settings.video.filter_threads = filter_threads;
+   g_settings.video.scaler_threads = scaler_threads;
 
 #ifdef HAVE_FREETYPE
    g_settings.video.font_enable = font_enable;
@@ -177,9 +184,15 @@ void config_set_defaults(void)
    g_settings.video.refresh_rate = refresh_rate;
    g_settings.video.hires_record = hires_record;
    g_settings.video.h264_record = h264_record;
+   g_settings.video.yuv_record = yuv_record;
    g_settings.video.post_filter_record = post_filter_record;
    g_settings.video.gpu_record = gpu_record;
    g_settings.video.gpu_screenshot = gpu_screenshot;
+   g_settings.video.headless_scale = headless_scale;
+   g_settings.video.headless_hash = headless_hash;
+   g_settings.video.headless_dump_interval = headless_dump_interval;
+   g_settings.screenshot_png_compression = screenshot_png_compression;
+   strlcpy(g_settings.screenshot_png_filter, screenshot_png_filter, sizeof(g_settings.screenshot_png_filter));
 
    g_settings.audio.enable = audio_enable;
    g_settings.audio.out_rate = out_rate;
@@ -194,6 +207,13 @@ void config_set_defaults(void)
    g_settings.rewind_enable = rewind_enable;
    g_settings.rewind_buffer_size = rewind_buffer_size;
    g_settings.rewind_granularity = rewind_granularity;
+   g_settings.run_ahead_frames = run_ahead_frames;
+   g_settings.netplay_delta_states = netplay_delta_states;
+   g_settings.netplay_checkpoint_interval = netplay_checkpoint_interval;
+   g_settings.netplay_max_spectators = netplay_max_spectators;
+   g_settings.netplay_spectator_lag = netplay_spectator_lag;
+   g_settings.netplay_input_delay_min = netplay_input_delay_min;
+   g_settings.netplay_input_delay_max = netplay_input_delay_max;
    g_settings.slowmotion_ratio = slowmotion_ratio;
    g_settings.pause_nonactive = pause_nonactive;
    g_settings.autosave_interval = autosave_interval;
@@ -204,6 +224,7 @@ void config_set_defaults(void)
    g_settings.network_cmd_enable   = network_cmd_enable;
    g_settings.network_cmd_port     = network_cmd_port;
    g_settings.stdin_cmd_enable     = stdin_cmd_enable;
+   g_settings.perfcnt_enable       = perfcnt_enable;
 
    rarch_assert(sizeof(g_settings.input.binds[0]) >= sizeof(retro_keybinds_1));
    rarch_assert(sizeof(g_settings.input.binds[1]) >= sizeof(retro_keybinds_rest));
@@ -356,6 +377,9 @@ bool config_load_file(const char *path)
    CONFIG_GET_BOOL(video.force_16bit, "video_force_16bit");
    CONFIG_GET_BOOL(video.disable_composition, "video_disable_composition");
    CONFIG_GET_BOOL(video.vsync, "video_vsync");
+   CONFIG_GET_INT(video.frame_delay, "video_frame_delay");
+   CONFIG_GET_BOOL(video.frame_delay_auto, "video_frame_delay_auto");
+   CONFIG_GET_INT(video.fastforward_frameskip, "video_fastforward_frameskip");
    CONFIG_GET_BOOL(video.smooth, "video_smooth");
    CONFIG_GET_BOOL(video.force_aspect, "video_force_aspect");
    CONFIG_GET_BOOL(video.crop_overscan, "video_crop_overscan");
@@ -391,12 +415,20 @@ bool config_load_file(const char *path)
 
    CONFIG_GET_BOOL(video.hires_record, "video_hires_record");
    CONFIG_GET_BOOL(video.h264_record, "video_h264_record");
+   CONFIG_GET_BOOL(video.yuv_record, "video_yuv_record");
    CONFIG_GET_BOOL(video.post_filter_record, "video_post_filter_record");
    CONFIG_GET_BOOL(video.gpu_record, "video_gpu_record");
    CONFIG_GET_BOOL(video.gpu_screenshot, "video_gpu_screenshot");
+   CONFIG_GET_INT(video.scaler_threads, "video_scaler_threads");
+
+   CONFIG_GET_BOOL(video.headless_scale, "video_headless_scale");
+   CONFIG_GET_BOOL(video.headless_hash, "video_headless_hash");
+   CONFIG_GET_INT(video.headless_dump_interval, "video_headless_dump_interval");
+   CONFIG_GET_PATH(video.headless_dump_directory, "video_headless_dump_directory");
 
 #ifdef HAVE_DYLIB
    CONFIG_GET_PATH(video.filter_path, "video_filter");
+   CONFIG_GET_INT(video.filter_threads, "video_filter_threads");
    CONFIG_GET_PATH(video.external_driver, "video_external_driver");
    CONFIG_GET_PATH(audio.external_driver, "audio_external_driver");
 #endif
@@ -453,6 +485,8 @@ bool config_load_file(const char *path)
       RARCH_WARN("screenshot_directory is not an existing directory, ignoring ...\n");
       *g_settings.screenshot_directory = '\0';
    }
+   CONFIG_GET_INT(screenshot_png_compression, "screenshot_png_compression");
+   CONFIG_GET_STRING(screenshot_png_filter, "screenshot_png_filter");
 
    CONFIG_GET_BOOL(rewind_enable, "rewind_enable");
 
@@ -461,6 +495,13 @@ bool config_load_file(const char *path)
       g_settings.rewind_buffer_size = buffer_size * UINT64_C(1000000);
 
    CONFIG_GET_INT(rewind_granularity, "rewind_granularity");
+   CONFIG_GET_INT(run_ahead_frames, "run_ahead_frames");
+   CONFIG_GET_BOOL(netplay_delta_states, "netplay_delta_states");
+   CONFIG_GET_INT(netplay_checkpoint_interval, "netplay_checkpoint_interval");
+   CONFIG_GET_INT(netplay_max_spectators, "netplay_max_spectators");
+   CONFIG_GET_INT(netplay_spectator_lag, "netplay_spectator_lag");
+   CONFIG_GET_INT(netplay_input_delay_min, "netplay_input_delay_min");
+   CONFIG_GET_INT(netplay_input_delay_max, "netplay_input_delay_max");
    CONFIG_GET_FLOAT(slowmotion_ratio, "slowmotion_ratio");
    if (g_settings.slowmotion_ratio < 1.0f)
       g_settings.slowmotion_ratio = 1.0f;
@@ -479,6 +520,8 @@ bool config_load_file(const char *path)
    CONFIG_GET_INT(network_cmd_port, "network_cmd_port");
    CONFIG_GET_BOOL(stdin_cmd_enable, "stdin_cmd_enable");
 
+   CONFIG_GET_BOOL(perfcnt_enable, "perfcnt_enable");
+
    if (config_get_string(conf, "environment_variables",
             &g_extern.system.environment))
    {
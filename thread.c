@@ -26,6 +26,7 @@
 #else
 #include <pthread.h>
 #include <time.h>
+#include <unistd.h>
 #endif
 
 #ifdef __MACH__
@@ -321,3 +322,177 @@ void scond_signal(scond_t *cond)
 
 #endif
 
+unsigned sthread_get_cpu_cores(void)
+{
+#if defined(_WIN32) && !defined(_XBOX)
+   SYSTEM_INFO info;
+   GetSystemInfo(&info);
+   return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+#elif defined(_SC_NPROCESSORS_ONLN)
+   long cores = sysconf(_SC_NPROCESSORS_ONLN);
+   return cores > 0 ? cores : 1;
+#else
+   return 1;
+#endif
+}
+
+struct sthread_pool_worker
+{
+   sthread_pool_t *pool;
+   sthread_t *thread;
+   scond_t *cond;
+   unsigned index;
+   bool go;
+};
+
+struct sthread_pool
+{
+   slock_t *lock;
+   scond_t *done_cond;
+
+   struct sthread_pool_worker *workers;
+   unsigned threads;
+   unsigned pending;
+   bool quit;
+
+   void (*job)(void*, unsigned, unsigned);
+   void *userdata;
+};
+
+static void sthread_pool_loop(void *data)
+{
+   struct sthread_pool_worker *worker = (struct sthread_pool_worker*)data;
+   sthread_pool_t *pool = worker->pool;
+
+   for (;;)
+   {
+      slock_lock(pool->lock);
+      while (!worker->go && !pool->quit)
+         scond_wait(worker->cond, pool->lock);
+
+      if (pool->quit)
+      {
+         slock_unlock(pool->lock);
+         break;
+      }
+
+      worker->go = false;
+      slock_unlock(pool->lock);
+
+      pool->job(pool->userdata, worker->index, pool->threads);
+
+      slock_lock(pool->lock);
+      if (--pool->pending == 0)
+         scond_signal(pool->done_cond);
+      slock_unlock(pool->lock);
+   }
+}
+
+sthread_pool_t *sthread_pool_new(unsigned threads)
+{
+   if (threads < 1)
+      threads = 1;
+
+   sthread_pool_t *pool = (sthread_pool_t*)calloc(1, sizeof(*pool));
+   if (!pool)
+      return NULL;
+
+   pool->threads   = threads;
+   pool->lock      = slock_new();
+   pool->done_cond = scond_new();
+   // Worker 0 is the calling thread, and is never spawned.
+   pool->workers   = (struct sthread_pool_worker*)calloc(threads, sizeof(*pool->workers));
+
+   if (!pool->lock || !pool->done_cond || !pool->workers)
+      goto error;
+
+   for (unsigned i = 1; i < threads; i++)
+   {
+      struct sthread_pool_worker *worker = &pool->workers[i];
+      worker->pool  = pool;
+      worker->index = i;
+      worker->cond  = scond_new();
+      if (!worker->cond)
+         goto error;
+
+      worker->thread = sthread_create(sthread_pool_loop, worker);
+      if (!worker->thread)
+         goto error;
+   }
+
+   return pool;
+
+error:
+   sthread_pool_free(pool);
+   return NULL;
+}
+
+void sthread_pool_free(sthread_pool_t *pool)
+{
+   if (!pool)
+      return;
+
+   if (pool->workers)
+   {
+      if (pool->lock)
+      {
+         slock_lock(pool->lock);
+         pool->quit = true;
+         for (unsigned i = 1; i < pool->threads; i++)
+         {
+            if (pool->workers[i].cond)
+               scond_signal(pool->workers[i].cond);
+         }
+         slock_unlock(pool->lock);
+      }
+
+      for (unsigned i = 1; i < pool->threads; i++)
+      {
+         if (pool->workers[i].thread)
+            sthread_join(pool->workers[i].thread);
+         if (pool->workers[i].cond)
+            scond_free(pool->workers[i].cond);
+      }
+   }
+
+   if (pool->lock)
+      slock_free(pool->lock);
+   if (pool->done_cond)
+      scond_free(pool->done_cond);
+
+   free(pool->workers);
+   free(pool);
+}
+
+unsigned sthread_pool_threads(sthread_pool_t *pool)
+{
+   return pool->threads;
+}
+
+void sthread_pool_run(sthread_pool_t *pool,
+      void (*job)(void *userdata, unsigned index, unsigned count), void *userdata)
+{
+   if (pool->threads > 1)
+   {
+      slock_lock(pool->lock);
+      pool->job      = job;
+      pool->userdata = userdata;
+      pool->pending  = pool->threads - 1;
+      for (unsigned i = 1; i < pool->threads; i++)
+      {
+         pool->workers[i].go = true;
+         scond_signal(pool->workers[i].cond);
+      }
+      slock_unlock(pool->lock);
+   }
+
+   job(userdata, 0, pool->threads);
+
+   if (pool->threads > 1)
+   {
+      slock_lock(pool->lock);
+      while (pool->pending)
+         scond_wait(pool->done_cond, pool->lock);
+      slock_unlock(pool->lock);
+   }
+}
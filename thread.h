@@ -47,6 +47,21 @@ bool scond_wait_timeout(scond_t *cond, slock_t *lock, unsigned timeout_ms);
 #endif
 void scond_signal(scond_t *cond);
 
+// Number of CPU cores available, or 1 if it cannot be determined.
+unsigned sthread_get_cpu_cores(void);
+
+// Persistent pool of worker threads.
+// sthread_pool_run() calls job(userdata, index, count) for every index in [0, count),
+// where count is the number of threads in the pool.
+// Index 0 runs on the calling thread. The call returns when all jobs are done.
+typedef struct sthread_pool sthread_pool_t;
+
+sthread_pool_t *sthread_pool_new(unsigned threads);
+void sthread_pool_free(sthread_pool_t *pool);
+
+unsigned sthread_pool_threads(sthread_pool_t *pool);
+void sthread_pool_run(sthread_pool_t *pool,
+      void (*job)(void *userdata, unsigned index, unsigned count), void *userdata);
 
 #endif
 